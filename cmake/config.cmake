@@ -45,6 +45,11 @@ check_function_exists(clock_gettime HAVE_CLOCK_GETTIME)
 check_function_exists(posix_fadvise HAVE_POSIX_FADVISE)
 check_function_exists(ftruncate HAVE_FTRUNCATE)
 check_function_exists(pwrite HAVE_PWRITE)
+check_function_exists(copy_file_range HAVE_COPY_FILE_RANGE)
+check_function_exists(splice HAVE_SPLICE)
+check_function_exists(recvmmsg HAVE_RECVMMSG)
+check_function_exists(sendmmsg HAVE_SENDMMSG)
+check_function_exists(accept4 HAVE_ACCEPT4)
 check_function_exists(setpgrp HAVE_SETPGRP)
 check_function_exists(setlocale HAVE_SETLOCALE)
 check_function_exists(gettext HAVE_GETTEXT)
@@ -86,6 +91,12 @@ check_include_files(linux/version.h HAVE_LINUX_VERSION_H)
 check_include_files(regex.h HAVE_REGEX_H)
 check_include_files(sys/inotify.h HAVE_SYS_INOTIFY_H)
 check_include_files(sys/event.h HAVE_SYS_EVENT_H)
+check_include_files(sys/epoll.h HAVE_SYS_EPOLL_H)
+check_include_files(sys/eventfd.h HAVE_SYS_EVENTFD_H)
+check_include_files(linux/futex.h HAVE_LINUX_FUTEX_H)
+check_include_files(linux/io_uring.h HAVE_LINUX_IO_URING_H)
+check_include_files(ucontext.h HAVE_UCONTEXT_H)
+check_include_files(sys/sendfile.h HAVE_SYS_SENDFILE_H)
 check_include_files(syslog.h HAVE_SYSLOG_H)
 check_include_files(libintl.h HAVE_LIBINTL_H)
 check_include_files(netinet/in.h HAVE_NETINET_IN_H)
@@ -274,6 +274,20 @@ ssize_t UDPSocket::send(const void *buf, size_t len)
     return _IORET64 ::sendto(so, (const char *)buf, _IOLEN64 len, MSG_NOSIGNAL, addr, alen);
 }
 
+ssize_t UDPSocket::send(ucommon::PacketBuffer& packets)
+{
+    const struct sockaddr *addr = peer;
+    if(isConnected())
+        addr = NULL;
+
+    return ucommon::Socket::sendto(so, packets, 0, addr);
+}
+
+ssize_t UDPSocket::receive(ucommon::PacketBuffer& packets)
+{
+    return ucommon::Socket::recvfrom(so, packets);
+}
+
 ssize_t UDPSocket::receive(void *buf, size_t len, bool reply)
 {
     struct sockaddr *addr = peer;
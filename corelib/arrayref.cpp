@@ -21,10 +21,43 @@
 #include <ucommon/string.h>
 #include <ucommon/thread.h>
 #include <ucommon/arrayref.h>
+#include <ucommon/timers.h>
 #include <cstdlib>
 
 namespace ucommon {
 
+// lock-free queues keep the producer and consumer positions on cache lines
+// of their own after the slots, followed by the per-slot sequence numbers
+// of a multi-producer queue...
+
+typedef struct {
+    volatile size_t position;
+    size_t cached;
+} array_cursor;
+
+static size_t cacheline(void)
+{
+    size_t line = Thread::cache();
+    if(line < sizeof(array_cursor))
+        line = sizeof(array_cursor);
+    return line;
+}
+
+static inline array_cursor *producer(caddr_t ring)
+{
+    return reinterpret_cast<array_cursor *>(ring);
+}
+
+static inline array_cursor *consumer(caddr_t ring, size_t line)
+{
+    return reinterpret_cast<array_cursor *>(ring + line);
+}
+
+static inline volatile size_t *sequence(caddr_t ring, size_t line)
+{
+    return reinterpret_cast<volatile size_t *>(ring + (line * 2));
+}
+
 ArrayRef::Array::Array(arraytype_t arraymode, void *addr, size_t used) :
 Counted(addr, used), ConditionalAccess()
 {
@@ -33,6 +66,9 @@ Counted(addr, used), ConditionalAccess()
 
     head = 0;
     type = arraymode;
+    ring = NULL;
+    line = 0;
+    producers = consumers = 0;
     if(type == ARRAY)
         tail = size;
     else
@@ -44,6 +80,161 @@ Counted(addr, used), ConditionalAccess()
     while(index < used) {
         list[index++] = NULL;
     }
+
+    if(!lockfree())
+        return;
+
+    line = cacheline();
+    ring = (caddr_t)(&list[used]);
+    ring += line - ((uintptr_t)ring % line);
+    producer(ring)->position = producer(ring)->cached = 0;
+    consumer(ring, line)->position = consumer(ring, line)->cached = 0;
+    if(type == MPMC) {
+        volatile size_t *seq = sequence(ring, line);
+        for(index = 0; index < used; ++index)
+            seq[index] = index;
+    }
+}
+
+bool ArrayRef::Array::enqueue(Counted *object)
+{
+    array_cursor *in = producer(ring);
+    Counted **list = get();
+    size_t pos;
+
+    if(type == SPSC) {
+        pos = in->position;
+        if(pos - in->cached >= size) {
+            in->cached = Atomic::load(&consumer(ring, line)->position);
+            if(pos - in->cached >= size)
+                return false;
+        }
+        object->retain();
+        list[pos % size] = object;
+        Atomic::store(&in->position, pos + 1);
+        return true;
+    }
+
+    volatile size_t *seq = sequence(ring, line);
+    pos = Atomic::load(&in->position);
+    for(;;) {
+        size_t current = Atomic::load(&seq[pos % size]);
+        intptr_t diff = (intptr_t)current - (intptr_t)pos;
+        if(!diff) {
+            if(Atomic::compare_exchange(&in->position, pos, pos + 1))
+                break;
+        }
+        else if(diff < 0)
+            return false;
+        else
+            pos = Atomic::load(&in->position);
+    }
+    object->retain();
+    list[pos % size] = object;
+    Atomic::store(&seq[pos % size], pos + 1);
+    return true;
+}
+
+TypeRef::Counted *ArrayRef::Array::dequeue(void)
+{
+    array_cursor *out = consumer(ring, line);
+    Counted **list = get();
+    Counted *object;
+    size_t pos;
+
+    if(type == SPSC) {
+        pos = out->position;
+        if(pos == out->cached) {
+            out->cached = Atomic::load(&producer(ring)->position);
+            if(pos == out->cached)
+                return NULL;
+        }
+        object = list[pos % size];
+        list[pos % size] = NULL;
+        Atomic::store(&out->position, pos + 1);
+        return object;
+    }
+
+    volatile size_t *seq = sequence(ring, line);
+    pos = Atomic::load(&out->position);
+    for(;;) {
+        size_t current = Atomic::load(&seq[pos % size]);
+        intptr_t diff = (intptr_t)current - (intptr_t)(pos + 1);
+        if(!diff) {
+            if(Atomic::compare_exchange(&out->position, pos, pos + 1))
+                break;
+        }
+        else if(diff < 0)
+            return NULL;
+        else
+            pos = Atomic::load(&out->position);
+    }
+    object = list[pos % size];
+    list[pos % size] = NULL;
+    Atomic::store(&seq[pos % size], pos + size);
+    return object;
+}
+
+// waiters announce themselves before checking the queue again under the
+// lock, and the other side fences before looking for waiters, so a wakeup
+// cannot be lost between the check and the wait...
+
+bool ArrayRef::Array::push(Counted *object, timeout_t timeout)
+{
+    if(!object)
+        return true;
+
+    if(!enqueue(object)) {
+        lock();
+        Atomic::fetch_add(&producers, (atomic_t)1);
+        while(!enqueue(object)) {
+            if(timeout == Timer::inf)
+                waitSignal();
+            else if(!waitSignal(timeout)) {
+                Atomic::fetch_add(&producers, (atomic_t)-1);
+                unlock();
+                return false;
+            }
+        }
+        Atomic::fetch_add(&producers, (atomic_t)-1);
+        unlock();
+    }
+
+    Atomic::fence();
+    if(Atomic::load(&consumers)) {
+        lock();
+        broadcast();
+        unlock();
+    }
+    return true;
+}
+
+TypeRef::Counted *ArrayRef::Array::pull(timeout_t timeout)
+{
+    Counted *object = dequeue();
+
+    if(!object) {
+        lock();
+        Atomic::fetch_add(&consumers, (atomic_t)1);
+        while(NULL == (object = dequeue())) {
+            if(timeout == Timer::inf)
+                waitBroadcast();
+            else if(!waitBroadcast(timeout))
+                break;
+        }
+        Atomic::fetch_add(&consumers, (atomic_t)-1);
+        unlock();
+        if(!object)
+            return NULL;
+    }
+
+    Atomic::fence();
+    if(Atomic::load(&producers)) {
+        lock();
+        signal();
+        unlock();
+    }
+    return object;
 }
 
 void ArrayRef::Array::dealloc()
@@ -68,6 +259,9 @@ void ArrayRef::Array::dealloc()
 
 size_t ArrayRef::Array::count(void)
 {
+    if(lockfree())
+        return Atomic::load(&producer(ring)->position) - Atomic::load(&consumer(ring, line)->position);
+
     if(head <= tail)
         return tail - head;
 
@@ -146,6 +340,9 @@ void ArrayRef::reset(Counted *object)
     if(!array || !array->size || !object)
         return;
 
+    if(array->lockfree())
+        return;
+
     switch(array->type) {
     case ARRAY:
         max = array->size;
@@ -174,6 +371,13 @@ void ArrayRef::pop(void)
 
     if(!array || !array->size)
         return;
+
+    if(array->lockfree()) {
+        Counted *object = array->pull(0);
+        if(object)
+            object->release();
+        return;
+    }
    
     array->lock();
     switch(array->type) {
@@ -212,6 +416,15 @@ void ArrayRef::reset(TypeRef& var)
 
 void ArrayRef::clear(void)
 {
+    Array *array = polystatic_cast<Array *>(ref);
+
+    if(array && array->size && array->lockfree()) {
+        Counted *object;
+        while(NULL != (object = array->pull(0)))
+            object->release();
+        return;
+    }
+
     reset(nullptr);
 }
 
@@ -221,6 +434,10 @@ ArrayRef::Array *ArrayRef::create(arraytype_t mode, size_t size)
         return NULL;
 
     size_t s = sizeof(Array) + (size * sizeof(Counted *));
+    if(mode == MPMC || mode == SPSC)
+        s += cacheline() * 3;
+    if(mode == MPMC)
+        s += size * sizeof(size_t);
     caddr_t p = auto_release.allocate(s);
     return new(mem(p)) Array(mode, p, size);
 }
@@ -231,6 +448,9 @@ bool ArrayRef::push(const TypeRef& object, timeout_t timeout)
     if(!array || array->type == ARRAY)
         return false;
 
+    if(array->lockfree())
+        return array->push(object.ref, timeout);
+
     array->lock();
     while(array->count() >= (array->size - 1)) {
         if(!array->waitSignal(timeout)) {
@@ -264,6 +484,11 @@ void ArrayRef::push(const TypeRef& object)
     if(!array || array->type == ARRAY)
         return;
 
+    if(array->lockfree()) {
+        array->push(object.ref, Timer::inf);
+        return;
+    }
+
     array->lock();
     while(array->count() >= (array->size - 1)) {
         array->waitSignal();
@@ -283,6 +508,11 @@ void ArrayRef::pull(TypeRef& object, timeout_t timeout)
         return;
     }
 
+    if(array->lockfree()) {
+        object.ref = array->pull(timeout);
+        return;
+    }
+
     array->lock();
     for(;;) {
         if(array->head != array->tail) {
@@ -330,6 +560,11 @@ void ArrayRef::pull(TypeRef& object)
         return;
     }
 
+    if(array->lockfree()) {
+        object.ref = array->pull(Timer::inf);
+        return;
+    }
+
     array->lock();
     for(;;) {
         if(array->head != array->tail) {
@@ -428,7 +663,7 @@ TypeRef::Counted *ArrayRef::get(size_t index)
     if(!array)
         return NULL;
 
-    if(index >= array->size || array->head == array->tail) {
+    if(index >= array->size || array->head == array->tail || array->lockfree()) {
         return NULL;
 	}
 
@@ -0,0 +1,973 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ucommon-config.h>
+#include <ucommon/export.h>
+#include <ucommon/asyncio.h>
+#ifdef  HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef  HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(HAVE_POLL_H)
+#include <poll.h>
+#define USE_POLL
+#elif defined(HAVE_SYS_POLL_H)
+#include <sys/poll.h>
+#define USE_POLL
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_MMAN_H)
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(SYS_io_uring_setup) && defined(SYS_io_uring_enter) && defined(SYS_io_uring_register)
+#define USE_URING
+#endif
+#endif
+
+#ifndef ECANCELED
+#define ECANCELED   EINTR
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace ucommon {
+
+enum {
+    AIO_IDLE = 0,
+    AIO_PENDING,
+    AIO_DONE
+};
+
+enum {
+    AIO_READ = 0,
+    AIO_WRITE,
+    AIO_SYNC,
+    AIO_RECV,
+    AIO_SEND,
+    AIO_ACCEPT,
+    AIO_CONNECT
+};
+
+enum {
+    AIO_LINKED = 0x01
+};
+
+#ifdef  USE_URING
+
+static const unsigned char uring_ops[] = {
+    IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_RECV,
+    IORING_OP_SEND, IORING_OP_ACCEPT, IORING_OP_CONNECT,
+    IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED, IORING_OP_NOP,
+    IORING_OP_ASYNC_CANCEL
+};
+
+class __LOCAL AsyncIO::ring
+{
+private:
+    __DELETE_COPY(ring);
+
+public:
+    int fd;
+    unsigned tail, chained;
+    unsigned sqmask, cqmask;
+    volatile unsigned *sqhead, *sqtail, *sqarray;
+    volatile unsigned *cqhead, *cqtail;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqmap, *cqmap;
+    size_t sqlen, cqlen, sqeslen;
+
+    ring(unsigned entries);
+    ~ring();
+
+    bool probe(void);
+    struct io_uring_sqe *get(void);
+    void push(bool linked = false);
+    void submit(void);
+    void settle(void);
+    void close(void);
+
+    inline int enter(unsigned count, unsigned wait, unsigned flags) {
+        return (int)syscall(SYS_io_uring_enter, fd, count, wait, flags, NULL, 0);
+    }
+
+    inline int control(unsigned opcode, void *arg, unsigned count) {
+        return (int)syscall(SYS_io_uring_register, fd, opcode, arg, count);
+    }
+};
+
+AsyncIO::ring::ring(unsigned entries)
+{
+    struct io_uring_params params;
+
+    sqmap = cqmap = MAP_FAILED;
+    sqes = (struct io_uring_sqe *)MAP_FAILED;
+    sqlen = cqlen = sqeslen = 0;
+    tail = chained = 0;
+
+    memset(&params, 0, sizeof(params));
+    fd = (int)syscall(SYS_io_uring_setup, entries, &params);
+    if(fd < 0)
+        return;
+
+    // without nodrop, completions could be lost when the queue overflows...
+    if(!(params.features & IORING_FEAT_NODROP)) {
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+
+    sqlen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqlen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    sqeslen = params.sq_entries * sizeof(struct io_uring_sqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(cqlen > sqlen)
+            sqlen = cqlen;
+        cqlen = sqlen;
+    }
+
+    sqmap = ::mmap(NULL, sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(sqmap != MAP_FAILED && (params.features & IORING_FEAT_SINGLE_MMAP))
+        cqmap = sqmap;
+    else if(sqmap != MAP_FAILED)
+        cqmap = ::mmap(NULL, cqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if(cqmap != MAP_FAILED)
+        sqes = (struct io_uring_sqe *)::mmap(NULL, sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if(sqes == MAP_FAILED) {
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+
+    caddr_t sq = (caddr_t)sqmap;
+    caddr_t cq = (caddr_t)cqmap;
+    sqhead = (volatile unsigned *)(sq + params.sq_off.head);
+    sqtail = (volatile unsigned *)(sq + params.sq_off.tail);
+    sqarray = (volatile unsigned *)(sq + params.sq_off.array);
+    sqmask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    cqhead = (volatile unsigned *)(cq + params.cq_off.head);
+    cqtail = (volatile unsigned *)(cq + params.cq_off.tail);
+    cqmask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    tail = *sqtail;
+
+    if(!probe()) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+AsyncIO::ring::~ring()
+{
+    if(sqes != MAP_FAILED)
+        ::munmap(sqes, sqeslen);
+    if(cqmap != MAP_FAILED && cqmap != sqmap)
+        ::munmap(cqmap, cqlen);
+    if(sqmap != MAP_FAILED)
+        ::munmap(sqmap, sqlen);
+    if(fd > -1)
+        ::close(fd);
+}
+
+// older kernels may have io_uring but not every operation we use...
+
+bool AsyncIO::ring::probe(void)
+{
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *info = (struct io_uring_probe *)::calloc(1, size);
+    bool result = true;
+
+    if(!info)
+        return false;
+
+    if(control(IORING_REGISTER_PROBE, info, 256) < 0)
+        result = false;
+
+    for(unsigned pos = 0; result && pos < sizeof(uring_ops); ++pos) {
+        unsigned op = uring_ops[pos];
+        if(op > info->last_op || !(info->ops[op].flags & IO_URING_OP_SUPPORTED))
+            result = false;
+    }
+
+    ::free(info);
+    return result;
+}
+
+struct io_uring_sqe *AsyncIO::ring::get(void)
+{
+    if(tail - Atomic::load(sqhead) > sqmask)
+        return NULL;
+
+    struct io_uring_sqe *sqe = &sqes[tail & sqmask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+// chained counts the entries at the end of the queue that belong to a
+// chain whose last request has not been prepared yet...
+
+void AsyncIO::ring::push(bool linked)
+{
+    sqarray[tail & sqmask] = tail & sqmask;
+    ++tail;
+    Atomic::store(sqtail, tail);
+    if(linked)
+        ++chained;
+    else
+        chained = 0;
+}
+
+void AsyncIO::ring::submit(void)
+{
+    unsigned count;
+
+    chained = 0;
+    while((count = tail - Atomic::load(sqhead)) > 0) {
+        if(enter(count, 0, 0) < 0 && errno != EINTR)
+            break;
+    }
+}
+
+// a chain split between two submits is no longer linked, so only the
+// entries ahead of an unfinished chain are submitted to make room...
+
+void AsyncIO::ring::settle(void)
+{
+    unsigned count;
+
+    while((count = tail - Atomic::load(sqhead) - chained) > 0) {
+        if(enter(count, 0, 0) < 0 && errno != EINTR)
+            break;
+    }
+}
+
+// end an unfinished chain at the last entry already prepared...
+
+void AsyncIO::ring::close(void)
+{
+    if(!chained)
+        return;
+
+    sqes[(tail - 1) & sqmask].flags &= ~IOSQE_IO_LINK;
+    chained = 0;
+}
+
+// the reaper is the only consumer of the completion queue.  The engine
+// tags cancels with its own address, and a nop with no request asks the
+// reaper to stop once every request in flight has completed, as ring
+// completions may arrive in any order...
+
+class __LOCAL AsyncIO::reaper : public JoinableThread
+{
+private:
+    __DELETE_DEFAULTS(reaper);
+
+public:
+    AsyncIO *owner;
+
+    reaper(AsyncIO *aio) : JoinableThread(), owner(aio) {}
+
+    ~reaper() {
+        join();
+    }
+
+    void run(void) __OVERRIDE;
+};
+
+void AsyncIO::reaper::run(void)
+{
+    ring *rp = owner->uring;
+    bool stopping = false;
+
+    while(!stopping || Atomic::load(&owner->inflight)) {
+        unsigned head = *rp->cqhead;
+        if(head == Atomic::load(rp->cqtail)) {
+            rp->enter(0, 1, IORING_ENTER_GETEVENTS);
+            continue;
+        }
+
+        struct io_uring_cqe *cqe = &rp->cqes[head & rp->cqmask];
+        request *item = (request *)(uintptr_t)cqe->user_data;
+        ssize_t result = cqe->res;
+        Atomic::store(rp->cqhead, head + 1);
+
+        if(!item)
+            stopping = true;
+        else if((uintptr_t)item != (uintptr_t)owner) {
+            owner->retire(item);
+            owner->complete(item, result);
+            Atomic::fetch_add(&owner->inflight, -1);
+        }
+    }
+}
+
+#else
+
+class __LOCAL AsyncIO::ring
+{
+};
+
+class __LOCAL AsyncIO::reaper
+{
+};
+
+#endif
+
+// each job performs a chain of linked requests in order from the task
+// pool, or a single request when not linked...
+
+class __LOCAL AsyncIO::job : public TaskPool::task
+{
+private:
+    __DELETE_DEFAULTS(job);
+
+public:
+    AsyncIO *owner;
+    OrderedIndex chain;
+
+    job(AsyncIO *aio) : TaskPool::task(true), owner(aio) {}
+
+    void run(void) __OVERRIDE;
+};
+
+// emulated socket operations wait for readiness a period at a time, so
+// a stopping engine cancels them rather than blocking its pool forever...
+
+static bool ready(intptr_t fd, unsigned opcode, volatile atomic_t *stopping)
+{
+    socket_t so = (socket_t)fd;
+    bool output;
+
+    switch(opcode) {
+    case AIO_RECV:
+    case AIO_ACCEPT:
+        output = false;
+        break;
+    case AIO_SEND:
+        output = true;
+        break;
+    default:
+        return true;
+    }
+
+    while(!Atomic::load(stopping)) {
+#ifdef  USE_POLL
+        struct pollfd pfd;
+        pfd.fd = so;
+        pfd.events = output ? POLLOUT : POLLIN;
+        pfd.revents = 0;
+        if(::poll(&pfd, 1, 100) > 0)
+            return true;
+#else
+        struct timeval tv;
+        fd_set grp, err;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        FD_ZERO(&grp);
+        FD_ZERO(&err);
+        FD_SET(so, &grp);
+        FD_SET(so, &err);
+        if(::select((int)(so + 1), output ? NULL : &grp, output ? &grp : NULL, &err, &tv) > 0)
+            return true;
+#endif
+    }
+    return false;
+}
+
+static ssize_t perform(unsigned opcode, intptr_t fd, caddr_t data, size_t size, fsys::offset_t offset, struct sockaddr *addr, socklen_t *addrlen, int flags)
+{
+    ssize_t result = -1;
+
+#ifdef  _MSWINDOWS_
+    HANDLE handle = (HANDLE)fd;
+    socket_t so = (socket_t)fd;
+    OVERLAPPED pos;
+    DWORD count = 0;
+
+    memset(&pos, 0, sizeof(pos));
+    if(offset >= 0)
+        pos.Offset = (DWORD)offset;
+
+    switch(opcode) {
+    case AIO_READ:
+        if(ReadFile(handle, data, (DWORD)size, &count, offset < 0 ? NULL : &pos))
+            return (ssize_t)count;
+        return -(ssize_t)GetLastError();
+    case AIO_WRITE:
+        if(WriteFile(handle, data, (DWORD)size, &count, offset < 0 ? NULL : &pos))
+            return (ssize_t)count;
+        return -(ssize_t)GetLastError();
+    case AIO_SYNC:
+        if(FlushFileBuffers(handle))
+            return 0;
+        return -(ssize_t)GetLastError();
+    case AIO_RECV:
+        result = ::recv(so, data, (int)size, flags);
+        break;
+    case AIO_SEND:
+        result = ::send(so, data, (int)size, flags);
+        break;
+    case AIO_ACCEPT:
+        result = (ssize_t)::accept(so, addr, addrlen);
+        if(result == (ssize_t)INVALID_SOCKET)
+            result = -1;
+        break;
+    case AIO_CONNECT:
+        result = ::connect(so, addr, *addrlen);
+        break;
+    }
+
+    if(result < 0)
+        return -(ssize_t)Socket::error();
+#else
+    int io = (int)fd;
+
+    switch(opcode) {
+    case AIO_READ:
+        if(offset < 0)
+            result = ::read(io, data, size);
+        else
+            result = ::pread(io, data, size, (off_t)offset);
+        break;
+    case AIO_WRITE:
+        if(offset < 0)
+            result = ::write(io, data, size);
+        else
+            result = ::pwrite(io, data, size, (off_t)offset);
+        break;
+    case AIO_SYNC:
+        result = ::fsync(io);
+        break;
+    case AIO_RECV:
+        result = ::recv(io, data, size, flags);
+        break;
+    case AIO_SEND:
+        result = ::send(io, data, size, flags | MSG_NOSIGNAL);
+        break;
+    case AIO_ACCEPT:
+        result = ::accept(io, addr, addrlen);
+        break;
+    case AIO_CONNECT:
+        result = ::connect(io, addr, *addrlen);
+        break;
+    }
+
+    if(result < 0)
+        return -(ssize_t)errno;
+#endif
+    return result;
+}
+
+void AsyncIO::job::run(void)
+{
+    bool cancel = false;
+    request *item;
+
+    while(NULL != (item = static_cast<request *>(chain.get()))) {
+        ssize_t result = -ECANCELED;
+        if(!cancel && ready(item->fd, item->opcode, &owner->stopping))
+            result = perform(item->opcode, item->fd, item->data, item->size, item->offset, item->address, &item->addrlen, item->flags);
+
+        // like io_uring, a failed or short transfer breaks the chain...
+        bool partial = item->opcode != AIO_SYNC && item->opcode != AIO_ACCEPT && item->opcode != AIO_CONNECT && result < (ssize_t)item->size;
+        if((item->options & AIO_LINKED) && (result < 0 || partial))
+            cancel = true;
+
+        owner->complete(item, result);
+    }
+}
+
+AsyncIO::request::request(bool autodelete) :
+OrderedObject()
+{
+    state = AIO_IDLE;
+    owner = NULL;
+    status = 0;
+    opcode = options = 0;
+    fd = -1;
+    data = NULL;
+    size = 0;
+    offset = -1;
+    address = NULL;
+    addrlen = 0;
+    flags = 0;
+    detached = autodelete;
+    before = after = NULL;
+}
+
+AsyncIO::request::~request()
+{
+}
+
+void AsyncIO::request::completed(void)
+{
+}
+
+bool AsyncIO::request::is_done(void) const
+{
+    return Atomic::load(&state) == AIO_DONE;
+}
+
+bool AsyncIO::request::wait(timeout_t timeout)
+{
+    if(is_done())
+        return true;
+
+    if(!owner || detached || Atomic::load(&state) != AIO_PENDING)
+        return false;
+
+    owner->flush();
+
+    bool result = true;
+    struct timespec ts;
+
+    if(timeout != Timer::inf)
+        Conditional::set(&ts, timeout);
+
+    owner->lock();
+    Atomic::fetch_add(&owner->waiting, 1);
+    Atomic::fence();
+    while(!is_done()) {
+        if(timeout == Timer::inf)
+            owner->finished.wait();
+        else if(!owner->finished.wait(&ts)) {
+            result = is_done();
+            break;
+        }
+    }
+    Atomic::fetch_add(&owner->waiting, -1);
+    owner->unlock();
+    return result;
+}
+
+AsyncIO::AsyncIO(unsigned entries, unsigned threads, bool emulated) :
+Conditional(), finished(this)
+{
+    unsigned count = 1;
+    while(count < entries)
+        count <<= 1;
+
+    uring = NULL;
+    thread = NULL;
+    pool = NULL;
+    waiting = 0;
+    inflight = 0;
+    stopping = 0;
+    active = NULL;
+    buffer = NULL;
+    bufsize = 0;
+    bufcount = 0;
+    filelist = NULL;
+    filecount = 0;
+
+#ifdef  USE_URING
+    if(!emulated) {
+        uring = new ring(count);
+        if(uring->fd < 0) {
+            delete uring;
+            uring = NULL;
+        }
+    }
+
+    if(uring) {
+        thread = new reaper(this);
+        thread->start();
+        return;
+    }
+#endif
+
+    pool = new TaskPool(threads, count);
+}
+
+AsyncIO::~AsyncIO()
+{
+    flush();
+
+#ifdef  USE_URING
+    if(uring) {
+        struct io_uring_sqe *sqe;
+
+        // cancel whatever is still in flight, such as receives and
+        // accepts that may otherwise never complete...
+        lock();
+        uring->close();
+        for(request *item = active; item; item = item->after) {
+            sqe = uring->get();
+            while(!sqe) {
+                uring->submit();
+                sqe = uring->get();
+            }
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (uintptr_t)item;
+            sqe->user_data = (uintptr_t)this;
+            uring->push();
+        }
+
+        sqe = uring->get();
+        while(!sqe) {
+            uring->submit();
+            sqe = uring->get();
+        }
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = 0;
+        uring->push();
+        uring->submit();
+        unlock();
+
+        delete thread;
+        delete uring;
+        thread = NULL;
+        uring = NULL;
+    }
+#endif
+
+    // emulated socket operations still waiting are cancelled too...
+    Atomic::store(&stopping, (atomic_t)1);
+    if(pool)
+        delete pool;
+    pool = NULL;
+
+    if(filelist)
+        ::free(filelist);
+    filelist = NULL;
+}
+
+bool AsyncIO::submit(request *item, bool linked)
+{
+    assert(item != NULL);
+
+    item->owner = this;
+    item->status = 0;
+    item->options = linked ? AIO_LINKED : 0;
+    item->Next = NULL;
+    Atomic::store(&item->state, (atomic_t)AIO_PENDING);
+
+    lock();
+#ifdef  USE_URING
+    if(uring) {
+        struct io_uring_sqe *sqe = uring->get();
+        if(!sqe) {
+            // full, so submit what is already queued to make room...
+            uring->settle();
+            sqe = uring->get();
+        }
+        if(!sqe) {
+            // the ring only holds this chain, so it ends where it is...
+            uring->close();
+            unlock();
+            Atomic::store(&item->state, (atomic_t)AIO_IDLE);
+            return false;
+        }
+
+        sqe->fd = (int)item->fd;
+        sqe->user_data = (uintptr_t)item;
+        if(linked)
+            sqe->flags |= IOSQE_IO_LINK;
+
+        for(unsigned pos = 0; pos < filecount; ++pos) {
+            if(filelist[pos] == (fd_t)item->fd) {
+                sqe->fd = (int)pos;
+                sqe->flags |= IOSQE_FIXED_FILE;
+                break;
+            }
+        }
+
+        switch(item->opcode) {
+        case AIO_READ:
+        case AIO_WRITE:
+            sqe->opcode = (item->opcode == AIO_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->addr = (uintptr_t)item->data;
+            sqe->len = (unsigned)item->size;
+            sqe->off = (uint64_t)item->offset;
+            if(bufcount && item->data >= buffer && item->data + item->size <= buffer + bufsize * bufcount) {
+                size_t index = (size_t)(item->data - buffer) / bufsize;
+                if(item->data + item->size <= buffer + bufsize * (index + 1)) {
+                    sqe->opcode = (item->opcode == AIO_READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+                    sqe->buf_index = (uint16_t)index;
+                }
+            }
+            break;
+        case AIO_SYNC:
+            sqe->opcode = IORING_OP_FSYNC;
+            break;
+        case AIO_RECV:
+            sqe->opcode = IORING_OP_RECV;
+            sqe->addr = (uintptr_t)item->data;
+            sqe->len = (unsigned)item->size;
+            sqe->msg_flags = (unsigned)item->flags;
+            break;
+        case AIO_SEND:
+            sqe->opcode = IORING_OP_SEND;
+            sqe->addr = (uintptr_t)item->data;
+            sqe->len = (unsigned)item->size;
+            sqe->msg_flags = (unsigned)(item->flags | MSG_NOSIGNAL);
+            break;
+        case AIO_ACCEPT:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->addr = (uintptr_t)item->address;
+            sqe->addr2 = item->address ? (uintptr_t)&item->addrlen : 0;
+            break;
+        case AIO_CONNECT:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr = (uintptr_t)item->address;
+            sqe->off = item->addrlen;
+            break;
+        }
+        uring->push(linked);
+        Atomic::fetch_add(&inflight, 1);
+        item->before = NULL;
+        item->after = active;
+        if(active)
+            active->before = item;
+        active = item;
+        unlock();
+        return true;
+    }
+#endif
+
+    item->enlistTail(&queued);
+    unlock();
+    return true;
+}
+
+void AsyncIO::retire(request *item)
+{
+    lock();
+    if(item->before)
+        item->before->after = item->after;
+    else
+        active = item->after;
+    if(item->after)
+        item->after->before = item->before;
+    item->before = item->after = NULL;
+    unlock();
+}
+
+void AsyncIO::complete(request *item, ssize_t result)
+{
+    item->status = result;
+    item->completed();
+
+    if(item->detached) {
+        delete item;
+        return;
+    }
+
+    Atomic::store(&item->state, (atomic_t)AIO_DONE);
+    Atomic::fence();
+    if(Atomic::load(&waiting)) {
+        lock();
+        finished.broadcast();
+        unlock();
+    }
+}
+
+void AsyncIO::flush(void)
+{
+    lock();
+#ifdef  USE_URING
+    if(uring) {
+        uring->submit();
+        unlock();
+        return;
+    }
+#endif
+
+    job *jp = NULL;
+    request *item;
+    while(NULL != (item = static_cast<request *>(queued.get()))) {
+        if(!jp)
+            jp = new job(this);
+        item->Next = NULL;
+        item->enlistTail(&jp->chain);
+        if(!(item->options & AIO_LINKED)) {
+            pool->submit(jp);
+            jp = NULL;
+        }
+    }
+    if(jp)
+        pool->submit(jp);
+    unlock();
+}
+
+bool AsyncIO::read(request *item, fd_t fd, void *data, size_t size, fsys::offset_t offset, bool linked)
+{
+    assert(item != NULL && data != NULL);
+
+    item->opcode = AIO_READ;
+    item->fd = (intptr_t)fd;
+    item->data = (caddr_t)data;
+    item->size = size;
+    item->offset = offset;
+    return submit(item, linked);
+}
+
+bool AsyncIO::write(request *item, fd_t fd, const void *data, size_t size, fsys::offset_t offset, bool linked)
+{
+    assert(item != NULL && data != NULL);
+
+    item->opcode = AIO_WRITE;
+    item->fd = (intptr_t)fd;
+    item->data = (caddr_t)data;
+    item->size = size;
+    item->offset = offset;
+    return submit(item, linked);
+}
+
+bool AsyncIO::sync(request *item, fd_t fd, bool linked)
+{
+    assert(item != NULL);
+
+    item->opcode = AIO_SYNC;
+    item->fd = (intptr_t)fd;
+    item->size = 0;
+    return submit(item, linked);
+}
+
+bool AsyncIO::recv(request *item, socket_t so, void *data, size_t size, int flags, bool linked)
+{
+    assert(item != NULL && data != NULL);
+
+    item->opcode = AIO_RECV;
+    item->fd = (intptr_t)so;
+    item->data = (caddr_t)data;
+    item->size = size;
+    item->flags = flags;
+    return submit(item, linked);
+}
+
+bool AsyncIO::send(request *item, socket_t so, const void *data, size_t size, int flags, bool linked)
+{
+    assert(item != NULL && data != NULL);
+
+    item->opcode = AIO_SEND;
+    item->fd = (intptr_t)so;
+    item->data = (caddr_t)data;
+    item->size = size;
+    item->flags = flags;
+    return submit(item, linked);
+}
+
+bool AsyncIO::accept(request *item, socket_t so, struct sockaddr_storage *addr, bool linked)
+{
+    assert(item != NULL);
+
+    item->opcode = AIO_ACCEPT;
+    item->fd = (intptr_t)so;
+    item->address = (struct sockaddr *)addr;
+    item->addrlen = addr ? sizeof(struct sockaddr_storage) : 0;
+    item->size = 0;
+    return submit(item, linked);
+}
+
+bool AsyncIO::connect(request *item, socket_t so, const struct sockaddr *addr, bool linked)
+{
+    assert(item != NULL && addr != NULL);
+
+    item->opcode = AIO_CONNECT;
+    item->fd = (intptr_t)so;
+    item->address = (struct sockaddr *)addr;
+    item->addrlen = Socket::len(addr);
+    item->size = 0;
+    return submit(item, linked);
+}
+
+bool AsyncIO::buffers(void *base, size_t size, unsigned count)
+{
+    if(!base || !size)
+        count = 0;
+
+    lock();
+#ifdef  USE_URING
+    if(uring && bufcount)
+        uring->control(IORING_UNREGISTER_BUFFERS, NULL, 0);
+
+    if(uring && count) {
+        struct iovec *list = (struct iovec *)::malloc(sizeof(struct iovec) * count);
+        if(!list) {
+            bufcount = 0;
+            unlock();
+            return false;
+        }
+        for(unsigned pos = 0; pos < count; ++pos) {
+            list[pos].iov_base = (caddr_t)base + pos * size;
+            list[pos].iov_len = size;
+        }
+        int result = uring->control(IORING_REGISTER_BUFFERS, list, count);
+        ::free(list);
+        if(result < 0) {
+            bufcount = 0;
+            unlock();
+            return false;
+        }
+    }
+#endif
+
+    buffer = (caddr_t)base;
+    bufsize = size;
+    bufcount = count;
+    unlock();
+    return true;
+}
+
+bool AsyncIO::files(const fd_t *list, unsigned count)
+{
+    if(!list)
+        count = 0;
+
+    lock();
+#ifdef  USE_URING
+    if(uring && filecount)
+        uring->control(IORING_UNREGISTER_FILES, NULL, 0);
+
+    if(uring && count && uring->control(IORING_REGISTER_FILES, (void *)list, count) < 0) {
+        filecount = 0;
+        unlock();
+        return false;
+    }
+#endif
+
+    if(filelist)
+        ::free(filelist);
+    filelist = NULL;
+    filecount = 0;
+
+    if(count) {
+        filelist = (fd_t *)::malloc(sizeof(fd_t) * count);
+        if(!filelist) {
+            unlock();
+            __THROW_ALLOC();
+        }
+        memcpy(filelist, list, sizeof(fd_t) * count);
+        filecount = count;
+    }
+    unlock();
+    return true;
+}
+
+} // namespace ucommon
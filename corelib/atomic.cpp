@@ -106,9 +106,11 @@ bool Atomic::spinlock::acquire() volatile
 
 void Atomic::spinlock::wait() volatile
 {
+    backoff delay;
+
     while(InterlockedBitTestAndSet(&value, 1)) {
         while(value)
-            ;
+            delay();
     }
 }
 
@@ -164,9 +166,11 @@ bool Atomic::spinlock::acquire(void) volatile
 
 void Atomic::spinlock::wait(void) volatile
 {
+    backoff delay;
+
     while (std::atomic_exchange_explicit((atomic_val)(&value), (atomic_t)1, std::memory_order_acquire)) {
         while (value)
-            ;
+            delay();
     }
 }
 
@@ -221,9 +225,11 @@ bool Atomic::spinlock::acquire(void) volatile
 
 void Atomic::spinlock::wait(void) volatile
 {
+    backoff delay;
+
     while (__c11_atomic_exchange((atomic_val)(&value), 1, __ATOMIC_ACQUIRE)) {
         while (value)
-            ;
+            delay();
     }
 }
 
@@ -277,9 +283,11 @@ bool Atomic::spinlock::acquire(void) volatile
 
 void Atomic::spinlock::wait(void) volatile
 {
+    backoff delay;
+
     while (__atomic_test_and_set(&value, __ATOMIC_ACQUIRE)) {
         while (value)
-            ;
+            delay();
     }
 }
 
@@ -333,9 +341,11 @@ bool Atomic::spinlock::acquire(void) volatile
 
 void Atomic::spinlock::wait(void) volatile
 {
+    backoff delay;
+
     while (__sync_lock_test_and_set(&value, 1)) {
         while (value)
-            ;
+            delay();
     }
 }
 
@@ -445,6 +455,32 @@ atomic_t Atomic::counter::operator-=(atomic_t change) volatile
     return fetch_sub(change) - change;
 }
 
+#if !defined(__GNUC_PREREQ__) || !(__GNUC_PREREQ__(4, 7) || defined(__clang__)) || defined(sparc)
+
+void Atomic::_lock(const volatile void *pointer)
+{
+    Mutex::protect((const void *)pointer);
+}
+
+void Atomic::_unlock(const volatile void *pointer)
+{
+    Mutex::release((const void *)pointer);
+}
+
+void Atomic::fence(void)
+{
+#if defined(_MSWINDOWS_)
+    MemoryBarrier();
+#else
+    static Mutex barrier;
+
+    barrier.lock();
+    barrier.unlock();
+#endif
+}
+
+#endif
+
 Atomic::Aligned::Aligned(size_t object, size_t align)
 {
     if(!align)
@@ -472,4 +508,97 @@ Atomic::Aligned::~Aligned()
     }
 }
 
+void Atomic::backoff::operator()(void)
+{
+    // beyond this many pauses, let another thread run instead...
+    if(spins > 64) {
+        Thread::yield();
+        return;
+    }
+
+    for(unsigned count = 0; count < spins; ++count)
+        pause();
+    spins <<= 1;
+}
+
+size_t Atomic::padding(size_t size)
+{
+    size_t line = Thread::cache();
+    if(!line)
+        return size;
+
+    return ((size + line - 1) / line) * line;
+}
+
+// each thread takes a serial number the first time it counts, and uses
+// it to pick a shard...
+
+static volatile atomic_t shard_serial = 0;
+
+class __LOCAL shard_local : public Thread::Local
+{
+private:
+    void *allocate(void) __FINAL {
+        unsigned *slot = (unsigned *)::malloc(sizeof(unsigned));
+        if(!slot)
+            __THROW_ALLOC();
+        *slot = (unsigned)Atomic::fetch_add(&shard_serial, (atomic_t)1);
+        return slot;
+    }
+
+    void release(void *mem) __FINAL {
+        ::free(mem);
+    }
+};
+
+Atomic::sharded::sharded(unsigned shards)
+{
+    if(!shards)
+        shards = Thread::cpus();
+
+    unsigned count = 1;
+    while(count < shards)
+        count <<= 1;
+
+    size_t line = padding(sizeof(int64_t));
+    mask = count - 1;
+    stride = (unsigned)(line / sizeof(int64_t));
+    memory = ::calloc(1, line * (count + 1));
+    if(!memory)
+        __THROW_ALLOC();
+
+    caddr_t base = (caddr_t)memory;
+    base += line - ((uintptr_t)base % line);
+    cells = (volatile int64_t *)base;
+}
+
+Atomic::sharded::~sharded()
+{
+    if(memory)
+        ::free(memory);
+    memory = NULL;
+}
+
+void Atomic::sharded::add(int64_t offset)
+{
+    static shard_local locals;
+    unsigned slot = *((unsigned *)*locals) & mask;
+
+    Atomic::fetch_add(&cells[slot * stride], offset);
+}
+
+int64_t Atomic::sharded::get(void) const
+{
+    int64_t total = 0;
+    for(unsigned slot = 0; slot <= mask; ++slot)
+        total += Atomic::load(&cells[slot * stride]);
+    return total;
+}
+
+void Atomic::sharded::clear(void)
+{
+    for(unsigned slot = 0; slot <= mask; ++slot)
+        Atomic::store(&cells[slot * stride], (int64_t)0);
+}
+
 } // namespace ucommon
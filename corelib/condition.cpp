@@ -28,6 +28,12 @@
 #include <stdarg.h>
 #include <limits.h>
 
+#ifdef  HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace ucommon {
 
 #if !defined(_MSTHREADS_)
@@ -61,6 +67,42 @@ void Conditional::set(struct timespec *ts, timeout_t msec)
     }
 }
 
+#ifdef  HAVE_LINUX_FUTEX_H
+
+bool Conditional::park(volatile atomic_t *word, atomic_t value, struct timespec *deadline)
+{
+    struct timespec now, remains, *timeout = NULL;
+
+    // futex waits are relative, so convert from our clock deadline...
+    if(deadline) {
+        set(&now, 0);
+        remains.tv_sec = deadline->tv_sec - now.tv_sec;
+        remains.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if(remains.tv_nsec < 0) {
+            --remains.tv_sec;
+            remains.tv_nsec += 1000000000l;
+        }
+        if(remains.tv_sec < 0)
+            return false;
+        timeout = &remains;
+    }
+
+    if(syscall(SYS_futex, (atomic_t *)word, FUTEX_WAIT_PRIVATE, value, timeout, NULL, 0) == -1 && errno == ETIMEDOUT)
+        return false;
+
+    return true;
+}
+
+void Conditional::unpark(volatile atomic_t *word, unsigned count)
+{
+    if(count > INT_MAX)
+        count = INT_MAX;
+
+    syscall(SYS_futex, (atomic_t *)word, FUTEX_WAKE_PRIVATE, (int)count, NULL, NULL, 0);
+}
+
+#endif
+
 #ifdef  _MSTHREADS_
 
 ConditionMutex::ConditionMutex()
@@ -443,13 +485,15 @@ void ConditionalLock::modify(void)
 
     assert(context && sharing >= context->count);
 
+    // claim the context before waiting, so another thread cannot reuse
+    // an idle context slot while we wait...
     sharing -= context->count;
+    ++context->count;
     while(sharing) {
         ++pending;
         waitSignal();
         --pending;
     }
-    ++context->count;
 }
 
 void ConditionalLock::commit(void)
@@ -526,13 +570,379 @@ void ConditionalLock::share(void)
 }
 
 
+// each thread tracks how deeply it holds each biased lock, so readers
+// can recurse past a pending writer without a shared context list...
+
+#define BIASED_ENTRIES  8
+
+typedef struct {
+    const BiasedLock *lock;
+    unsigned depth, aside;
+    bool writer;
+} biased_entry;
+
+typedef struct {
+    unsigned slot, limit;
+    biased_entry *list;
+    biased_entry entries[BIASED_ENTRIES];
+} biased_table;
+
+static volatile atomic_t biased_serial = 0;
+
+class __LOCAL biased_local : public Thread::Local
+{
+private:
+    void *allocate(void) __FINAL {
+        biased_table *table = (biased_table *)::calloc(1, sizeof(biased_table));
+        if(!table)
+            __THROW_ALLOC();
+        table->slot = (unsigned)Atomic::fetch_add(&biased_serial, 1);
+        table->limit = BIASED_ENTRIES;
+        table->list = table->entries;
+        return table;
+    }
+
+    void release(void *mem) __FINAL {
+        biased_table *table = (biased_table *)mem;
+
+        if(!table)
+            return;
+
+        if(table->list != table->entries)
+            ::free(table->list);
+        ::free(table);
+    }
+};
+
+static biased_entry *biased_held(const BiasedLock *lock, unsigned *slot = NULL)
+{
+    static biased_local locals;
+    biased_table *table = (biased_table *)*locals;
+    biased_entry *empty = NULL;
+
+    if(slot)
+        *slot = table->slot;
+
+    for(unsigned pos = 0; pos < table->limit; ++pos) {
+        biased_entry *entry = &table->list[pos];
+        if(entry->depth && entry->lock == lock)
+            return entry;
+        if(!entry->depth && !empty)
+            empty = entry;
+    }
+
+    if(!empty) {
+        biased_entry *list = (biased_entry *)::calloc(table->limit * 2, sizeof(biased_entry));
+        if(!list)
+            __THROW_ALLOC();
+        memcpy(list, table->list, sizeof(biased_entry) * table->limit);
+        if(table->list != table->entries)
+            ::free(table->list);
+        empty = &list[table->limit];
+        table->list = list;
+        table->limit *= 2;
+    }
+
+    empty->lock = lock;
+    empty->writer = false;
+    return empty;
+}
+
+BiasedLock::BiasedLock(unsigned slots) :
+ConditionalAccess()
+{
+    if(!slots)
+        slots = Thread::cpus();
+
+    unsigned count = 1;
+    while(count < slots)
+        count <<= 1;
+
+    // each reader counter gets a cache line of its own...
+    size_t line = Thread::cache();
+    if(line < sizeof(atomic_t))
+        line = sizeof(atomic_t);
+
+    intent = 0;
+    mask = count - 1;
+    stride = (unsigned)(line / sizeof(atomic_t));
+    counters = ::calloc(1, line * (count + 1));
+    if(!counters)
+        __THROW_ALLOC();
+
+    caddr_t base = (caddr_t)counters;
+    base += line - ((uintptr_t)base % line);
+    readers = (volatile atomic_t *)base;
+}
+
+BiasedLock::~BiasedLock()
+{
+    if(counters)
+        ::free(counters);
+    counters = NULL;
+    readers = NULL;
+}
+
+void BiasedLock::_share(void)
+{
+    access();
+}
+
+void BiasedLock::_unshare(void)
+{
+    release();
+}
+
+void BiasedLock::drain(void)
+{
+    for(;;) {
+        atomic_t total = 0;
+        for(unsigned pos = 0; pos <= mask; ++pos)
+            total += Atomic::load(&readers[pos * stride]);
+        if(!total)
+            break;
+        ++pending;
+        waitSignal();
+        --pending;
+    }
+}
+
+void BiasedLock::resume(void)
+{
+    if(pending)
+        signal();
+    else if(waiting && !Atomic::load(&intent))
+        broadcast();
+}
+
+void BiasedLock::access(void)
+{
+    unsigned slot;
+    biased_entry *entry = biased_held(this, &slot);
+    volatile atomic_t *counter = &readers[(slot & mask) * stride];
+
+    Atomic::fetch_add(counter, (atomic_t)1);
+    Atomic::fence();
+    if(entry->depth || !Atomic::load(&intent)) {
+        ++entry->depth;
+        return;
+    }
+
+    // back off for a pending writer, which may be waiting on our count...
+    Atomic::fetch_add(counter, (atomic_t)-1);
+    lock();
+    if(pending)
+        signal();
+    while(Atomic::load(&intent)) {
+        ++waiting;
+        waitBroadcast();
+        --waiting;
+    }
+    Atomic::fetch_add(counter, (atomic_t)1);
+    unlock();
+    ++entry->depth;
+}
+
+void BiasedLock::release(void)
+{
+    unsigned slot;
+    biased_entry *entry = biased_held(this, &slot);
+
+    assert(entry->depth > 0);
+
+    --entry->depth;
+    Atomic::fetch_add(&readers[(slot & mask) * stride], (atomic_t)-1);
+    Atomic::fence();
+
+    // a writer thread releasing nested shares already holds the lock...
+    if(entry->writer || !Atomic::load(&intent))
+        return;
+
+    lock();
+    if(pending)
+        signal();
+    unlock();
+}
+
+// shares already held by the writer are set aside while it waits, so all
+// writers wait for the same condition, as sharing does for condlock...
+
+void BiasedLock::modify(void)
+{
+    unsigned slot;
+    biased_entry *entry = biased_held(this, &slot);
+
+    lock();
+    entry->aside = entry->depth;
+    Atomic::fetch_add(&intent, (atomic_t)1);
+    Atomic::fetch_add(&readers[(slot & mask) * stride], -(atomic_t)entry->aside);
+    Atomic::fence();
+    drain();
+    ++entry->depth;
+    entry->writer = true;
+}
+
+void BiasedLock::commit(void)
+{
+    unsigned slot;
+    biased_entry *entry = biased_held(this, &slot);
+
+    assert(entry->writer && entry->depth > 0);
+
+    --entry->depth;
+    entry->writer = false;
+    Atomic::fetch_add(&readers[(slot & mask) * stride], (atomic_t)entry->aside);
+    Atomic::fetch_add(&intent, (atomic_t)-1);
+    resume();
+    unlock();
+}
+
+void BiasedLock::exclusive(void)
+{
+    unsigned slot;
+    biased_entry *entry = biased_held(this, &slot);
+
+    assert(entry->depth > 0);
+
+    lock();
+    entry->aside = entry->depth;
+    Atomic::fetch_add(&intent, (atomic_t)1);
+    Atomic::fetch_add(&readers[(slot & mask) * stride], -(atomic_t)entry->aside);
+    Atomic::fence();
+    drain();
+    entry->writer = true;
+}
+
+void BiasedLock::share(void)
+{
+    unsigned slot;
+    biased_entry *entry = biased_held(this, &slot);
+
+    assert(entry->writer && entry->depth > 0);
+
+    entry->writer = false;
+    Atomic::fetch_add(&readers[(slot & mask) * stride], (atomic_t)entry->aside);
+    Atomic::fetch_add(&intent, (atomic_t)-1);
+    resume();
+    unlock();
+}
+
 Barrier::Barrier(unsigned limit) :
 Conditional()
 {
     count = limit;
     waits = 0;
+    state = 0;
+}
+
+#ifdef  HAVE_LINUX_FUTEX_H
+
+// the barrier state holds the generation in the upper bits and the threads
+// arrived in the lower 16 bits, so arriving and tripping are single atomic
+// operations, and waiters park on the one word that changes per generation...
+
+static inline atomic_t generation(atomic_t current)
+{
+    return (atomic_t)((((unsigned)current >> 16) + 1) << 16);
 }
 
+Barrier::~Barrier()
+{
+    atomic_t current = Atomic::load(&state);
+    if((unsigned)current & 0xffff) {
+        Atomic::store(&state, generation(current));
+        unpark(&state, INT_MAX);
+    }
+}
+
+bool Barrier::trip(void)
+{
+    atomic_t current = Atomic::load(&state);
+
+    for(;;) {
+        unsigned arrived = (unsigned)current & 0xffff;
+        if(!arrived || arrived < Atomic::load(&count))
+            return false;
+        if(Atomic::compare_exchange(&state, current, generation(current))) {
+            unpark(&state, INT_MAX);
+            return true;
+        }
+    }
+}
+
+bool Barrier::arrive(struct timespec *deadline)
+{
+    if(!Atomic::load(&count))
+        return true;
+
+    atomic_t current = Atomic::fetch_add(&state, (atomic_t)1) + 1;
+    unsigned passed = (unsigned)current >> 16;
+
+    // a count lowered while we arrived is seen either here or by set...
+    Atomic::fence();
+    if(trip())
+        return true;
+
+    for(;;) {
+        if(((unsigned)current >> 16) != passed)
+            return true;
+        if(!park(&state, current, deadline))
+            return ((unsigned)Atomic::load(&state) >> 16) != passed;
+        current = Atomic::load(&state);
+    }
+}
+
+void Barrier::set(unsigned limit)
+{
+    assert(limit > 0);
+
+    Atomic::store(&count, limit);
+    Atomic::fence();
+    trip();
+}
+
+void Barrier::dec(void)
+{
+    operator--();
+}
+
+unsigned Barrier::operator--(void)
+{
+    unsigned current = Atomic::load(&count);
+
+    while(current && !Atomic::compare_exchange(&count, current, current - 1))
+        ;
+    return current ? current - 1 : 0;
+}
+
+void Barrier::inc(void)
+{
+    operator++();
+}
+
+unsigned Barrier::operator++(void)
+{
+    unsigned result = Atomic::fetch_add(&count, 1u) + 1;
+    Atomic::fence();
+    trip();
+    return result;
+}
+
+bool Barrier::wait(timeout_t timeout)
+{
+    struct timespec ts;
+    Conditional::set(&ts, timeout);
+
+    return arrive(&ts);
+}
+
+void Barrier::wait(void)
+{
+    arrive(NULL);
+}
+
+#else
+
 Barrier::~Barrier()
 {
     lock();
@@ -635,12 +1045,15 @@ void Barrier::wait(void)
     Conditional::unlock();
 }
 
+#endif
+
 Semaphore::Semaphore(unsigned limit) :
 Conditional()
 {
 	waits = 0;
 	count = limit;
 	used = 0;
+	sequence = 0;
 }
 
 Semaphore::Semaphore(unsigned limit, unsigned avail) :
@@ -652,6 +1065,7 @@ Conditional()
 	waits = 0;
 	count = limit;
 	used = limit - avail;
+	sequence = 0;
 }
 
 void Semaphore::_share(void)
@@ -664,6 +1078,84 @@ void Semaphore::_unshare(void)
     release();
 }
 
+#ifdef  HAVE_LINUX_FUTEX_H
+
+// waiters announce themselves before rechecking for a free slot, so a
+// release either sees a waiter to wake or the waiter sees the freed slot,
+// and uncontended waits and releases are a single compare and swap...
+
+bool Semaphore::claim(struct timespec *deadline)
+{
+    bool expired = false;
+
+    for(;;) {
+        unsigned limit = Atomic::load(&count);
+        unsigned current = Atomic::load(&used);
+        while(limit && current < limit) {
+            if(Atomic::compare_exchange(&used, current, current + 1))
+                return true;
+        }
+
+        if(expired)
+            return false;
+
+        Atomic::fetch_add(&waits, 1u);
+        Atomic::fence();
+        atomic_t ticket = Atomic::load(&sequence);
+        if(limit && Atomic::load(&used) < Atomic::load(&count)) {
+            Atomic::fetch_add(&waits, (unsigned)-1);
+            continue;
+        }
+        expired = !park(&sequence, ticket, deadline);
+        Atomic::fetch_add(&waits, (unsigned)-1);
+
+        // group release when no count, so any release passes us...
+        if(!limit && Atomic::load(&sequence) != ticket)
+            return true;
+    }
+}
+
+bool Semaphore::wait(timeout_t timeout)
+{
+    struct timespec ts;
+    Conditional::set(&ts, timeout);
+
+    return claim(&ts);
+}
+
+void Semaphore::wait(void)
+{
+    claim(NULL);
+}
+
+void Semaphore::release(void)
+{
+    unsigned current = Atomic::load(&used);
+
+    while(current && !Atomic::compare_exchange(&used, current, current - 1))
+        ;
+
+    Atomic::fence();
+    if(Atomic::load(&waits)) {
+        Atomic::fetch_add(&sequence, (atomic_t)1);
+        unpark(&sequence, Atomic::load(&count) ? 1 : INT_MAX);
+    }
+}
+
+void Semaphore::set(unsigned value)
+{
+    assert(value > 0);
+
+    Atomic::store(&count, value);
+    Atomic::fence();
+    if(Atomic::load(&waits)) {
+        Atomic::fetch_add(&sequence, (atomic_t)1);
+        unpark(&sequence, INT_MAX);
+    }
+}
+
+#else
+
 bool Semaphore::wait(timeout_t timeout)
 {
     bool result = true;
@@ -734,4 +1226,6 @@ void Semaphore::set(unsigned value)
     }
 }
 
+#endif
+
 } // namespace ucommon
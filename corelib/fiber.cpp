@@ -0,0 +1,643 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ucommon-config.h>
+#include <ucommon/export.h>
+#include <ucommon/fiber.h>
+#include <ucommon/thread.h>
+#ifdef  HAVE_UCONTEXT_H
+#include <ucontext.h>
+#endif
+#ifdef  HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef  HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <stdlib.h>
+
+#if defined(HAVE_UCONTEXT_H) && !defined(_MSWINDOWS_)
+#define USE_FIBERS
+#endif
+
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS   MAP_ANON
+#endif
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+#define USE_GUARD
+#endif
+
+namespace ucommon {
+
+static size_t pagesize(void)
+{
+#if defined(HAVE_UNISTD_H) && defined(_SC_PAGESIZE)
+    long size = sysconf(_SC_PAGESIZE);
+    if(size > 0)
+        return (size_t)size;
+#endif
+    return 4096;
+}
+
+// the scheduler a thread is running is kept in thread local storage, so
+// socket operations can find it without being passed a reference...
+
+class __LOCAL scheduler_local : public Thread::Local
+{
+private:
+    void release(void *mem) __FINAL {
+    }
+};
+
+static Thread::Local& schedulers(void)
+{
+    static scheduler_local locals;
+    return locals;
+}
+
+// fiber timers are only changed from the scheduler thread, which also
+// evaluates the next deadline before each poll, so no wakeup is needed...
+
+class __LOCAL Scheduler::clock : public TimerQueue
+{
+public:
+    clock() : TimerQueue(1) {}
+
+private:
+    void modify(void) __FINAL {
+    }
+
+    void update(void) __FINAL {
+    }
+};
+
+// a frame is the stack and wait state of a started fiber.  Frames are
+// pooled by the scheduler, so the reactor handler and timer event used
+// for waiting are created once per stack rather than once per wait.  The
+// reactor takes one registration per descriptor, so when fibers wait on
+// the same socket, the first to wait holds the registration for all of
+// them, and hands it on to the next when it resumes...
+
+class __LOCAL Scheduler::frame
+{
+public:
+    class __LOCAL waiter : public Reactor::handler
+    {
+    public:
+        frame *fp;
+
+        waiter(frame *f) : Reactor::handler(INVALID_SOCKET), fp(f) {}
+
+        inline void set(socket_t socket) {
+            so = socket;
+        }
+
+    private:
+        void readable(void) __FINAL {
+            fp->notify(READABLE);
+        }
+
+        void writable(void) __FINAL {
+            fp->notify(WRITABLE);
+        }
+
+        void hangup(void) __FINAL {
+            // let the fibers retry so the i/o call itself reports the error...
+            fp->notify(READABLE | WRITABLE);
+        }
+    };
+
+    class __LOCAL alarm : public TimerQueue::event
+    {
+    public:
+        frame *fp;
+
+        alarm(frame *f) : TimerQueue::event((timeout_t)0), fp(f) {
+            disarm();
+        }
+
+    private:
+        void expired(void) __FINAL {
+            fp->wake(0);
+        }
+    };
+
+#ifdef  USE_FIBERS
+    ucontext_t context;
+#endif
+    Scheduler *owner;
+    fiber *task;
+    frame *next;
+    frame *host, *guests, *peer;
+    frame *before, *after;
+    waiter io;
+    alarm timer;
+    void *memory;
+    caddr_t stack;
+    size_t size;
+    unsigned events, result;
+
+    frame(Scheduler *scheduler, size_t request);
+    ~frame();
+
+    bool hold(socket_t so);
+    void drop(void);
+    void notify(unsigned revents);
+    unsigned interest(void) const;
+    void enlist(void);
+    void delist(void);
+
+    inline void wake(unsigned revents) {
+        result |= revents;
+        if(task)
+            owner->ready(task);
+    }
+
+    inline void rearm(void) {
+        owner->modify(&io, interest() | ONESHOT);
+    }
+};
+
+Scheduler::frame::frame(Scheduler *scheduler, size_t request) :
+io(this), timer(this)
+{
+    owner = scheduler;
+    task = NULL;
+    next = NULL;
+    host = guests = peer = NULL;
+    before = after = NULL;
+    events = result = 0;
+    size = request;
+
+#ifdef  USE_GUARD
+    // stacks grow down on every supported target, so the guard page is
+    // placed below the stack to trap overflow...
+    size_t page = pagesize();
+    memory = ::mmap(NULL, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        memory = NULL;
+        stack = NULL;
+    }
+    else {
+        ::mprotect(memory, page, PROT_NONE);
+        stack = (caddr_t)memory + page;
+    }
+#else
+    memory = ::malloc(size);
+    stack = (caddr_t)memory;
+#endif
+
+    timer.attach(owner->clocks);
+}
+
+Scheduler::frame::~frame()
+{
+    timer.detach();
+    io.set(INVALID_SOCKET);
+
+    if(!memory)
+        return;
+
+#ifdef  USE_GUARD
+    ::munmap(memory, size + pagesize());
+#else
+    ::free(memory);
+#endif
+}
+
+void Scheduler::frame::enlist(void)
+{
+    before = NULL;
+    after = owner->waiting;
+    if(after)
+        after->before = this;
+    owner->waiting = this;
+}
+
+void Scheduler::frame::delist(void)
+{
+    if(before)
+        before->after = after;
+    else
+        owner->waiting = after;
+    if(after)
+        after->before = before;
+    before = after = NULL;
+}
+
+unsigned Scheduler::frame::interest(void) const
+{
+    unsigned flags = events;
+    for(frame *fp = guests; fp; fp = fp->peer)
+        flags |= fp->events;
+    return flags;
+}
+
+bool Scheduler::frame::hold(socket_t so)
+{
+    host = guests = peer = NULL;
+    io.set(so);
+    if(owner->attach(&io, events | ONESHOT)) {
+        enlist();
+        return true;
+    }
+
+    io.set(INVALID_SOCKET);
+    if(errno != EEXIST)
+        return false;
+
+    // another fiber may already hold the socket, so share its registration...
+    frame *fp = owner->waiting;
+    while(fp && fp->io.handle() != so)
+        fp = fp->after;
+
+    if(!fp)
+        return false;
+
+    host = fp;
+    peer = fp->guests;
+    fp->guests = this;
+    fp->rearm();
+    return true;
+}
+
+void Scheduler::frame::drop(void)
+{
+    if(host) {
+        frame **link = &host->guests;
+        while(*link != this)
+            link = &(*link)->peer;
+        *link = peer;
+        host->rearm();
+        host = peer = NULL;
+        return;
+    }
+
+    socket_t so = io.handle();
+    owner->detach(&io);
+    delist();
+    io.set(INVALID_SOCKET);
+
+    frame *fp = guests;
+    guests = NULL;
+    if(!fp)
+        return;
+
+    // the next waiting fiber takes over the registration for the rest...
+    fp->host = NULL;
+    fp->guests = fp->peer;
+    fp->peer = NULL;
+    for(frame *guest = fp->guests; guest; guest = guest->peer)
+        guest->host = fp;
+    fp->io.set(so);
+    if(owner->attach(&fp->io, fp->interest() | ONESHOT)) {
+        fp->enlist();
+        return;
+    }
+
+    // should the socket be gone, they all retry and see the error...
+    fp->io.set(INVALID_SOCKET);
+    fp->notify(READABLE | WRITABLE);
+}
+
+void Scheduler::frame::notify(unsigned revents)
+{
+    bool woken = false;
+
+    if(events & revents) {
+        wake(events & revents);
+        woken = true;
+    }
+
+    for(frame *fp = guests; fp; fp = fp->peer) {
+        if(fp->events & revents) {
+            fp->wake(fp->events & revents);
+            woken = true;
+        }
+    }
+
+    // a oneshot event nobody waits for any more must not disarm the rest...
+    if(!woken && io.reactor())
+        rearm();
+}
+
+Scheduler::fiber::fiber(bool flag, size_t size)
+{
+    owner = NULL;
+    next = NULL;
+    context = NULL;
+    stack = size;
+    detached = flag;
+    done = queued = false;
+}
+
+Scheduler::fiber::~fiber()
+{
+}
+
+Scheduler::Scheduler(size_t size, unsigned count, unsigned maximum) :
+Reactor(NULL, maximum)
+{
+    size_t page = pagesize();
+
+    if(!size)
+        size = 65536;
+
+    executing = first = last = NULL;
+    idle = waiting = NULL;
+    active = cached = 0;
+    stacks = count;
+    stacksize = ((size + page - 1) / page) * page;
+    clocks = new clock();
+
+#ifdef  USE_FIBERS
+    context = ::malloc(sizeof(ucontext_t));
+    if(!context)
+        __THROW_ALLOC();
+#else
+    context = NULL;
+#endif
+}
+
+Scheduler::~Scheduler()
+{
+    while(idle) {
+        frame *fp = idle;
+        idle = fp->next;
+        delete fp;
+    }
+
+    delete clocks;
+
+    if(context)
+        ::free(context);
+}
+
+bool Scheduler::is_supported(void)
+{
+#ifdef  USE_FIBERS
+    return true;
+#else
+    return false;
+#endif
+}
+
+Scheduler *Scheduler::current(void)
+{
+    return (Scheduler *)schedulers().get();
+}
+
+Scheduler::fiber *Scheduler::self(void)
+{
+    Scheduler *scheduler = current();
+    if(!scheduler)
+        return NULL;
+
+    return scheduler->executing;
+}
+
+Scheduler::frame *Scheduler::create(size_t size)
+{
+    if(size == stacksize && idle) {
+        frame *fp = idle;
+        idle = fp->next;
+        --cached;
+        return fp;
+    }
+
+    frame *fp = new frame(this, size);
+    if(!fp->memory) {
+        delete fp;
+        return NULL;
+    }
+    return fp;
+}
+
+void Scheduler::destroy(frame *fp)
+{
+    fp->task = NULL;
+    if(fp->size == stacksize && cached < stacks) {
+        fp->next = idle;
+        idle = fp;
+        ++cached;
+        return;
+    }
+    delete fp;
+}
+
+void Scheduler::entry(void)
+{
+    Scheduler *scheduler = current();
+    fiber *item = scheduler->executing;
+
+    item->run();
+
+    // returning resumes the scheduler through the context link...
+    item->done = true;
+}
+
+bool Scheduler::start(fiber *item)
+{
+    assert(item != NULL);
+
+#ifdef  USE_FIBERS
+    if(item->context)
+        return false;
+
+    size_t size = stacksize;
+    if(item->stack) {
+        size_t page = pagesize();
+        size = ((item->stack + page - 1) / page) * page;
+    }
+
+    frame *fp = create(size);
+    if(!fp)
+        return false;
+
+    if(getcontext(&fp->context)) {
+        destroy(fp);
+        return false;
+    }
+
+    fp->context.uc_stack.ss_sp = fp->stack;
+    fp->context.uc_stack.ss_size = fp->size;
+    fp->context.uc_link = (ucontext_t *)context;
+    makecontext(&fp->context, &Scheduler::entry, 0);
+
+    fp->task = item;
+    item->owner = this;
+    item->context = fp;
+    item->done = false;
+    ++active;
+    ready(item);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Scheduler::ready(fiber *item)
+{
+    if(item->queued)
+        return;
+
+    item->queued = true;
+    item->next = NULL;
+    if(last)
+        last->next = item;
+    else
+        first = item;
+    last = item;
+}
+
+void Scheduler::resume(fiber *item)
+{
+#ifdef  USE_FIBERS
+    executing = item;
+    swapcontext((ucontext_t *)context, &item->context->context);
+    executing = NULL;
+
+    if(!item->done)
+        return;
+
+    destroy(item->context);
+    item->context = NULL;
+    --active;
+    if(item->detached)
+        delete item;
+#endif
+}
+
+void Scheduler::suspend(void)
+{
+#ifdef  USE_FIBERS
+    fiber *item = executing;
+    swapcontext(&item->context->context, (ucontext_t *)context);
+#endif
+}
+
+void Scheduler::run(void)
+{
+    Thread::Local& locals = schedulers();
+    void *prior = locals.get();
+
+    locals.set(this);
+    running = true;
+    while(running) {
+        // resume the fibers that are ready now, anything readied while
+        // this batch runs waits for the next pass...
+        fiber *batch = first;
+        first = last = NULL;
+        while(batch) {
+            fiber *item = batch;
+            batch = item->next;
+            item->queued = false;
+            resume(item);
+        }
+
+        timeout_t next = clocks->expire();
+        if(!active && !count())
+            break;
+
+        if(first)
+            next = 0;
+
+        if(poll(next) < 0 && errno != EINTR)
+            break;
+    }
+    running = false;
+    locals.set(prior);
+}
+
+void Scheduler::yield(void)
+{
+    Scheduler *scheduler = current();
+    fiber *item = self();
+
+    if(!item) {
+        Thread::yield();
+        return;
+    }
+
+    scheduler->ready(item);
+    scheduler->suspend();
+}
+
+void Scheduler::sleep(timeout_t timeout)
+{
+    Scheduler *scheduler = current();
+    fiber *item = self();
+
+    if(!item) {
+        Thread::sleep(timeout);
+        return;
+    }
+
+    if(!timeout) {
+        yield();
+        return;
+    }
+
+    frame *fp = item->context;
+    fp->timer.arm(timeout);
+    scheduler->suspend();
+    fp->timer.disarm();
+}
+
+unsigned Scheduler::wait(socket_t so, unsigned events, timeout_t timeout)
+{
+    Scheduler *scheduler = current();
+    fiber *item = self();
+
+    if(!item)
+        return 0;
+
+    frame *fp = item->context;
+    fp->events = events & (READABLE | WRITABLE);
+    fp->result = 0;
+
+    if(!fp->hold(so)) {
+        // a socket held by a handler outside the scheduler cannot be
+        // waited on, so this is reported after a pause, so callers that
+        // simply retry do not spin...
+        if(errno == EEXIST) {
+            if(timeout)
+                sleep(timeout < 10 ? timeout : 10);
+            errno = EEXIST;
+            return 0;
+        }
+
+        // descriptors the reactor cannot wait on, such as files, are
+        // always ready, so the caller retries after other fibers run...
+        yield();
+        return fp->events;
+    }
+
+    if(timeout != Timer::inf)
+        fp->timer.arm(timeout);
+
+    scheduler->suspend();
+
+    fp->timer.disarm();
+    fp->drop();
+    return fp->result & fp->events;
+}
+
+} // namespace ucommon
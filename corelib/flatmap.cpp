@@ -0,0 +1,177 @@
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ucommon-config.h>
+#include <ucommon/export.h>
+#include <ucommon/typeref.h>
+#include <ucommon/string.h>
+#include <ucommon/thread.h>
+#include <ucommon/condition.h>
+#include <ucommon/flatmap.h>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FLATMAP_SSE2
+#endif
+
+namespace ucommon {
+
+// control tags are either an empty or deleted marker with the high bit
+// set, or the top seven bits of the hash of the key in that slot.  The
+// first group of tags is mirrored past the end so a group may be loaded
+// from any position without wrapping...
+
+#define FLATMAP_EMPTY   ((uint8_t)0x80)
+#define FLATMAP_DELETED ((uint8_t)0xfe)
+
+FlatMap::FlatMap(size_t size, size_t initial, condlock_t *locking, bool biased)
+{
+    owned = false;
+    if(!locking && biased) {
+        lock = new BiasedLock();
+        owned = true;
+    }
+    else if(!locking) {
+        lock = new condlock_t();
+        owned = true;
+    }
+    else
+        lock = locking;
+
+    slotsize = size;
+    capacity = used = deleted = 0;
+    control = NULL;
+    slots = NULL;
+
+    size_t request = group;
+    while(request < initial + initial / 7)
+        request <<= 1;
+    rehash(request);
+}
+
+FlatMap::~FlatMap()
+{
+    if(control)
+        ::free(control);
+    if(slots)
+        ::free(slots);
+    if(owned && lock.biased())
+        delete lock.biased();
+    else if(owned)
+        delete lock.get();
+    control = NULL;
+    slots = NULL;
+}
+
+unsigned FlatMap::match(size_t offset, uint8_t id) const
+{
+#ifdef  FLATMAP_SSE2
+    __m128i tags = _mm_loadu_si128((const __m128i *)(control + offset));
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8((char)id)));
+#else
+    unsigned bits = 0;
+    for(unsigned pos = 0; pos < group; ++pos) {
+        if(control[offset + pos] == id)
+            bits |= (1u << pos);
+    }
+    return bits;
+#endif
+}
+
+unsigned FlatMap::empty(size_t offset) const
+{
+    return match(offset, FLATMAP_EMPTY);
+}
+
+void FlatMap::tag(size_t position, uint8_t id)
+{
+    control[position] = id;
+    if(position < group)
+        control[capacity + position] = id;
+}
+
+void FlatMap::erase(size_t position)
+{
+    --used;
+    ++deleted;
+    tag(position, FLATMAP_DELETED);
+}
+
+size_t FlatMap::insert(size_t hash)
+{
+    // keep load below 7/8 so every probe sequence reaches an empty tag...
+    if((used + deleted + 1) * 8 > capacity * 7) {
+        if(used * 2 < capacity)
+            rehash(capacity);
+        else
+            rehash(capacity * 2);
+    }
+
+    size_t mask = capacity - 1;
+    size_t offset = hash & mask;
+
+    for(size_t step = group; ; step += group) {
+        for(unsigned pos = 0; pos < group; ++pos) {
+            size_t index = (offset + pos) & mask;
+            uint8_t id = control[index];
+            if(id & 0x80) {
+                if(id == FLATMAP_DELETED)
+                    --deleted;
+                ++used;
+                return index;
+            }
+        }
+        offset = (offset + step) & mask;
+    }
+}
+
+void FlatMap::rehash(size_t size)
+{
+    uint8_t *tags = (uint8_t *)::malloc(size + group);
+    caddr_t list = (caddr_t)::malloc(size * slotsize);
+    if(!tags || !list)
+        __THROW_ALLOC();
+
+    memset(tags, FLATMAP_EMPTY, size + group);
+
+    uint8_t *prior = control;
+    caddr_t from = slots;
+    size_t limit = capacity;
+
+    control = tags;
+    slots = list;
+    capacity = size;
+    used = deleted = 0;
+
+    for(size_t pos = 0; pos < limit; ++pos) {
+        if(prior[pos] & 0x80)
+            continue;
+        caddr_t source = from + (pos * slotsize);
+        size_t hash = hashof(source);
+        size_t index = insert(hash);
+        relocate(slot(index), source);
+        tag(index, tagof(hash));
+    }
+
+    if(prior)
+        ::free(prior);
+    if(from)
+        ::free(from);
+}
+
+} // namespace ucommon
@@ -85,6 +85,26 @@
 #include <sys/event.h>
 #endif
 
+#ifdef  HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
+#ifndef _MSWINDOWS_
+#include <sys/socket.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef SPLICE_F_MOVE
+#define SPLICE_F_MOVE 0
+#endif
+
+#ifndef SPLICE_F_MORE
+#define SPLICE_F_MORE 0
+#endif
+
 namespace ucommon {
 
 const fsys::offset_t fsys::end = (offset_t)(-1);
@@ -1374,39 +1394,25 @@ int dir::remove(const char *path)
 int fsys::copy(const char *oldpath, const char *newpath, size_t size)
 {
     int result = 0;
-    char *buffer = new char[size];
     fsys src, dest;
-    ssize_t count = (ssize_t)size;
-
-    if(!buffer) {
-        result = ENOMEM;
-        goto end;
-    }
 
     remove(newpath);
 
     src.open(oldpath, fsys::STREAM);
-    if(!is(src))
+    if(!is(src)) {
+        result = src.err();
         goto end;
+    }
 
     dest.open(newpath, GROUP_PUBLIC, fsys::STREAM);
-    if(!is(dest))
+    if(!is(dest)) {
+        result = dest.err();
         goto end;
-
-    while(count > 0) {
-        count = src.read(buffer, size);
-        if(count < 0) {
-            result = src.err();
-            goto end;
-        }
-        if(count > 0)
-            count = dest.write(buffer, size);
-        if(count < 0) {
-            result = dest.err();
-            goto end;
-        }
     }
 
+    if(transfer(*dest, *src) < 0)
+        result = errno;
+
 end:
     if(is(src))
         src.close();
@@ -1414,15 +1420,258 @@ end:
     if(is(dest))
         dest.close();
 
-    if(buffer)
-        delete[] buffer;
-
     if(result != 0)
         remove(newpath);
 
     return result;
 }
 
+// when the kernel cannot move the data itself, it is copied through a
+// large page aligned buffer, so each pass is a few big system calls and
+// the buffer maps whole pages...
+
+#define TRANSFER_BUFFER 65536
+
+enum {
+    TRANSFER_FILE = 0,
+    TRANSFER_SEND,
+    TRANSFER_RECV
+};
+
+static caddr_t transfer_alloc(void)
+{
+#ifdef  HAVE_POSIX_MEMALIGN
+    void *mem = NULL;
+    if(posix_memalign(&mem, 4096, TRANSFER_BUFFER))
+        return NULL;
+    return (caddr_t)mem;
+#else
+    return (caddr_t)malloc(TRANSFER_BUFFER);
+#endif
+}
+
+static ssize_t transfer_input(intptr_t fd, caddr_t buf, size_t len, unsigned mode)
+{
+    if(mode == TRANSFER_RECV)
+        return ::recv((socket_t)fd, buf, (int)len, 0);
+
+#ifdef  _MSWINDOWS_
+    DWORD count;
+    if(!ReadFile((fd_t)fd, (LPVOID)buf, (DWORD)len, &count, NULL)) {
+        errno = fsys::remapError();
+        return -1;
+    }
+    return (ssize_t)count;
+#else
+    return ::read((fd_t)fd, buf, len);
+#endif
+}
+
+static ssize_t transfer_output(intptr_t fd, caddr_t buf, size_t len, unsigned mode)
+{
+    if(mode == TRANSFER_SEND)
+        return ::send((socket_t)fd, buf, (int)len, MSG_NOSIGNAL);
+
+#ifdef  _MSWINDOWS_
+    DWORD count;
+    if(!WriteFile((fd_t)fd, (LPCVOID)buf, (DWORD)len, &count, NULL)) {
+        errno = fsys::remapError();
+        return -1;
+    }
+    return (ssize_t)count;
+#else
+    return ::write((fd_t)fd, buf, len);
+#endif
+}
+
+static ssize_t transfer_buffered(intptr_t target, intptr_t source, size_t size, size_t total, unsigned mode)
+{
+    caddr_t buffer = transfer_alloc();
+    if(!buffer) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    while(!size || total < size) {
+        size_t request = TRANSFER_BUFFER;
+        if(size && size - total < request)
+            request = size - total;
+
+        ssize_t count = transfer_input(source, buffer, request, mode);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count < 0) {
+            total = (size_t)-1;
+            break;
+        }
+        if(!count)
+            break;
+
+        ssize_t offset = 0;
+        while(offset < count) {
+            ssize_t result = transfer_output(target, buffer + offset, (size_t)(count - offset), mode);
+            if(result < 0 && errno == EINTR)
+                continue;
+            if(result <= 0) {
+                offset = -1;
+                break;
+            }
+            offset += result;
+        }
+        if(offset < 0) {
+            total = (size_t)-1;
+            break;
+        }
+        total += (size_t)count;
+    }
+
+    int saved = errno;
+    ::free(buffer);
+    errno = saved;
+    return (ssize_t)total;
+}
+
+// errors that mean the kernel cannot move data between this pair of
+// descriptors, as opposed to a failure of the transfer itself...
+
+static bool transfer_unsupported(int error)
+{
+    switch(error) {
+    case EINVAL:
+    case ENOSYS:
+    case EXDEV:
+#ifdef  EOPNOTSUPP
+    case EOPNOTSUPP:
+#endif
+        return true;
+    default:
+        return false;
+    }
+}
+
+ssize_t fsys::transfer(fd_t target, fd_t source, size_t size)
+{
+    size_t total = 0;
+
+#ifdef  HAVE_COPY_FILE_RANGE
+    while(!size || total < size) {
+        size_t request = 0x40000000;
+        if(size && size - total < request)
+            request = size - total;
+
+        ssize_t count = ::copy_file_range(source, NULL, target, NULL, request, 0);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count < 0 && !total && transfer_unsupported(errno))
+            break;
+        if(count < 0)
+            return -1;
+        // procfs, sysfs, and some fuse files report nothing to copy, so a
+        // first empty copy is checked by reading instead...
+        if(!count && !total)
+            break;
+        if(!count)
+            return (ssize_t)total;
+        total += (size_t)count;
+    }
+    if(total)
+        return (ssize_t)total;
+#endif
+
+    return transfer_buffered((intptr_t)target, (intptr_t)source, size, total, TRANSFER_FILE);
+}
+
+ssize_t fsys::sendfile(socket_t target, fd_t source, size_t size)
+{
+    size_t total = 0;
+
+#ifdef  HAVE_SYS_SENDFILE_H
+    while(!size || total < size) {
+        size_t request = 0x40000000;
+        if(size && size - total < request)
+            request = size - total;
+
+        ssize_t count = ::sendfile(target, source, NULL, request);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count < 0 && !total && transfer_unsupported(errno))
+            break;
+        if(count < 0)
+            return -1;
+        if(!count)
+            return (ssize_t)total;
+        total += (size_t)count;
+    }
+    if(total)
+        return (ssize_t)total;
+#endif
+
+    return transfer_buffered((intptr_t)target, (intptr_t)source, size, total, TRANSFER_SEND);
+}
+
+ssize_t fsys::recvfile(fd_t target, socket_t source, size_t size)
+{
+    size_t total = 0;
+
+#if defined(HAVE_SPLICE) && defined(O_APPEND)
+    bool native = true;
+    int pfd[2];
+    int flags = ::fcntl(target, F_GETFL);
+
+    // the kernel will not splice into a file opened for append, and the
+    // pipe is only worth creating when the path can be used at all...
+    if(flags < 0 || (flags & O_APPEND) || ::pipe(pfd))
+        return transfer_buffered((intptr_t)target, (intptr_t)source, size, 0, TRANSFER_RECV);
+
+    while(!size || total < size) {
+        size_t request = TRANSFER_BUFFER;
+        if(size && size - total < request)
+            request = size - total;
+
+        ssize_t count = ::splice(source, NULL, pfd[1], NULL, request, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count < 0 && !total && transfer_unsupported(errno)) {
+            native = false;
+            break;
+        }
+        if(count <= 0) {
+            if(count < 0)
+                total = (size_t)-1;
+            break;
+        }
+
+        // drain the pipe fully, so it is empty again for the next pass...
+        ssize_t moved = 0;
+        while(moved < count) {
+            ssize_t result = ::splice(pfd[0], NULL, target, NULL, (size_t)(count - moved), SPLICE_F_MOVE);
+            if(result < 0 && errno == EINTR)
+                continue;
+            if(result <= 0) {
+                moved = -1;
+                break;
+            }
+            moved += result;
+        }
+        if(moved < 0) {
+            total = (size_t)-1;
+            break;
+        }
+        total += (size_t)count;
+    }
+
+    int saved = errno;
+    ::close(pfd[0]);
+    ::close(pfd[1]);
+    errno = saved;
+
+    if(native)
+        return (ssize_t)total;
+#endif
+
+    return transfer_buffered((intptr_t)target, (intptr_t)source, size, total, TRANSFER_RECV);
+}
+
 int fsys::rename(const char *oldpath, const char *newpath)
 {
     if(::rename(oldpath, newpath))
@@ -547,6 +547,8 @@ ReusableAllocator(), MappedMemory(name,  osize * count)
 
     objsize = (unsigned)osize;
     reading = 0;
+    base = addr();
+    stride = objsize;
 }
 
 MappedReuse::MappedReuse(size_t osize) :
@@ -556,32 +558,18 @@ ReusableAllocator(), MappedMemory()
 
     objsize = (unsigned)osize;
     reading = 0;
+    base = addr();
+    stride = objsize;
 }
 
 bool MappedReuse::avail(void) const
 {
-    bool rtn = false;
-
-    __AUTOLOCK(this);
-
-    if(freelist || used < size)
-        rtn = true;
-    return rtn;
+    return is_free() || Atomic::load(&used) + objsize <= size;
 }
 
 ReusableObject *MappedReuse::request(void)
 {
-    ReusableObject *obj = NULL;
-
-    __AUTOLOCK(this);
-
-    if(freelist) {
-        obj = freelist;
-        freelist = next(obj);
-    }
-    else if(used + objsize <= size)
-        obj = (ReusableObject *)sbrk(objsize);
-    return obj;
+    return getLocked();
 }
 
 ReusableObject *MappedReuse::get(void)
@@ -594,53 +582,51 @@ void MappedReuse::removeLocked(ReusableObject *obj)
     assert(obj != NULL);
 
     obj->retain();
-    obj->enlist((LinkedObject **)&freelist);
+    push(obj);
 }
 
+// the free list and mapped space are lock-free, so this is safe whether
+// or not the lock is actually held...
+
 ReusableObject *MappedReuse::getLocked(void)
 {
-    ReusableObject *obj = NULL;
+    ReusableObject *obj = pop();
 
-    if(freelist) {
-        obj = freelist;
-        freelist = next(obj);
-    }
-    else if(used + objsize <= size)
-        obj = (ReusableObject *)sbrk(objsize);
+    if(obj)
+        return obj;
 
-    return obj;
+    size_t current = Atomic::load(&used);
+    while(current + objsize <= size) {
+        if(Atomic::compare_exchange(&used, current, current + objsize))
+            return (ReusableObject *)offset(current);
+    }
+    return NULL;
 }
 
 ReusableObject *MappedReuse::getTimed(timeout_t timeout)
 {
-    bool rtn = true;
     struct timespec ts;
-    ReusableObject *obj = NULL;
+    ReusableObject *obj = getLocked();
 
-    if(timeout && timeout != Timer::inf)
-        set(&ts, timeout);
+    if(obj || !timeout)
+        return obj;
 
-    __AUTOLOCK(this);
+    if(timeout != Timer::inf)
+        set(&ts, timeout);
 
-    while(rtn && (!freelist || (freelist && reading)) && used >= size) {
-        ++waiting;
+    lock();
+    ++waiting;
+    Atomic::fence();
+    while(!(obj = getLocked())) {
         if(timeout == Timer::inf)
             wait();
-        else if(timeout)
-            rtn = wait(&ts);
-        else
-            rtn = false;
-        --waiting;
-    }
-    if(!rtn) {
-        return NULL;
-    }
-    if(freelist) {
-        obj = freelist;
-        freelist = next(obj);
+        else if(!wait(&ts)) {
+            obj = getLocked();
+            break;
+        }
     }
-    else if(used + objsize <= size)
-        obj = (ReusableObject *)sbrk(objsize);
+    --waiting;
+    unlock();
     return obj;
 }
 
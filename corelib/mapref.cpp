@@ -26,34 +26,83 @@
 
 namespace ucommon {
 
+// buckets migrated from the prior table on each modify while growing...
+#define MAPREF_REHASH   8
+
 MapRef::Index::Index() :
 LinkedObject()
 {
     key = value = NULL;
+    path = 0;
 }
 
 MapRef::Index::Index(LinkedObject **origin) :
 LinkedObject(origin)
 {
     key = value = NULL;
+    path = 0;
 }
 
-MapRef::Map::Map(void *addr, size_t indexes, size_t paging) :
+MapRef::Map::Map(void *addr, size_t indexes, size_t paging, bool biased, unsigned striped, hash_t hash) :
 Counted(addr, indexes), pool(paging)
 {
     size_t index = 0;
     LinkedObject **list = get();
     free = last = NULL;
-    count = alloc = 0;
+    count = alloc = limit = moved = 0;
+    lock = &locking;
+    table = list;
+    prior = NULL;
+    moving = NULL;
+    stripes = NULL;
+    ways = striped;
+    growing = false;
+    hashing = hash;
+
+    if(biased)
+        lock = new(pool.alloc(sizeof(BiasedLock))) BiasedLock();
+
+    // a striped table is a multiple of the stripes in size...
+    if(ways > indexes)
+        ways = (unsigned)indexes;
+
+    if(ways) {
+        size = indexes - (indexes % ways);
+        moving = (size_t *)pool.alloc(sizeof(size_t) * ways);
+        stripes = (sharedlock_t *)pool.alloc(sizeof(sharedlock_t) * ways);
+        for(unsigned pos = 0; pos < ways; ++pos) {
+            if(biased)
+                stripes[pos] = new(pool.alloc(sizeof(BiasedLock))) BiasedLock();
+            else
+                stripes[pos] = new(pool.alloc(sizeof(condlock_t))) condlock_t();
+            moving[pos] = 0;
+        }
+    }
     
     while(index < indexes) {
         list[index++] = NULL;
     }
 }
 
+// key paths are spread by the hash of the map when they enter it, so the
+// paths held and compared within the map are all spread paths...
+
+size_t MapRef::Map::spread(size_t path) const
+{
+    if(!hashing)
+        return path;
+
+    size_t key = sizeof(path);
+    return (*hashing)(key, (const uint8_t *)&path, sizeof(path));
+}
+
+// in striped mode only the bucket stripe is held, so the free list, pool,
+// and count are guarded separately, and growth is deferred to commit...
+
 MapRef::Index *MapRef::Map::create(size_t key)
 {
-    LinkedObject **list = get();
+    if(ways)
+        guard.acquire();
     caddr_t p = (caddr_t)(free);
     if(free)
         free = free->getNext();
@@ -62,12 +111,108 @@ MapRef::Index *MapRef::Map::create(size_t key)
         p = (caddr_t)pool.alloc(sizeof(Index));
     }
     ++count;
-    return new(p) Index(&list[key % size]);
+    key = spread(key);
+    if(ways) {
+        if(count > size * 2)
+            growing = true;
+        guard.release();
+    }
+    Index *ip = new(p) Index(locate(key));
+    ip->path = key;
+    if(!ways && !prior && count > size * 2)
+        grow();
+    return ip;
+}
+
+// while growing, a key lives in the prior table until its old bucket has
+// been migrated, so every key is always on exactly one chain.  A striped
+// map migrates the buckets of each stripe in order, and as tables are a
+// multiple of the stripes in size, a key and both of its buckets are
+// always covered by the same stripe...
+
+LinkedObject **MapRef::Map::locate(size_t path)
+{
+    if(prior) {
+        size_t offset = path % limit;
+        if(ways && offset / ways >= moving[offset % ways])
+            return &prior[offset];
+        if(!ways && offset >= moved)
+            return &prior[offset];
+    }
+    return &table[path % size];
+}
+
+LinkedObject *MapRef::Map::bucket(size_t offset)
+{
+    if(offset < size)
+        return table[offset];
+    return prior[offset - size];
+}
+
+size_t MapRef::Map::paths(void)
+{
+    if(prior)
+        return size + limit;
+    return size;
+}
+
+void MapRef::Map::grow(void)
+{
+    size_t buckets = size * 2;
+    if(!ways)
+        ++buckets;
+    LinkedObject **list = (LinkedObject **)::calloc(buckets, sizeof(LinkedObject *));
+    if(!list)
+        return;
+
+    prior = table;
+    limit = size;
+    moved = 0;
+    table = list;
+    size = buckets;
+}
+
+void MapRef::Map::migrate(size_t offset)
+{
+    LinkedObject *node = prior[offset];
+    prior[offset] = NULL;
+    while(node) {
+        Index *ip = static_cast<Index *>(node);
+        node = node->getNext();
+        ip->Next = table[ip->path % size];
+        table[ip->path % size] = ip;
+    }
+}
+
+void MapRef::Map::rehash(unsigned stripe, size_t buckets)
+{
+    if(!prior)
+        return;
+
+    size_t share = limit / ways;
+    while(moving[stripe] < share && buckets--)
+        migrate(moving[stripe]++ * ways + stripe);
+}
+
+void MapRef::Map::rehash(size_t buckets)
+{
+    while(prior && buckets--) {
+        migrate(moved++);
+        if(moved < limit)
+            continue;
+
+        if(prior != get())
+            ::free(prior);
+        prior = NULL;
+        limit = moved = 0;
+    }
 }
 
 MapRef::Index *MapRef::Map::append()
 {
-    LinkedObject **list = get();
+    LinkedObject **list = table;
+    if(ways)
+        guard.acquire();
     caddr_t p = (caddr_t)(free);
     if(free)
         free = free->getNext();
@@ -85,6 +230,8 @@ MapRef::Index *MapRef::Map::append()
         list[0] = ip;
     last = ip;
     ip->Next = NULL;
+    if(ways)
+        guard.release();
     return ip;
 }       
 
@@ -99,10 +246,11 @@ void MapRef::Map::remove(Index *index, size_t path)
     if(index->value)
         index->value->release();
 
-    LinkedObject **root = get();
-    root = &root[path % size];
+    LinkedObject **root = locate(spread(path));
 
-    --count;
+    // the last entry is shared by every stripe...
+    if(ways)
+        guard.acquire();
     if(last && index == last) {
         last = *(root);
         if(last == index)
@@ -114,32 +262,126 @@ void MapRef::Map::remove(Index *index, size_t path)
         }
     }
     index->delist(root); 
+    --count;
     index->enlist(&free);
+    if(ways)
+        guard.release();
 }
 
+// a stripe covers every key path that maps to it, which does not change
+// as the map grows...
+
 LinkedObject *MapRef::Map::access(size_t key)
 {
-    lock.access();
-	return (get())[key % size];
+    key = spread(key);
+    if(!ways)
+        lock.access();
+    else
+        stripes[key % ways].access();
+    return *locate(key);
 }
 
 LinkedObject *MapRef::Map::modify(size_t key)
 {
-    lock.modify();
-    return (get())[key % size];
+    key = spread(key);
+    if(!ways) {
+        lock.modify();
+        rehash(MAPREF_REHASH);
+    }
+    else {
+        stripes[key % ways].modify();
+        rehash((unsigned)(key % ways), MAPREF_REHASH);
+    }
+    return *locate(key);
+}
+
+void MapRef::Map::commit(size_t key)
+{
+    if(!ways) {
+        lock.commit();
+        return;
+    }
+
+    stripes[spread(key) % ways].commit();
+    if(growing)
+        expand();
+}
+
+void MapRef::Map::unlock(size_t key)
+{
+    if(!ways)
+        lock.release();
+    else
+        stripes[spread(key) % ways].release();
+}
+
+void MapRef::Map::enter(bool exclusive)
+{
+    if(!ways) {
+        if(exclusive)
+            lock.modify();
+        else
+            lock.access();
+        return;
+    }
+
+    for(unsigned pos = 0; pos < ways; ++pos) {
+        if(exclusive)
+            stripes[pos].modify();
+        else
+            stripes[pos].access();
+    }
+}
+
+void MapRef::Map::leave(bool exclusive)
+{
+    if(!ways) {
+        if(exclusive)
+            lock.commit();
+        else
+            lock.release();
+        return;
+    }
+
+    unsigned pos = ways;
+    while(pos--) {
+        if(exclusive)
+            stripes[pos].commit();
+        else
+            stripes[pos].release();
+    }
+}
+
+void MapRef::Map::expand(void)
+{
+    enter(true);
+    if(growing) {
+        growing = false;
+        // stripes left idle may not have migrated the last growth...
+        for(unsigned pos = 0; pos < ways; ++pos) {
+            rehash(pos, limit);
+            moving[pos] = 0;
+        }
+        if(prior && prior != get())
+            ::free(prior);
+        prior = NULL;
+        limit = 0;
+        grow();
+    }
+    leave(true);
 }
 
 void MapRef::Map::dealloc()
 {
-    size_t index = 0;
-    LinkedObject **list = get();
+    size_t index = 0, total = paths();
     linked_pointer<Index> ip;
 
     if(!size)
         return;
 
-    while(index < size) {
-		ip = list[index];
+    enter(true);
+    while(index < total) {
+		ip = bucket(index);
 		while(ip) {
 			if(ip->key)
 				ip->key->release();
@@ -149,8 +391,26 @@ void MapRef::Map::dealloc()
 		}
 		++index;
 	}	
+    leave(true);
+    if(prior && prior != get())
+        ::free(prior);
+    if(table != get())
+        ::free(table);
+    table = prior = NULL;
     size = 0;
 	free = last = NULL;
+    if(lock.biased()) {
+        lock.biased()->~BiasedLock();
+        lock = &locking;
+    }
+    while(ways) {
+        sharedlock_t& stripe = stripes[--ways];
+        if(stripe.biased())
+            stripe.biased()->~BiasedLock();
+        else
+            stripe.get()->~ConditionalLock();
+    }
+    stripes = NULL;
 	pool.purge();
     Counted::dealloc();
 }
@@ -162,7 +422,7 @@ MapRef::Instance::Instance(Map *vmap)
 
     map = vmap;
     map->retain();
-    map->lock.access();
+    map->enter();
     rewind();
 }
 
@@ -173,7 +433,7 @@ MapRef::Instance::Instance(MapRef& from)
         return;
 
     map->retain();
-    map->lock.access();
+    map->enter();
     rewind();
 }
 
@@ -193,7 +453,7 @@ MapRef::Instance::Instance(const Instance& copy)
         return;
 
     map->retain();
-    map->lock.access();
+    map->enter();
 }
 
 MapRef::Instance::~Instance()
@@ -206,7 +466,7 @@ void MapRef::Instance::drop()
     if(!map)
         return;
 
-    map->lock.release();
+    map->leave();
     map->release();
     map = NULL;
     index = NULL;
@@ -223,7 +483,7 @@ void MapRef::Instance::assign(const Instance& copy)
         return;
 
     map->retain();
-    map->lock.access();
+    map->enter();
 }
 
 void MapRef::Instance::assign(MapRef& from)
@@ -234,7 +494,7 @@ void MapRef::Instance::assign(MapRef& from)
         return;
 
     map->retain();
-    map->lock.access();
+    map->enter();
     rewind();
 }
 
@@ -244,7 +504,7 @@ void MapRef::Instance::rewind()
         return;
 
     path = 0;
-    index = (map->get())[0];
+    index = map->bucket(0);
     if(!index)
         next();
 }
@@ -257,7 +517,7 @@ bool MapRef::Instance::top()
     if(path > 0)
         return false;
 
-    if(index != (map->get())[0])
+    if(index != map->bucket(0))
         return false;
 
     return true;
@@ -284,7 +544,7 @@ bool MapRef::Instance::eol()
     if(!map)
         return false;
 
-    if(path < map->size)
+    if(path < map->paths())
         return false;
 
     return true;
@@ -301,8 +561,8 @@ bool MapRef::Instance::next()
     if(index)
         return true;
 
-    while(++path < map->size) {
-        index = (map->get())[path];
+    while(++path < map->paths()) {
+        index = map->bucket(path);
         if(index)
             return true;
     }
@@ -319,8 +579,8 @@ TypeRef(copy)
 {
 }
 
-MapRef::MapRef(size_t indexes, size_t paging) :
-TypeRef(create(indexes, paging))
+MapRef::MapRef(size_t indexes, size_t paging, bool biased, unsigned stripes, hash_t hash) :
+TypeRef(create(indexes, paging, biased, stripes, hash))
 {
 }
 
@@ -339,7 +599,13 @@ size_t MapRef::count()
 	if(!m)
         return 0;
 
-    return m->count;
+    if(!m->ways)
+        return m->count;
+
+    m->enter();
+    size_t total = m->count;
+    m->leave();
+    return total;
 }
 
 void MapRef::remove(Index *ind, size_t path)
@@ -351,14 +617,14 @@ void MapRef::remove(Index *ind, size_t path)
     m->remove(ind, path);
 }
 
-MapRef::Map *MapRef::create(size_t indexes, size_t paging)
+MapRef::Map *MapRef::create(size_t indexes, size_t paging, bool biased, unsigned stripes, hash_t hash)
 {
     if(!indexes)
         return NULL;
 
     size_t s = sizeof(Map) + (indexes * sizeof(Index *));
     caddr_t p = auto_release.allocate(s);
-    return new(mem(p)) Map(p, indexes, paging);
+    return new(mem(p)) Map(p, indexes, paging, biased, stripes, hash);
 }
 
 void MapRef::update(Index *ind, TypeRef& value)
@@ -379,17 +645,17 @@ void MapRef::append(TypeRef& value)
 	if(!m || !m->size)
 		return;
 
-    m->lock.modify();
+    m->modify();
     Index *ind = m->append();
     if(!ind) {
-        m->lock.commit();
+        m->commit();
         return;
     }
     ind->key = NULL;
     ind->value = value.ref;
     if(ind->value)
         ind->value->retain();
-    m->lock.commit();
+    m->commit();
 }
 
 void MapRef::add(size_t keypath, TypeRef& key, TypeRef& value)
@@ -434,26 +700,57 @@ linked_pointer<MapRef::Index> MapRef::modify(size_t key)
 	return ip;
 }
 
-void MapRef::commit()
+void MapRef::commit(size_t key)
 {
     Map *m = polydynamic_cast<Map *>(ref);
 	if(!m || !m->size)
 		return;
 
-    m->lock.commit();
+    m->commit(key);
     m->release();
 }
 
-void MapRef::release()
+void MapRef::release(size_t key)
 {
     Map *m = polydynamic_cast<Map *>(ref);
 	if(!m || !m->size)
 		return;
 
-    m->lock.release();
+    m->unlock(key);
     m->release();
 }
 
+void MapRef::statistics(size_t *buckets, size_t *chains, size_t *longest)
+{
+    size_t total = 0, used = 0, deepest = 0;
+    Map *m = polydynamic_cast<Map *>(ref);
+
+    if(m && m->size) {
+        m->enter();
+        total = m->paths();
+        for(size_t path = 0; path < total; ++path) {
+            size_t depth = 0;
+            LinkedObject *node = m->bucket(path);
+            while(node) {
+                ++depth;
+                node = node->getNext();
+            }
+            if(depth)
+                ++used;
+            if(depth > deepest)
+                deepest = depth;
+        }
+        m->leave();
+    }
+
+    if(buckets)
+        *buckets = total;
+    if(chains)
+        *chains = used;
+    if(longest)
+        *longest = deepest;
+}
+
 size_t MapRef::index(size_t& key, const uint8_t *addr, size_t len)
 {
 	while(len-- && addr) {
@@ -463,4 +760,47 @@ size_t MapRef::index(size_t& key, const uint8_t *addr, size_t len)
 	return key;
 }
 
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+#ifdef  __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t r = a * (b | 1);
+    r ^= r >> 32;
+    r *= 0x9e3779b97f4a7c15ull;
+    return r ^ (r >> 29) ^ b;
+#endif
+}
+
+size_t MapRef::mixed(size_t& key, const uint8_t *addr, size_t len)
+{
+    static const uint64_t p0 = 0xa0761d6478bd642full;
+    static const uint64_t p1 = 0xe7037ed1a0b428dbull;
+    static const uint64_t p2 = 0x8ebc6af09c88c6e3ull;
+
+    uint64_t seed = (uint64_t)key ^ p0;
+    size_t total = len;
+
+    if(!addr)
+        len = 0;
+
+    while(len >= 8) {
+        uint64_t word;
+        memcpy(&word, addr, 8);
+        seed = mix(seed ^ word, p1);
+        addr += 8;
+        len -= 8;
+    }
+
+    if(len) {
+        uint64_t word = 0;
+        memcpy(&word, addr, len);
+        seed = mix(seed ^ word, p1);
+    }
+
+    key = (size_t)mix(seed ^ (uint64_t)total, p2);
+    return key;
+}
+
 } // namespace
@@ -21,6 +21,7 @@
 #include <ucommon/object.h>
 #include <ucommon/memory.h>
 #include <ucommon/thread.h>
+#include <ucommon/atomic.h>
 #include <ucommon/string.h>
 #include <ucommon/fsys.h>
 #ifdef  HAVE_UNISTD_H
@@ -64,6 +65,7 @@ void memalloc::assign(memalloc& source)
     count = source.count;
     page = source.page;
     limit = source.limit;
+    slab = source.slab;
     source.count = 0;
     source.page = NULL;
 }
@@ -105,6 +107,7 @@ memalloc::memalloc(size_t ps)
     count = 0;
     limit = 0;
     page = NULL;
+    slab = NULL;
 }
 
 memalloc::memalloc(const memalloc& copy)
@@ -114,6 +117,7 @@ memalloc::memalloc(const memalloc& copy)
     page = NULL;
     pagesize = copy.pagesize;
     align = copy.align;
+    slab = copy.slab;
 }
 
 memalloc::~memalloc()
@@ -145,6 +149,11 @@ void memalloc::purge(void)
     page_t *next;
     while(page) {
         next = page->next;
+        if(slab) {
+            slab->dealloc(page);
+            page = next;
+            continue;
+        }
 #if defined(HAVE_ALIGNED_ALLOC) && defined(_MSWINDOWS_)
         if (align)
             _aligned_free(page);
@@ -170,18 +179,21 @@ memalloc::page_t *memalloc::pager(void)
         return NULL;
     }
 
+    if(slab)
+        npage = (page_t *)slab->alloc(pagesize);
 #if defined(HAVE_POSIX_MEMALIGN)
-    if(align && !posix_memalign(&addr, align, pagesize))
+    else if(align && !posix_memalign(&addr, align, pagesize))
         npage = (page_t *)addr;
     else
         npage = (page_t *)malloc(pagesize);
 #elif defined(HAVE_ALIGNED_ALLOC)
-    if (align)
+    else if (align)
         npage = (page_t *)aligned_alloc(align, pagesize);
     else
         npage = (page_t *)malloc(pagesize);
 #else
-    npage = (page_t *)malloc(pagesize);
+    else
+        npage = (page_t *)malloc(pagesize);
 #endif
 
     if(!npage) {
@@ -199,6 +211,15 @@ memalloc::page_t *memalloc::pager(void)
     return npage;
 }
 
+bool memalloc::attach(slaballoc *heap)
+{
+    if(page)
+        return false;
+
+    slab = heap;
+    return true;
+}
+
 void *memalloc::_alloc(size_t size)
 {
     assert(size > 0);
@@ -227,6 +248,592 @@ void *memalloc::_alloc(size_t size)
     return mem;
 }
 
+// slab pages are aligned on their own size, so the page header of any
+// object can be found by masking its address...
+
+#define SLAB_PAGESIZE   65536
+#define SLAB_ALIGN      16
+
+typedef struct slabpage {
+    struct slabpage *next, *prev;
+    void *base;
+    slaballoc::sizeclass *owner;
+    size_t size;
+    unsigned used, first;
+    uint32_t map[1];
+} slabpage_t;
+
+class __LOCAL slaballoc::sizeclass
+{
+public:
+    pthread_mutex_t mutex;
+    size_t size, offset;
+    unsigned total, words;
+    unsigned pages, used;
+    slabpage_t *partial, *full, *spare;
+};
+
+static size_t slab_offset(size_t words)
+{
+    size_t offset = sizeof(slabpage_t) + sizeof(uint32_t) * (words - 1);
+    return (offset + SLAB_ALIGN - 1) & ~((size_t)SLAB_ALIGN - 1);
+}
+
+static size_t slab_class(unsigned id)
+{
+    if(id < 4)
+        return (id + 1) * 8;
+
+    unsigned shift = 5 + (id - 4) / 4;
+    return ((size_t)1 << shift) + ((id - 4) % 4 + 1) * ((size_t)1 << (shift - 2));
+}
+
+static unsigned slab_index(size_t size)
+{
+    if(size <= 32)
+        return (unsigned)((size + 7) / 8) - 1;
+
+    size_t bits = size - 1;
+    unsigned shift = 0;
+    while(bits >> (shift + 1))
+        ++shift;
+
+    size_t step = (size_t)1 << (shift - 2);
+    return 4 + (shift - 5) * 4 + (unsigned)((size - 1 - ((size_t)1 << shift)) / step);
+}
+
+static void *slab_pagealloc(size_t align, size_t size)
+{
+    void *mem = NULL;
+
+#if defined(HAVE_POSIX_MEMALIGN)
+    if(posix_memalign(&mem, align, size))
+        return NULL;
+#elif defined(HAVE_ALIGNED_ALLOC)
+    mem = aligned_alloc(align, (size + align - 1) & ~(align - 1));
+#else
+    caddr_t base = (caddr_t)malloc(size + align);
+    if(!base)
+        return NULL;
+    mem = (void *)(((uintptr_t)base + align) & ~((uintptr_t)align - 1));
+    ((slabpage_t *)mem)->base = base;
+    return mem;
+#endif
+    if(mem)
+        ((slabpage_t *)mem)->base = mem;
+    return mem;
+}
+
+static void slab_pagefree(slabpage_t *page)
+{
+#if defined(HAVE_ALIGNED_ALLOC) && defined(_MSWINDOWS_) && !defined(HAVE_POSIX_MEMALIGN)
+    _aligned_free(page->base);
+#else
+    free(page->base);
+#endif
+}
+
+static void slab_unlink(slabpage_t **list, slabpage_t *page)
+{
+    if(page->prev)
+        page->prev->next = page->next;
+    else
+        *list = page->next;
+    if(page->next)
+        page->next->prev = page->prev;
+    page->next = page->prev = NULL;
+}
+
+static void slab_link(slabpage_t **list, slabpage_t *page)
+{
+    page->prev = NULL;
+    page->next = *list;
+    if(*list)
+        (*list)->prev = page;
+    *list = page;
+}
+
+static void slab_purge(slabpage_t *page)
+{
+    slabpage_t *next;
+
+    while(page) {
+        next = page->next;
+        slab_pagefree(page);
+        page = next;
+    }
+}
+
+slaballoc::slaballoc(size_t ps)
+{
+    if(!ps)
+        ps = SLAB_PAGESIZE;
+
+    pagesize = 1024;
+    while(pagesize < ps)
+        pagesize <<= 1;
+
+    // each size class should hold at least 8 objects in a page...
+    maximum = pagesize / 8;
+    classes = slab_index(maximum) + 1;
+    while(slab_class(classes - 1) > maximum)
+        --classes;
+    maximum = slab_class(classes - 1);
+
+    large = NULL;
+    pthread_mutex_init(&mutex, NULL);
+
+    index = (sizeclass *)::malloc(sizeof(sizeclass) * classes);
+    if(!index)
+        __THROW_ALLOC();
+
+    for(unsigned id = 0; id < classes; ++id) {
+        sizeclass *sc = &index[id];
+        sc->size = slab_class(id);
+        sc->total = (unsigned)(pagesize / sc->size);
+        for(;;) {
+            sc->words = (sc->total + 31) / 32;
+            sc->offset = slab_offset(sc->words);
+            if(sc->offset + sc->total * sc->size <= pagesize)
+                break;
+            --sc->total;
+        }
+        sc->pages = sc->used = 0;
+        sc->partial = sc->full = sc->spare = NULL;
+        pthread_mutex_init(&sc->mutex, NULL);
+    }
+}
+
+slaballoc::~slaballoc()
+{
+    slaballoc::purge();
+
+    for(unsigned id = 0; id < classes; ++id)
+        pthread_mutex_destroy(&index[id].mutex);
+
+    ::free(index);
+    pthread_mutex_destroy(&mutex);
+}
+
+size_t slaballoc::fit(size_t size) const
+{
+    if(size > maximum)
+        return 0;
+
+    if(!size)
+        size = 1;
+
+    return index[slab_index(size)].size;
+}
+
+void slaballoc::purge(void)
+{
+    for(unsigned id = 0; id < classes; ++id) {
+        sizeclass *sc = &index[id];
+        pthread_mutex_lock(&sc->mutex);
+        slab_purge(sc->partial);
+        slab_purge(sc->full);
+        slab_purge(sc->spare);
+        sc->partial = sc->full = sc->spare = NULL;
+        sc->pages = sc->used = 0;
+        pthread_mutex_unlock(&sc->mutex);
+    }
+
+    pthread_mutex_lock(&mutex);
+    slab_purge((slabpage_t *)large);
+    large = NULL;
+    pthread_mutex_unlock(&mutex);
+}
+
+unsigned slaballoc::pages(void) const
+{
+    unsigned total = 0;
+
+    for(unsigned id = 0; id < classes; ++id) {
+        pthread_mutex_lock(&index[id].mutex);
+        total += index[id].pages;
+        pthread_mutex_unlock(&index[id].mutex);
+    }
+
+    pthread_mutex_lock(&mutex);
+    slabpage_t *page = (slabpage_t *)large;
+    while(page) {
+        ++total;
+        page = page->next;
+    }
+    pthread_mutex_unlock(&mutex);
+    return total;
+}
+
+unsigned slaballoc::utilization(void) const
+{
+    unsigned long used = 0, alloc = 0;
+
+    for(unsigned id = 0; id < classes; ++id) {
+        sizeclass *sc = &index[id];
+        pthread_mutex_lock(&sc->mutex);
+        alloc += (unsigned long)sc->pages * pagesize;
+        used += (unsigned long)sc->used * sc->size;
+        pthread_mutex_unlock(&sc->mutex);
+    }
+
+    pthread_mutex_lock(&mutex);
+    slabpage_t *page = (slabpage_t *)large;
+    while(page) {
+        alloc += (unsigned long)page->size;
+        used += (unsigned long)page->size;
+        page = page->next;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if(!alloc)
+        return 0;
+
+    return (unsigned)((used * 100) / alloc);
+}
+
+void *slaballoc::_alloc(size_t size)
+{
+    assert(size > 0);
+
+    slabpage_t *page;
+
+    if(size > maximum) {
+        size_t offset = slab_offset(1);
+        page = (slabpage_t *)slab_pagealloc(pagesize, offset + size);
+        if(!page) {
+            __THROW_ALLOC();
+            return NULL;
+        }
+        page->owner = NULL;
+        page->size = offset + size;
+        page->used = 1;
+        pthread_mutex_lock(&mutex);
+        slab_link((slabpage_t **)&large, page);
+        pthread_mutex_unlock(&mutex);
+        return ((caddr_t)page) + offset;
+    }
+
+    sizeclass *sc = &index[slab_index(size)];
+    pthread_mutex_lock(&sc->mutex);
+    page = sc->partial;
+    if(!page) {
+        page = sc->spare;
+        sc->spare = NULL;
+        if(!page) {
+            page = (slabpage_t *)slab_pagealloc(pagesize, pagesize);
+            if(!page) {
+                pthread_mutex_unlock(&sc->mutex);
+                __THROW_ALLOC();
+                return NULL;
+            }
+            page->owner = sc;
+            page->size = pagesize;
+            page->used = page->first = 0;
+            for(unsigned word = 0; word < sc->words; ++word)
+                page->map[word] = 0xffffffff;
+            if(sc->total % 32)
+                page->map[sc->words - 1] = ((uint32_t)1 << (sc->total % 32)) - 1;
+            ++sc->pages;
+        }
+        slab_link(&sc->partial, page);
+    }
+
+    unsigned word = page->first;
+    while(!page->map[word])
+        ++word;
+
+    unsigned bit = 0;
+    uint32_t bits = page->map[word];
+    while(!(bits & ((uint32_t)1 << bit)))
+        ++bit;
+
+    page->map[word] &= ~((uint32_t)1 << bit);
+    page->first = word;
+    ++sc->used;
+    if(++page->used == sc->total) {
+        slab_unlink(&sc->partial, page);
+        slab_link(&sc->full, page);
+    }
+    pthread_mutex_unlock(&sc->mutex);
+    return ((caddr_t)page) + sc->offset + (word * 32 + bit) * sc->size;
+}
+
+void slaballoc::dealloc(void *mem)
+{
+    if(!mem)
+        return;
+
+    slabpage_t *page = (slabpage_t *)((uintptr_t)mem & ~((uintptr_t)pagesize - 1));
+    sizeclass *sc = page->owner;
+
+    if(!sc) {
+        pthread_mutex_lock(&mutex);
+        slab_unlink((slabpage_t **)&large, page);
+        pthread_mutex_unlock(&mutex);
+        slab_pagefree(page);
+        return;
+    }
+
+    unsigned pos = (unsigned)((((caddr_t)mem) - ((caddr_t)page) - sc->offset) / sc->size);
+    unsigned word = pos / 32;
+    uint32_t bit = (uint32_t)1 << (pos % 32);
+
+    pthread_mutex_lock(&sc->mutex);
+    assert(!(page->map[word] & bit));
+    page->map[word] |= bit;
+    if(word < page->first)
+        page->first = word;
+    --sc->used;
+    if(page->used-- == sc->total) {
+        slab_unlink(&sc->full, page);
+        slab_link(&sc->partial, page);
+    }
+
+    // keep one empty page per class so we do not thrash the system heap...
+    if(!page->used) {
+        slab_unlink(&sc->partial, page);
+        if(sc->spare) {
+            --sc->pages;
+            slab_pagefree(page);
+        }
+        else
+            sc->spare = page;
+    }
+    pthread_mutex_unlock(&sc->mutex);
+}
+
+class __LOCAL MagazineCache::magazine
+{
+public:
+    magazine *next;
+    volatile atomic_t refs;
+    volatile bool owned;
+    unsigned generation;
+    volatile unsigned long hits, misses;
+    caddr_t mem;
+    size_t avail;
+    unsigned count;
+    void *items[1];
+};
+
+// each thread keeps a small table of the magazines it holds...
+
+#define MAGAZINE_SLOTS  16
+
+typedef struct {
+    unsigned long serial;
+    MagazineCache::magazine *mag;
+} magazine_slot;
+
+typedef struct {
+    unsigned next;
+    magazine_slot slot[MAGAZINE_SLOTS];
+} magazine_table;
+
+static volatile atomic_t magazine_serial = 0;
+
+static void magazine_drop(MagazineCache::magazine *mag)
+{
+    // the thread gives up the magazine, and whoever is last frees it...
+    Atomic::store(&mag->owned, false);
+    if(Atomic::fetch_add(&mag->refs, -1) == 1)
+        ::free(mag);
+}
+
+static void magazine_release(void *mem)
+{
+    magazine_table *table = (magazine_table *)mem;
+
+    if(!table)
+        return;
+
+    for(unsigned pos = 0; pos < MAGAZINE_SLOTS; ++pos) {
+        if(table->slot[pos].mag)
+            magazine_drop(table->slot[pos].mag);
+    }
+    ::free(table);
+}
+
+#ifdef  _MSTHREADS_
+
+// thread locals are only released by threads ucommon started, so other
+// threads are kept out of the cache rather than leak their magazines...
+
+class __LOCAL magazine_local : public Thread::Local
+{
+private:
+    void *allocate(void) __FINAL {
+        return ::calloc(1, sizeof(magazine_table));
+    }
+
+    void release(void *mem) __FINAL {
+        magazine_release(mem);
+    }
+};
+
+static magazine_local magazine_locals;
+
+static magazine_table *magazine_tables(void)
+{
+    if(!Thread::get())
+        return NULL;
+
+    return (magazine_table *)*magazine_locals;
+}
+
+#else
+
+// the table is kept in a key with a destructor, so magazines are given
+// back when any thread exits, including threads ucommon did not start...
+
+static pthread_key_t magazine_key;
+static pthread_once_t magazine_once = PTHREAD_ONCE_INIT;
+
+static void magazine_init(void)
+{
+    pthread_key_create(&magazine_key, &magazine_release);
+}
+
+static magazine_table *magazine_tables(void)
+{
+    pthread_once(&magazine_once, &magazine_init);
+
+    magazine_table *table = (magazine_table *)pthread_getspecific(magazine_key);
+    if(!table) {
+        table = (magazine_table *)::calloc(1, sizeof(magazine_table));
+        if(table)
+            pthread_setspecific(magazine_key, table);
+    }
+    return table;
+}
+
+#endif
+
+MagazineCache::MagazineCache(unsigned size)
+{
+    list = NULL;
+    depth = size;
+    generation = 0;
+    serial = (unsigned long)Atomic::fetch_add(&magazine_serial, 1) + 1;
+    pthread_mutex_init(&mutex, NULL);
+}
+
+MagazineCache::~MagazineCache()
+{
+    magazine *next;
+
+    while(list) {
+        next = list->next;
+        if(Atomic::fetch_add(&list->refs, -1) == 1)
+            ::free(list);
+        list = next;
+    }
+    pthread_mutex_destroy(&mutex);
+}
+
+void MagazineCache::set(unsigned size)
+{
+    pthread_mutex_lock(&mutex);
+    if(!list)
+        depth = size;
+    pthread_mutex_unlock(&mutex);
+}
+
+MagazineCache::magazine *MagazineCache::get(void)
+{
+    magazine_table *table;
+    magazine *mag;
+    unsigned pos;
+
+    if(!depth)
+        return NULL;
+
+    table = magazine_tables();
+    if(!table)
+        return NULL;
+
+    for(pos = 0; pos < MAGAZINE_SLOTS; ++pos) {
+        if(table->slot[pos].serial == serial)
+            return table->slot[pos].mag;
+    }
+
+    // claim a magazine left by an exited thread, or create a new one...
+    pthread_mutex_lock(&mutex);
+    mag = list;
+    while(mag) {
+        if(!mag->owned)
+            break;
+        mag = mag->next;
+    }
+    if(mag) {
+        mag->owned = true;
+        Atomic::fetch_add(&mag->refs, 1);
+    }
+    else {
+        mag = (magazine *)::malloc(sizeof(magazine) + sizeof(void *) * depth);
+        if(mag) {
+            memset(mag, 0, sizeof(magazine));
+            mag->refs = 2;
+            mag->owned = true;
+            mag->generation = generation;
+            mag->next = list;
+            list = mag;
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if(!mag)
+        return NULL;
+
+    pos = table->next++ % MAGAZINE_SLOTS;
+    if(table->slot[pos].mag)
+        magazine_drop(table->slot[pos].mag);
+
+    table->slot[pos].serial = serial;
+    table->slot[pos].mag = mag;
+    return mag;
+}
+
+unsigned long MagazineCache::hits(void) const
+{
+    unsigned long total = 0;
+
+    pthread_mutex_lock(&mutex);
+    magazine *mag = list;
+    while(mag) {
+        total += mag->hits;
+        mag = mag->next;
+    }
+    pthread_mutex_unlock(&mutex);
+    return total;
+}
+
+unsigned long MagazineCache::misses(void) const
+{
+    unsigned long total = 0;
+
+    pthread_mutex_lock(&mutex);
+    magazine *mag = list;
+    while(mag) {
+        total += mag->misses;
+        mag = mag->next;
+    }
+    pthread_mutex_unlock(&mutex);
+    return total;
+}
+
+unsigned MagazineCache::ratio(void) const
+{
+    unsigned long hit = hits();
+    unsigned long total = hit + misses();
+
+    if(!total)
+        return 0;
+
+    return (unsigned)((hit * 100) / total);
+}
+
 mempager::mempager(size_t ps) :
 memalloc(ps)
 {
@@ -269,6 +876,7 @@ void mempager::purge(void)
 {
     pthread_mutex_lock(&mutex);
     memalloc::purge();
+    magazines.invalidate();
     pthread_mutex_unlock(&mutex);
 }
 
@@ -281,6 +889,48 @@ void *mempager::_alloc(size_t size)
     assert(size > 0);
 
     void *mem;
+    MagazineCache::magazine *mag = magazines.get();
+
+    if(mag) {
+        while(size % sizeof(void *))
+            ++size;
+
+        // reserved space from a purged heap is no longer ours...
+        if(mag->generation != magazines.generation) {
+            mag->generation = magazines.generation;
+            mag->mem = NULL;
+            mag->avail = 0;
+        }
+
+        if(size <= mag->avail) {
+            ++mag->hits;
+            mem = mag->mem;
+            mag->mem += size;
+            mag->avail -= size;
+            return mem;
+        }
+
+        ++mag->misses;
+        size_t batch = size * magazines.depth;
+        if(batch > memalloc::size() / 4)
+            batch = memalloc::size() / 4;
+
+        if(size <= batch) {
+            pthread_mutex_lock(&mutex);
+            mag->mem = (caddr_t)memalloc::_alloc(batch);
+            mag->generation = magazines.generation;
+            pthread_mutex_unlock(&mutex);
+            if(!mag->mem) {
+                mag->avail = 0;
+                return NULL;
+            }
+            mag->avail = batch - size;
+            mem = mag->mem;
+            mag->mem += size;
+            return mem;
+        }
+    }
+
     pthread_mutex_lock(&mutex);
     mem = memalloc::_alloc(size);
     pthread_mutex_unlock(&mutex);
@@ -292,6 +942,8 @@ void mempager::assign(mempager& source)
     pthread_mutex_lock(&source.mutex);
     pthread_mutex_lock(&mutex);
     memalloc::assign(source);
+    magazines.invalidate();
+    source.magazines.invalidate();
     pthread_mutex_unlock(&mutex);
     pthread_mutex_unlock(&source.mutex);
 }
@@ -898,7 +1550,7 @@ void autorelease::operator+=(LinkedObject *obj)
 }
 
 PagerObject::PagerObject() :
-LinkedObject(nullptr), CountedObject()
+LinkedObject(), CountedObject()
 {
 }
 
@@ -938,6 +1590,24 @@ void PagerPool::put(PagerObject *ptr)
 {
     assert(ptr != NULL);
 
+    MagazineCache::magazine *mag = magazines.get();
+
+    if(mag) {
+        if(mag->count < magazines.depth) {
+            mag->items[mag->count++] = ptr;
+            return;
+        }
+
+        // drain half the magazine to the shared list at once...
+        unsigned keep = magazines.depth / 2;
+        pthread_mutex_lock(&mutex);
+        ptr->enlist(&freelist);
+        while(mag->count > keep)
+            (static_cast<PagerObject *>(mag->items[--mag->count]))->enlist(&freelist);
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+
     pthread_mutex_lock(&mutex);
     ptr->enlist(&freelist);
     pthread_mutex_unlock(&mutex);
@@ -947,13 +1617,34 @@ PagerObject *PagerPool::get(size_t size)
 {
     assert(size > 0);
 
-    PagerObject *ptr;
-    pthread_mutex_lock(&mutex);
-    ptr = static_cast<PagerObject *>(freelist);
-    if(ptr)
-        freelist = ptr->Next;
+    PagerObject *ptr = NULL;
+    MagazineCache::magazine *mag = magazines.get();
 
-    pthread_mutex_unlock(&mutex);
+    if(mag && mag->count) {
+        ++mag->hits;
+        ptr = static_cast<PagerObject *>(mag->items[--mag->count]);
+    }
+    else if(mag) {
+        // refill half the magazine from the shared list at once...
+        unsigned fill = (magazines.depth + 1) / 2;
+        ++mag->misses;
+        pthread_mutex_lock(&mutex);
+        ptr = static_cast<PagerObject *>(freelist);
+        if(ptr)
+            freelist = ptr->Next;
+        while(freelist && mag->count < fill) {
+            mag->items[mag->count++] = static_cast<PagerObject *>(freelist);
+            freelist = freelist->getNext();
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+    else {
+        pthread_mutex_lock(&mutex);
+        ptr = static_cast<PagerObject *>(freelist);
+        if(ptr)
+            freelist = ptr->Next;
+        pthread_mutex_unlock(&mutex);
+    }
 
     if(!ptr)
         ptr = new((_alloc(size))) PagerObject;
@@ -0,0 +1,495 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ucommon-config.h>
+#include <ucommon/export.h>
+#include <ucommon/reactor.h>
+#ifdef  HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#define USE_EPOLL
+#elif defined(HAVE_POLL_H)
+#include <poll.h>
+#elif defined(HAVE_SYS_POLL_H)
+#include <sys/poll.h>
+#endif
+
+#if defined(HAVE_SYS_EVENTFD_H) && defined(USE_EPOLL)
+#include <sys/eventfd.h>
+#define USE_EVENTFD
+#endif
+
+#ifdef  _MSWINDOWS_
+#define poll(p, n, t)   WSAPoll(p, n, t)
+#endif
+
+#if defined(USE_EPOLL) && !defined(EPOLLRDHUP)
+#define EPOLLRDHUP  0
+#endif
+
+namespace ucommon {
+
+static int waitfor(timeout_t timeout)
+{
+    if(timeout == Timer::inf)
+        return -1;
+
+    if(timeout > (timeout_t)INT_MAX)
+        return INT_MAX;
+
+    return (int)timeout;
+}
+
+#ifdef  USE_EPOLL
+
+typedef struct epoll_event  event_t;
+
+static unsigned native(unsigned flags)
+{
+    unsigned mask = 0;
+
+    // a peer that stops sending only matters to readers...
+    if(flags & Reactor::READABLE)
+        mask |= EPOLLIN | EPOLLRDHUP;
+    if(flags & Reactor::WRITABLE)
+        mask |= EPOLLOUT;
+    if(flags & Reactor::EDGE)
+        mask |= EPOLLET;
+    if(flags & Reactor::ONESHOT)
+        mask |= EPOLLONESHOT;
+    return mask;
+}
+
+#else
+
+typedef struct pollfd       event_t;
+
+static short native(unsigned flags)
+{
+    short mask = 0;
+
+    if(flags & Reactor::READABLE)
+        mask |= POLLIN;
+    if(flags & Reactor::WRITABLE)
+        mask |= POLLOUT;
+    return mask;
+}
+
+#endif
+
+Reactor::handler::handler(socket_t socket) :
+DLinkedObject()
+{
+    so = socket;
+    owner = NULL;
+    flags = 0;
+}
+
+Reactor::handler::~handler()
+{
+    if(owner)
+        owner->detach(this);
+}
+
+void Reactor::handler::readable(void)
+{
+}
+
+void Reactor::handler::writable(void)
+{
+}
+
+void Reactor::handler::hangup(void)
+{
+    if(owner)
+        owner->detach(this);
+}
+
+Reactor::Reactor(TimerQueue *tq, unsigned maximum)
+{
+    if(maximum < 1)
+        maximum = 1;
+
+    timers = tq;
+    active = NULL;
+    limit = maximum;
+    pending = current = 0;
+    running = false;
+    efd = -1;
+    wakeup[0] = wakeup[1] = INVALID_SOCKET;
+
+#ifdef  USE_EPOLL
+    events = ::malloc(sizeof(event_t) * limit);
+#ifdef  EPOLL_CLOEXEC
+    efd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    efd = epoll_create(limit);
+#endif
+    if(efd < 0)
+        return;
+
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = this;
+
+#ifdef  USE_EVENTFD
+    wakeup[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wakeup[0] != INVALID_SOCKET)
+        epoll_ctl(efd, EPOLL_CTL_ADD, wakeup[0], &ev);
+    return;
+#else
+    if(!::pipe(wakeup)) {
+        fcntl(wakeup[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeup[1], F_SETFL, O_NONBLOCK);
+        epoll_ctl(efd, EPOLL_CTL_ADD, wakeup[0], &ev);
+    }
+    return;
+#endif
+#else
+    // poll fd array followed by matching handler pointers...
+    events = ::malloc((sizeof(event_t) + sizeof(handler *)) * (limit + 1));
+    efd = 0;
+#ifndef _MSWINDOWS_
+    if(!::pipe(wakeup)) {
+        fcntl(wakeup[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeup[1], F_SETFL, O_NONBLOCK);
+    }
+#endif
+#endif
+}
+
+Reactor::~Reactor()
+{
+    linked_pointer<handler> hp = handlers.begin();
+    while(is(hp)) {
+        handler *h = *hp;
+        hp.next();
+        h->owner = NULL;
+        h->delist();
+    }
+    handlers.reset();
+
+#ifdef  USE_EPOLL
+    if(efd > -1)
+        ::close(efd);
+#endif
+
+#ifndef _MSWINDOWS_
+    if(wakeup[0] != INVALID_SOCKET)
+        ::close(wakeup[0]);
+    if(wakeup[1] != INVALID_SOCKET)
+        ::close(wakeup[1]);
+#endif
+
+    if(events)
+        ::free(events);
+
+    events = NULL;
+    efd = -1;
+}
+
+Reactor::operator bool() const
+{
+    return efd > -1 && events != NULL;
+}
+
+bool Reactor::operator!() const
+{
+    return efd < 0 || events == NULL;
+}
+
+bool Reactor::is_native(void)
+{
+#ifdef  USE_EPOLL
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Reactor::set(TimerQueue *tq)
+{
+    timers = tq;
+    notify();
+}
+
+bool Reactor::attach(handler *h, unsigned flags)
+{
+    assert(h != NULL);
+
+    if(h->owner == this)
+        return modify(h, flags);
+
+    if(h->owner)
+        h->owner->detach(h);
+
+    if(efd < 0 || h->so == INVALID_SOCKET)
+        return false;
+
+#ifdef  USE_EPOLL
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = native(flags);
+    ev.data.ptr = h;
+    if(epoll_ctl(efd, EPOLL_CTL_ADD, h->so, &ev))
+        return false;
+#endif
+
+    h->owner = this;
+    h->flags = flags;
+    h->enlist(&handlers);
+    return true;
+}
+
+bool Reactor::modify(handler *h, unsigned flags)
+{
+    assert(h != NULL);
+
+    if(h->owner != this)
+        return false;
+
+#ifdef  USE_EPOLL
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = native(flags);
+    ev.data.ptr = h;
+    if(epoll_ctl(efd, EPOLL_CTL_MOD, h->so, &ev))
+        return false;
+#endif
+
+    h->flags = flags;
+    return true;
+}
+
+void Reactor::detach(handler *h)
+{
+    assert(h != NULL);
+
+    if(h->owner != this)
+        return;
+
+#ifdef  USE_EPOLL
+    event_t ev;
+    memset(&ev, 0, sizeof(ev));
+    epoll_ctl(efd, EPOLL_CTL_DEL, h->so, &ev);
+
+    // cancel events still waiting for dispatch in the current batch...
+    event_t *list = (event_t *)events;
+    for(unsigned pos = current; pos < pending; ++pos) {
+        if(list[pos].data.ptr == h)
+            list[pos].data.ptr = NULL;
+    }
+#else
+    handler **list = (handler **)((event_t *)events + limit + 1);
+    for(unsigned pos = current; pos < pending; ++pos) {
+        if(list[pos] == h)
+            list[pos] = NULL;
+    }
+#endif
+
+    if(active == h)
+        active = NULL;
+
+    h->owner = NULL;
+    h->flags = 0;
+    h->delist();
+}
+
+void Reactor::notified(void)
+{
+}
+
+void Reactor::notify(void)
+{
+#ifdef  USE_EVENTFD
+    uint64_t one = 1;
+    if(wakeup[0] != INVALID_SOCKET && ::write(wakeup[0], &one, sizeof(one)) < 0)
+        return;
+#elif !defined(_MSWINDOWS_)
+    char one = 1;
+    if(wakeup[1] != INVALID_SOCKET && ::write(wakeup[1], &one, 1) < 0)
+        return;
+#endif
+}
+
+void Reactor::stop(void)
+{
+    running = false;
+    notify();
+}
+
+void Reactor::run(void)
+{
+    running = true;
+    while(running) {
+        if(poll() < 0 && errno != EINTR)
+            break;
+    }
+    running = false;
+}
+
+void Reactor::dispatch(handler *h, unsigned revents)
+{
+#ifdef  USE_EPOLL
+    const unsigned hup = EPOLLHUP | EPOLLERR;
+    const unsigned in = EPOLLIN | EPOLLPRI | EPOLLRDHUP;
+    const unsigned out = EPOLLOUT;
+#else
+    const unsigned hup = POLLHUP | POLLERR | POLLNVAL;
+    const unsigned in = POLLIN | POLLPRI;
+    const unsigned out = POLLOUT;
+#endif
+
+    // callbacks follow the interest the event was armed for...
+    unsigned interest = h->flags;
+    if(interest & ONESHOT)
+        h->flags &= ~(READABLE | WRITABLE);
+
+    active = h;
+    if(revents & hup) {
+        // let readers collect any data still pending before hangup...
+        if((revents & in) && (interest & READABLE))
+            h->readable();
+        if(active == h)
+            h->hangup();
+        active = NULL;
+        return;
+    }
+
+    if((revents & in) && (interest & READABLE))
+        h->readable();
+
+    if(active == h && (revents & out) && (interest & WRITABLE))
+        h->writable();
+
+    active = NULL;
+}
+
+int Reactor::poll(timeout_t timeout)
+{
+    int count = 0;
+
+    if(efd < 0 || !events)
+        return -1;
+
+    if(timers) {
+        timeout_t next = timers->expire();
+        if(next < timeout)
+            timeout = next;
+    }
+
+#ifdef  USE_EPOLL
+    event_t *list = (event_t *)events;
+    int result = epoll_wait(efd, list, limit, waitfor(timeout));
+    if(result < 0) {
+        if(errno == EINTR)
+            return 0;
+        return -1;
+    }
+
+    pending = (unsigned)result;
+    for(current = 0; current < pending; ++current) {
+        void *tag = list[current].data.ptr;
+        if(tag == this) {
+            char buf[64];
+            while(::read(wakeup[0], buf, sizeof(buf)) > 0)
+                ;
+            notified();
+            continue;
+        }
+        if(!tag)
+            continue;
+        dispatch((handler *)tag, list[current].events);
+        ++count;
+    }
+#else
+    unsigned total = handlers.count();
+    if(total > limit) {
+        caddr_t resize = (caddr_t)::realloc(events, (sizeof(event_t) + sizeof(handler *)) * (total + 1));
+        if(!resize)
+            return -1;
+        events = resize;
+        limit = total;
+    }
+
+    event_t *list = (event_t *)events;
+    handler **owners = (handler **)(list + limit + 1);
+    unsigned pos = 0;
+    linked_pointer<handler> hp = handlers.begin();
+    while(is(hp)) {
+        if(hp->flags & (READABLE | WRITABLE)) {
+            list[pos].fd = hp->so;
+            list[pos].events = native(hp->flags);
+            list[pos].revents = 0;
+            owners[pos++] = *hp;
+        }
+        hp.next();
+    }
+
+    if(wakeup[0] != INVALID_SOCKET) {
+        list[pos].fd = wakeup[0];
+        list[pos].events = POLLIN;
+        list[pos].revents = 0;
+        owners[pos++] = NULL;
+    }
+
+    int result = ::poll(list, pos, waitfor(timeout));
+    if(result < 0) {
+        if(errno == EINTR)
+            return 0;
+        return -1;
+    }
+
+    pending = pos;
+    for(current = 0; current < pending && result > 0; ++current) {
+        if(!list[current].revents)
+            continue;
+
+        --result;
+        handler *h = owners[current];
+        if(!h) {
+            if(list[current].fd == wakeup[0]) {
+                char buf[64];
+                while(::read(wakeup[0], buf, sizeof(buf)) > 0)
+                    ;
+                notified();
+            }
+            continue;
+        }
+        dispatch(h, list[current].revents);
+        ++count;
+    }
+#endif
+
+    pending = current = 0;
+
+    // if we woke on the timer deadline, process timers now...
+    if(timers && !count)
+        timers->expire();
+
+    return count;
+}
+
+} // namespace ucommon
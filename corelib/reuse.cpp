@@ -33,10 +33,11 @@ ReusableAllocator()
     assert(c > 0 && size > 0 && memory != NULL);
 
     objsize = size;
-    count = 0;
     limit = c;
     used = 0;
     mem = (caddr_t)memory;
+    base = mem;
+    stride = objsize;
 }
 
 ArrayReuse::ArrayReuse(size_t size, unsigned c) :
@@ -45,12 +46,13 @@ ReusableAllocator()
     assert(c > 0 && size > 0);
 
     objsize = size;
-    count = 0;
     limit = c;
     used = 0;
     mem = (caddr_t)malloc(size * c);
     if(!mem)
         __THROW_ALLOC();
+    base = mem;
+    stride = objsize;
 }
 
 ArrayReuse::~ArrayReuse()
@@ -63,50 +65,34 @@ ArrayReuse::~ArrayReuse()
 
 bool ArrayReuse::avail(void) const
 {
-    bool rtn = false;
-
-    __AUTOLOCK(this);
-
-    if(count < limit)
-        rtn = true;
-    return rtn;
+    return is_free() || Atomic::load(&used) < limit;
 }
 
 ReusableObject *ArrayReuse::get(timeout_t timeout)
 {
-    bool rtn = true;
     struct timespec ts;
-    ReusableObject *obj = NULL;
+    ReusableObject *obj = request();
 
-    if(timeout && timeout != Timer::inf)
-        set(&ts, timeout);
+    if(obj || !timeout)
+        return obj;
 
-    __AUTOLOCK(this);
+    // only block on the conditional once the pool is exhausted...
+    if(timeout != Timer::inf)
+        set(&ts, timeout);
 
-    while(!freelist && used >= limit && rtn) {
-        ++waiting;
+    lock();
+    ++waiting;
+    Atomic::fence();
+    while(!(obj = request())) {
         if(timeout == Timer::inf)
             wait();
-        else if(timeout)
-            rtn = wait(&ts);
-        else
-            rtn = false;
-        --waiting;
-    }
-
-    if(!rtn) {
-        return NULL;
-    }
-
-    if(freelist) {
-        obj = freelist;
-        freelist = next(obj);
-    } else if(used < limit) {
-        obj = (ReusableObject *)&mem[used * objsize];
-        ++used;
+        else if(!wait(&ts)) {
+            obj = request();
+            break;
+        }
     }
-    if(obj)
-        ++count;
+    --waiting;
+    unlock();
     return obj;
 }
 
@@ -117,21 +103,17 @@ ReusableObject *ArrayReuse::get(void)
 
 ReusableObject *ArrayReuse::request(void)
 {
-    ReusableObject *obj = NULL;
+    ReusableObject *obj = pop();
 
-    __AUTOLOCK(this);
+    if(obj)
+        return obj;
 
-    if(freelist) {
-        obj = freelist;
-        freelist = next(obj);
-    }
-    else if(used < limit) {
-        obj = (ReusableObject *)(mem + (used * objsize));
-        ++used;
+    unsigned index = Atomic::load(&used);
+    while(index < limit) {
+        if(Atomic::compare_exchange(&used, index, index + 1))
+            return (ReusableObject *)(mem + (index * objsize));
     }
-    if(obj)
-        ++count;
-    return obj;
+    return NULL;
 }
 
 PagerReuse::PagerReuse(mempager *p, size_t objsize, unsigned c) :
@@ -141,44 +123,115 @@ MemoryRedirect(p), ReusableAllocator()
 
     limit = c;
     count = 0;
+    vacant = 0;
     osize = objsize;
+
+    // a bounded pool indexes its objects for the lock-free free list,
+    // and each object is preceded by a header holding its slot index...
+    if(limit) {
+        table = (ReusableObject **)malloc(sizeof(ReusableObject *) * limit);
+        if(!table)
+            __THROW_ALLOC();
+    }
 }
 
 PagerReuse::~PagerReuse()
 {
+    if(table) {
+        free(table);
+        table = NULL;
+    }
 }
 
-bool PagerReuse::avail(void) const
+// slots whose objects could not be allocated are kept on a tagged stack
+// of their own, linked through their unused table entries, so they are
+// filled by a later request rather than lost to the pool...
+
+static void vacate(volatile uint64_t *stack, ReusableObject **table, unsigned index)
 {
-    bool rtn = false;
+    uint64_t top = Atomic::load(stack);
+    uint64_t update;
 
-    __AUTOLOCK(this);
+    do {
+        Atomic::store((ReusableObject * volatile *)&table[index], (ReusableObject *)(uintptr_t)(top & 0xffffffff));
+        update = (((top >> 32) + 1) << 32) | (uint64_t)(index + 1);
+    } while(!Atomic::compare_exchange(stack, top, update));
+}
+
+static bool reserve(volatile uint64_t *stack, ReusableObject **table, unsigned& index)
+{
+    uint64_t top = Atomic::load(stack);
+    uint64_t update;
+
+    do {
+        index = (unsigned)(top & 0xffffffff);
+        if(!index)
+            return false;
+        uintptr_t link = (uintptr_t)Atomic::load((ReusableObject * volatile *)&table[index - 1]);
+        update = (((top >> 32) + 1) << 32) | (uint64_t)(link & 0xffffffff);
+    } while(!Atomic::compare_exchange(stack, top, update));
+
+    --index;
+    return true;
+}
 
+bool PagerReuse::avail(void) const
+{
     if(!limit)
         return true;
 
-    if(count < limit)
-        rtn = true;
-    return rtn;
+    return is_free() || (Atomic::load(&vacant) & 0xffffffff) || Atomic::load(&count) < limit;
 }
 
 ReusableObject *PagerReuse::request(void)
 {
     ReusableObject *obj = NULL;
 
-    __AUTOLOCK(this);
+    if(!limit) {
+        __AUTOLOCK(this);
 
-    if(!limit || count < limit) {
         if(freelist) {
-            ++count;
             obj = freelist;
             freelist = next(obj);
+            return obj;
         }
-        else {
-            ++count;
-            return (ReusableObject *)_alloc(osize);
+        return (ReusableObject *)_alloc(osize);
+    }
+
+    obj = pop();
+    if(obj)
+        return obj;
+
+    unsigned index;
+    if(!reserve(&vacant, table, index)) {
+        index = Atomic::load(&count);
+        for(;;) {
+            if(index >= limit)
+                return NULL;
+            if(Atomic::compare_exchange(&count, index, index + 1))
+                break;
         }
     }
+
+    caddr_t mp;
+#ifdef  _UCOMMON_EXTENDED_
+    try {
+        mp = (caddr_t)_alloc(osize + sizeof(void *));
+    }
+    catch(...) {
+        vacate(&vacant, table, index);
+        throw;
+    }
+#else
+    mp = (caddr_t)_alloc(osize + sizeof(void *));
+#endif
+    if(!mp) {
+        vacate(&vacant, table, index);
+        return NULL;
+    }
+    *(unsigned *)mp = index;
+    obj = (ReusableObject *)(mp + sizeof(void *));
+    table[index] = obj;
     return obj;
 }
 
@@ -189,38 +242,28 @@ ReusableObject *PagerReuse::get(void)
 
 ReusableObject *PagerReuse::get(timeout_t timeout)
 {
-    bool rtn = true;
     struct timespec ts;
-    ReusableObject *obj;
+    ReusableObject *obj = request();
 
-    if(timeout && timeout != Timer::inf)
-        set(&ts, timeout);
+    if(obj || !timeout)
+        return obj;
 
-    __AUTOLOCK(this);
+    if(timeout != Timer::inf)
+        set(&ts, timeout);
 
-    while(rtn && limit && count >= limit) {
-        ++waiting;
+    lock();
+    ++waiting;
+    Atomic::fence();
+    while(!(obj = request())) {
         if(timeout == Timer::inf)
             wait();
-        else if(timeout)
-            rtn = wait(&ts);
-        else
-            rtn = false;
-        --waiting;
-    }
-    if(!rtn) {
-        return NULL;
-    }
-    if(freelist) {
-        obj = freelist;
-        freelist = next(obj);
-    }
-    else {
-        ++count;
-        return (ReusableObject *)_alloc(osize);
+        else if(!wait(&ts)) {
+            obj = request();
+            break;
+        }
     }
-    if(obj)
-        ++count;
+    --waiting;
+    unlock();
     return obj;
 }
 
@@ -25,28 +25,165 @@
 
 namespace ucommon {
 
+// readers publish the epoch they entered in a per-thread record, and
+// snapshots replaced by writers are retired until every record that may
+// still see them has left its read section...
+
+typedef struct epoch_record {
+    struct epoch_record *next;
+    volatile atomic_t active, inuse;
+    unsigned nesting;
+} epoch_record;
+
+typedef struct epoch_retired {
+    struct epoch_retired *next;
+    TypeRef::Counted *object;
+    atomic_t epoch;
+} epoch_retired;
+
+static volatile atomic_t epoch_global = 1;
+static epoch_record *volatile epoch_records = NULL;
+static epoch_retired *epoch_pending = NULL;
+static Mutex epoch_lock;
+
+class __LOCAL epoch_local : public Thread::Local
+{
+private:
+    void *allocate(void) __FINAL {
+        epoch_record *rec = epoch_records;
+
+        // reuse records left behind by exited threads first...
+        while(rec) {
+            atomic_t expected = 0;
+            if(Atomic::compare_exchange(&rec->inuse, expected, (atomic_t)1))
+                return rec;
+            rec = rec->next;
+        }
+
+        rec = (epoch_record *)::calloc(1, sizeof(epoch_record));
+        if(!rec)
+            __THROW_ALLOC();
+        rec->inuse = 1;
+        rec->next = Atomic::load(&epoch_records);
+        while(!Atomic::compare_exchange(&epoch_records, rec->next, rec))
+            ;
+        return rec;
+    }
+
+    void release(void *mem) __FINAL {
+        epoch_record *rec = (epoch_record *)mem;
+
+        if(!rec)
+            return;
+
+        rec->nesting = 0;
+        Atomic::store(&rec->active, (atomic_t)0);
+        Atomic::store(&rec->inuse, (atomic_t)0);
+    }
+};
+
+static epoch_record *epoch_current(void)
+{
+    static epoch_local locals;
+    return (epoch_record *)*locals;
+}
+
 SharedRef::SharedRef() : TypeRef()
 {
 }
 
+TypeRef::Counted *SharedRef::enter(void)
+{
+    epoch_record *rec = epoch_current();
+
+    if(!rec->nesting++) {
+        Atomic::store(&rec->active, Atomic::load(&epoch_global));
+        Atomic::fence();
+    }
+    return Atomic::load(&ref);
+}
+
+void SharedRef::leave(void)
+{
+    epoch_record *rec = epoch_current();
+
+    assert(rec->nesting > 0);
+
+    if(!--rec->nesting)
+        Atomic::store(&rec->active, (atomic_t)0);
+}
+
+void SharedRef::reclaim(void)
+{
+    epoch_retired *list = NULL;
+
+    epoch_lock.acquire();
+    Atomic::fence();
+
+    // find the oldest epoch any reader may still be using...
+    atomic_t current = Atomic::load(&epoch_global);
+    atomic_t oldest = current;
+    epoch_record *rec = Atomic::load(&epoch_records);
+    while(rec) {
+        atomic_t active = Atomic::load(&rec->active);
+        if(active && active < oldest)
+            oldest = active;
+        rec = rec->next;
+    }
+
+    epoch_retired **prior = &epoch_pending;
+    while(*prior) {
+        epoch_retired *node = *prior;
+        if(node->epoch < oldest) {
+            *prior = node->next;
+            node->next = list;
+            list = node;
+        }
+        else
+            prior = &node->next;
+    }
+    epoch_lock.release();
+
+    // release outside the lock, since dealloc may be arbitrary code...
+    while(list) {
+        epoch_retired *next = list->next;
+        list->object->release();
+        ::free(list);
+        list = next;
+    }
+}
+
 TypeRef SharedRef::get()
 {
-	lock.acquire();
-	TypeRef ptr(ref);
-	lock.release();
+	TypeRef ptr(enter());
+	leave();
 	return ptr;
 }
 
 void SharedRef::get(TypeRef& ptr)
 {
+	Counted *obj = ptr.ref;
+	if(obj)
+		obj->retain();
+
 	lock.acquire();
-	Counted *old = ref;
-	ref = ptr.ref;
-	if(ref)
-		ref->retain();
+	Counted *old = Atomic::exchange(&ref, obj);
 	lock.release();
-	if(old)
-		old->release();
+
+	if(!old)
+		return;
+
+	epoch_retired *node = (epoch_retired *)::malloc(sizeof(epoch_retired));
+	if(!node)
+		__THROW_ALLOC();
+	node->object = old;
+
+	epoch_lock.acquire();
+	node->epoch = Atomic::fetch_add(&epoch_global, (atomic_t)1);
+	node->next = epoch_pending;
+	epoch_pending = node;
+	epoch_lock.release();
+	reclaim();
 }
 
 void SharedRef::put(TypeRef& ptr)
@@ -56,20 +193,111 @@ void SharedRef::put(TypeRef& ptr)
 	lock.release();
 }
 
+// each thread remembers which stripe it holds for objects returned by a
+// striped mapped pointer, since release is only given the object.  The
+// same object may be gotten more than once, so every get keeps its own
+// entry until released...
+
+#define MAPPED_ENTRIES  8
+
+typedef struct {
+    const MappedPointer *map;
+    const void *object;
+    sharedlock_t *lock;
+} mapped_entry;
+
+typedef struct {
+    unsigned limit;
+    mapped_entry *list;
+    mapped_entry entries[MAPPED_ENTRIES];
+} mapped_table;
+
+class __LOCAL mapped_local : public Thread::Local
+{
+private:
+    void *allocate(void) __FINAL {
+        mapped_table *table = (mapped_table *)::calloc(1, sizeof(mapped_table));
+        if(!table)
+            __THROW_ALLOC();
+        table->limit = MAPPED_ENTRIES;
+        table->list = table->entries;
+        return table;
+    }
+
+    void release(void *mem) __FINAL {
+        mapped_table *table = (mapped_table *)mem;
+
+        if(!table)
+            return;
+
+        if(table->list != table->entries)
+            ::free(table->list);
+        ::free(table);
+    }
+};
+
+static mapped_entry *mapped_held(const MappedPointer *map, const void *object, bool create = false)
+{
+    static mapped_local locals;
+    mapped_table *table = (mapped_table *)*locals;
+
+    for(unsigned pos = 0; pos < table->limit; ++pos) {
+        mapped_entry *entry = &table->list[pos];
+        if(create && !entry->lock)
+            return entry;
+        if(!create && entry->lock && entry->map == map && entry->object == object)
+            return entry;
+    }
+
+    if(!create)
+        return NULL;
+
+    mapped_entry *list = (mapped_entry *)::calloc(table->limit * 2, sizeof(mapped_entry));
+    if(!list)
+        __THROW_ALLOC();
+    memcpy(list, table->list, sizeof(mapped_entry) * table->limit);
+    if(table->list != table->entries)
+        ::free(table->list);
+    table->list = list;
+    table->limit *= 2;
+    return &list[table->limit / 2];
+}
+
 MappedPointer::Index::Index(LinkedObject **origin) :
 LinkedObject(origin)
 {
 	key = value = NULL;
 }
 
-MappedPointer::MappedPointer(size_t indexes, condlock_t *locking, size_t paging) : pager(paging)
+MappedPointer::MappedPointer(size_t indexes, condlock_t *locking, size_t paging, bool biased, unsigned striped) : pager(paging)
 {
 	caddr_t p;
-	if(!locking) {
+	owned = false;
+	stripes = NULL;
+	ways = 0;
+	if(!locking && striped) {
+		stripes = (sharedlock_t *)pager.alloc(sizeof(sharedlock_t) * striped);
+		while(ways < striped) {
+			if(biased)
+				stripes[ways++] = new(pager.alloc(sizeof(BiasedLock))) BiasedLock;
+			else
+				stripes[ways++] = new(pager.alloc(sizeof(condlock_t))) condlock_t;
+		}
+	}
+	if(ways)
+		lock = stripes[0];
+	else if(!locking && biased) {
+		p = (caddr_t)pager.alloc(sizeof(BiasedLock));
+		lock = new(p) BiasedLock;
+		owned = true;
+	}
+	else if(!locking) {
 		p = (caddr_t)pager.alloc(sizeof(condlock_t));
-		locking = new(p) condlock_t;
+		lock = new(p) condlock_t;
+		owned = true;
 	}
-	lock = locking;
+	else
+		lock = locking;
 
 	list = (LinkedObject **)pager.alloc(sizeof(LinkedObject *) * indexes);
 	free = NULL;
@@ -80,54 +308,95 @@ MappedPointer::MappedPointer(size_t indexes, condlock_t *locking, size_t paging)
 
 MappedPointer::~MappedPointer()
 {
+	if(owned && lock.biased())
+		lock.biased()->~BiasedLock();
+	else if(owned)
+		lock.get()->~ConditionalLock();
+	while(ways) {
+		sharedlock_t& stripe = stripes[--ways];
+		if(stripe.biased())
+			stripe.biased()->~BiasedLock();
+		else
+			stripe.get()->~ConditionalLock();
+	}
 	pager.purge();
 }	
 
 LinkedObject *MappedPointer::access(size_t path)
 {
-	lock->access();
+	stripe(path)->access();
 	return list[path % paths];
 }
 
 LinkedObject *MappedPointer::modify(size_t path)
 {
-	lock->modify();
+	stripe(path)->modify();
 	return list[path % paths];
 }
 
+void *MappedPointer::held(void *object, size_t path)
+{
+	if(ways) {
+		mapped_entry *entry = mapped_held(this, object, true);
+		entry->map = this;
+		entry->object = object;
+		entry->lock = stripe(path);
+	}
+	return object;
+}
+
 void MappedPointer::release(void *object)
 {
-	if(object != nullptr)
-		lock->release();
+	if(object == nullptr)
+		return;
+
+	if(!ways) {
+		lock.release();
+		return;
+	}
+
+	mapped_entry *entry = mapped_held(this, object);
+	if(entry) {
+		entry->lock->release();
+		entry->lock = NULL;
+	}
 }
 
-void MappedPointer::replace(Index *ind, void *object)
+void MappedPointer::replace(Index *ind, void *object, size_t path)
 {
 	ind->value = object;
-	lock->commit();
+	commit(path);
 }
 
 void MappedPointer::remove(Index *ind, size_t path)
 {
 	LinkedObject **root = &list[path % paths];
 	ind->delist(root);
-	ind->enlist(&free);
 	ind->key = ind->value = NULL;
-	lock->commit();
+	if(ways)
+		guard.acquire();
+	ind->enlist(&free);
+	if(ways)
+		guard.release();
+	commit(path);
 }
 
 void MappedPointer::insert(const void *key, void *value, size_t path)
 {
+	if(ways)
+		guard.acquire();
 	caddr_t p = (caddr_t)(free);
 	if(free)
 		free = free->getNext();
 	else 
 		p = (caddr_t)pager.alloc(sizeof(Index));
+	if(ways)
+		guard.release();
 
 	Index *ind = new(p) Index(&list[path % paths]);
 	ind->key = key;
 	ind->value = value;
-	lock->commit();
+	commit(path);
 }	
 
 size_t MappedPointer::keypath(const uint8_t *addr, size_t size)
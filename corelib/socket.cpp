@@ -23,6 +23,7 @@
 #include <ucommon/typeref.h>
 #include <ucommon/thread.h>
 #include <ucommon/fsys.h>
+#include <ucommon/fiber.h>
 #ifndef _MSWINDOWS_
 #include <net/if.h>
 #include <sys/un.h>
@@ -54,6 +55,18 @@
 #define IP_MTU 14
 #endif
 
+#if defined(__linux__) && !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103
+#endif
+
+#if defined(__linux__) && !defined(UDP_GRO)
+#define UDP_GRO 104
+#endif
+
+// the kernel limits on datagrams and bytes passed in one segmented send...
+#define MAX_SEGMENTS    64
+#define MAX_SEGMENTED   65507
+
 #ifndef MSG_DONTWAIT
 #define MSG_DONTWAIT 0
 #endif
@@ -500,6 +513,227 @@ static unsigned bitcount(bit_t *bits, unsigned len)
     return count;
 }
 
+#if !defined(_MSWINDOWS_) && defined(O_NONBLOCK)
+
+// when called from a fiber, socket i/o is attempted without blocking and
+// the fiber waits in its scheduler until the socket is ready, so only
+// the fiber rather than the whole thread is suspended...
+
+static inline bool fiber_blocked(void)
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+static ssize_t fiber_recv(socket_t so, void *data, size_t len, int flags, struct sockaddr *addr, socklen_t *slen)
+{
+    bool all = (flags & (MSG_WAITALL | MSG_PEEK)) == MSG_WAITALL;
+    size_t total = 0;
+
+    flags = (flags & ~MSG_WAITALL) | MSG_DONTWAIT;
+    for(;;) {
+        ssize_t result = ::recvfrom(so, (caddr_t)data + total, (socksize_t)(len - total), flags, addr, slen);
+        if(result < 0) {
+            if(errno == EINTR)
+                continue;
+            if(!fiber_blocked())
+                return total ? (ssize_t)total : -1;
+            Scheduler::wait(so, Reactor::READABLE);
+            continue;
+        }
+        total += (size_t)result;
+        if(!all || !result || total >= len)
+            return (ssize_t)total;
+    }
+}
+
+static ssize_t fiber_send(socket_t so, const void *data, size_t len, int flags, const struct sockaddr *dest, socklen_t slen)
+{
+    size_t total = 0;
+
+    flags |= MSG_DONTWAIT;
+    for(;;) {
+        ssize_t result = ::sendto(so, (const char *)data + total, (socksize_t)(len - total), flags, dest, slen);
+        if(result < 0) {
+            if(errno == EINTR)
+                continue;
+            if(!fiber_blocked())
+                return total ? (ssize_t)total : -1;
+            Scheduler::wait(so, Reactor::WRITABLE);
+            continue;
+        }
+        total += (size_t)result;
+        if(total >= len)
+            return (ssize_t)total;
+    }
+}
+
+// a listener's file status flags are shared with every thread accepting
+// on it, so they are never changed here.  a fiber waits for a pending
+// connection before it accepts.  a listener shared with other acceptors
+// should be made non-blocking, so that a connection taken by another
+// thread first only suspends the fiber again rather than its thread...
+
+static socket_t fiber_accept(socket_t so, struct sockaddr *addr, socklen_t *len)
+{
+    if(!Scheduler::self())
+        return ::accept(so, addr, len);
+
+    for(;;) {
+        if(!Scheduler::wait(so, Reactor::READABLE))
+            return ::accept(so, addr, len);
+        socket_t result = ::accept(so, addr, len);
+        if(result != INVALID_SOCKET)
+            return result;
+        if(errno != EINTR && !fiber_blocked())
+            return result;
+    }
+}
+
+static int fiber_connect(socket_t so, const struct sockaddr *addr, socklen_t len)
+{
+    if(!Scheduler::self())
+        return ::connect(so, addr, len);
+
+    int flags = fcntl(so, F_GETFL);
+    if(flags == -1 || (flags & O_NONBLOCK))
+        return ::connect(so, addr, len);
+
+    fcntl(so, F_SETFL, flags | O_NONBLOCK);
+    int result = ::connect(so, addr, len);
+    if(result && errno == EINPROGRESS) {
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        Scheduler::wait(so, Reactor::WRITABLE);
+        if(getsockopt(so, SOL_SOCKET, SO_ERROR, (caddr_t)&err, &elen) || err) {
+            if(err)
+                errno = err;
+        }
+        else
+            result = 0;
+    }
+
+    int err = errno;
+    fcntl(so, F_SETFL, flags);
+    errno = err;
+    return result;
+}
+
+#define USE_FIBERS
+
+#else
+
+#define fiber_connect(so, addr, len)    ::connect(so, addr, len)
+
+#endif
+
+#if defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG)
+#define USE_MMSG
+#endif
+
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE  0
+#endif
+
+// a batch is a run of slots that are contiguous in the packet ring, so
+// the kernel can be handed the message headers of the run directly...
+
+#ifdef  USE_MMSG
+static struct mmsghdr *batch_setup(void *vectors, PacketBuffer::packet *list, unsigned count, size_t size, const struct sockaddr *dest, socklen_t dlen)
+{
+    struct mmsghdr *msgs = (struct mmsghdr *)vectors;
+    struct iovec *iov = (struct iovec *)(msgs + count);
+
+    for(unsigned pos = 0; pos < count; ++pos) {
+        PacketBuffer::packet *item = &list[pos];
+        struct msghdr *msg = &msgs[pos].msg_hdr;
+
+        memset(msg, 0, sizeof(struct msghdr));
+        msgs[pos].msg_len = 0;
+        msg->msg_iov = &iov[pos];
+        msg->msg_iovlen = 1;
+        iov[pos].iov_base = item->data;
+        if(size) {
+            iov[pos].iov_len = size;
+            msg->msg_name = &item->address;
+            msg->msg_namelen = sizeof(struct sockaddr_storage);
+        }
+        else if(item->has_address()) {
+            iov[pos].iov_len = item->size;
+            msg->msg_name = &item->address;
+            msg->msg_namelen = Socket::len(item->addr());
+        }
+        else {
+            iov[pos].iov_len = item->size;
+            msg->msg_name = (void *)dest;
+            msg->msg_namelen = dlen;
+        }
+    }
+    return msgs;
+}
+#endif
+
+// unnamed peers report an address that is only a family, which is kept
+// as no address so a reply uses the default peer instead...
+
+static inline void batch_from(PacketBuffer::packet *item, socklen_t slen)
+{
+    if(slen <= (socklen_t)sizeof(item->address.ss_family))
+        item->set(NULL);
+}
+
+static ssize_t recvbatch(socket_t so, void *vectors, PacketBuffer::packet *list, unsigned count, size_t size, int flags)
+{
+#ifdef  HAVE_RECVMMSG
+    struct mmsghdr *msgs = batch_setup(vectors, list, count, size, NULL, 0);
+    int result = ::recvmmsg(so, msgs, count, flags | MSG_WAITFORONE, NULL);
+    for(int pos = 0; pos < result; ++pos) {
+        list[pos].size = msgs[pos].msg_len;
+        batch_from(&list[pos], msgs[pos].msg_hdr.msg_namelen);
+    }
+    return result;
+#else
+    unsigned received = 0;
+    while(received < count) {
+        PacketBuffer::packet *item = &list[received];
+        socklen_t slen = sizeof(struct sockaddr_storage);
+        ssize_t result = ::recvfrom(so, item->data, (socksize_t)size, received ? flags | MSG_DONTWAIT : flags, item->addr(), &slen);
+        if(result < 0)
+            return received ? (ssize_t)received : -1;
+        item->size = (size_t)result;
+        batch_from(item, slen);
+        ++received;
+        // without a non-blocking flag only one datagram is safe to read...
+        if(!MSG_DONTWAIT)
+            break;
+    }
+    return (ssize_t)received;
+#endif
+}
+
+static ssize_t sendbatch(socket_t so, void *vectors, PacketBuffer::packet *list, unsigned count, int flags, const struct sockaddr *dest, socklen_t dlen)
+{
+#ifdef  HAVE_SENDMMSG
+    struct mmsghdr *msgs = batch_setup(vectors, list, count, 0, dest, dlen);
+    return ::sendmmsg(so, msgs, count, flags);
+#else
+    unsigned sent = 0;
+    while(sent < count) {
+        PacketBuffer::packet *item = &list[sent];
+        const struct sockaddr *addr = dest;
+        socklen_t alen = dlen;
+        if(item->has_address()) {
+            addr = item->addr();
+            alen = Socket::len(addr);
+        }
+        ssize_t result = ::sendto(so, item->data, (socksize_t)item->size, flags, addr, alen);
+        if(result < 0)
+            return sent ? (ssize_t)sent : -1;
+        ++sent;
+    }
+    return (ssize_t)sent;
+#endif
+}
+
 #ifdef  _MSWINDOWS_
 
 static bool _started = false;
@@ -652,6 +886,215 @@ const cidr *cidr::container(const policy *policy, const struct sockaddr *s)
 }
 
 
+// trie nodes are kept in one flat block and linked by node number, with
+// node 0 the ipv4 root and node 1 the ipv6 root.  Since a root is never a
+// child, a child number of 0 means no child...
+
+typedef struct {
+    uint8_t key[16];
+    uint32_t child[2];
+    unsigned bits;
+    const cidr *entry;
+} cidr_node;
+
+static inline unsigned cidr_bit(const uint8_t *key, unsigned pos)
+{
+    return (key[pos / 8] >> (7 - (pos % 8))) & 1;
+}
+
+static unsigned cidr_common(const uint8_t *k1, const uint8_t *k2, unsigned bits)
+{
+    unsigned pos = 0;
+
+    while(pos + 8 <= bits && k1[pos / 8] == k2[pos / 8])
+        pos += 8;
+
+    while(pos < bits && cidr_bit(k1, pos) == cidr_bit(k2, pos))
+        ++pos;
+
+    return pos;
+}
+
+static bool cidr_prefix(const uint8_t *key, const uint8_t *addr, unsigned bits)
+{
+    if(memcmp(key, addr, bits / 8))
+        return false;
+
+    if(!(bits % 8))
+        return true;
+
+    uint8_t mask = (uint8_t)(0xff << (8 - (bits % 8)));
+    return !((key[bits / 8] ^ addr[bits / 8]) & mask);
+}
+
+static uint32_t cidr_add(cidr_node **nodes, unsigned *used, unsigned *limit, const uint8_t *key, unsigned bits, const cidr *entry)
+{
+    if(*used >= *limit) {
+        *limit *= 2;
+        cidr_node *list = (cidr_node *)::realloc(*nodes, sizeof(cidr_node) * *limit);
+        if(!list)
+            __THROW_ALLOC();
+        *nodes = list;
+    }
+
+    cidr_node *node = &(*nodes)[*used];
+    memset(node, 0, sizeof(cidr_node));
+    memcpy(node->key, key, (bits + 7) / 8);
+    if(bits % 8)
+        node->key[bits / 8] &= (uint8_t)(0xff << (8 - (bits % 8)));
+    node->bits = bits;
+    node->entry = entry;
+    return (*used)++;
+}
+
+cidr::table::table() :
+nodes()
+{
+    count = 0;
+}
+
+cidr::table::table(const table& copy) :
+nodes(copy.nodes)
+{
+    count = copy.count;
+}
+
+cidr::table::table(const policy *policy) :
+nodes()
+{
+    unsigned used = 2, limit = 64;
+    cidr_node *list = (cidr_node *)::calloc(limit, sizeof(cidr_node));
+    if(!list)
+        __THROW_ALLOC();
+
+    count = 0;
+    linked_pointer<const cidr> cp = policy;
+    while(cp) {
+        const uint8_t *key;
+        uint32_t pos;
+        unsigned bits = cp->getMask();
+
+        switch(cp->Family) {
+        case AF_INET:
+            key = (const uint8_t *)&cp->Network.ipv4;
+            pos = 0;
+            break;
+#ifdef  AF_INET6
+        case AF_INET6:
+            key = (const uint8_t *)&cp->Network.ipv6;
+            pos = 1;
+            break;
+#endif
+        default:
+            cp.next();
+            continue;
+        }
+
+        for(;;) {
+            cidr_node *node = &list[pos];
+            if(node->bits == bits) {
+                if(!node->entry) {
+                    node->entry = *cp;
+                    ++count;
+                }
+                break;
+            }
+
+            unsigned branch = cidr_bit(key, node->bits);
+            uint32_t child = node->child[branch];
+            if(!child) {
+                child = cidr_add(&list, &used, &limit, key, bits, *cp);
+                list[pos].child[branch] = child;
+                ++count;
+                break;
+            }
+
+            // the child either extends our prefix, or must be split...
+            unsigned cbits = list[child].bits;
+            unsigned common = cidr_common(list[child].key, key, cbits < bits ? cbits : bits);
+            if(common == cbits) {
+                pos = child;
+                continue;
+            }
+
+            uint32_t split;
+            if(common == bits) {
+                split = cidr_add(&list, &used, &limit, key, bits, *cp);
+                ++count;
+            }
+            else {
+                split = cidr_add(&list, &used, &limit, key, common, NULL);
+                uint32_t leaf = cidr_add(&list, &used, &limit, key, bits, *cp);
+                list[split].child[cidr_bit(key, common)] = leaf;
+                ++count;
+            }
+            list[split].child[cidr_bit(list[child].key, common)] = child;
+            list[pos].child[branch] = split;
+            break;
+        }
+        cp.next();
+    }
+
+    nodes = typeref<const uint8_t *>((uint8_t *)list, sizeof(cidr_node) * used);
+    ::free(list);
+}
+
+cidr::table& cidr::table::operator=(const table& copy)
+{
+    nodes = copy.nodes;
+    count = copy.count;
+    return *this;
+}
+
+const cidr *cidr::table::search(const struct sockaddr *s, bool shortest) const
+{
+    assert(s != NULL);
+
+    const cidr_node *list = (const cidr_node *)*nodes;
+    const struct sockaddr_internet *addr = (const struct sockaddr_internet *)s;
+    const uint8_t *key;
+    const cidr *member = NULL;
+    unsigned limit;
+    uint32_t pos;
+
+    if(!list)
+        return NULL;
+
+    switch(s->sa_family) {
+    case AF_INET:
+        key = (const uint8_t *)&addr->ipv4.sin_addr;
+        limit = 32;
+        pos = 0;
+        break;
+#ifdef  AF_INET6
+    case AF_INET6:
+        key = (const uint8_t *)&addr->ipv6.sin6_addr;
+        limit = 128;
+        pos = 1;
+        break;
+#endif
+    default:
+        return NULL;
+    }
+
+    for(;;) {
+        const cidr_node *node = &list[pos];
+        if(!cidr_prefix(node->key, key, node->bits))
+            break;
+        if(node->entry) {
+            member = node->entry;
+            if(shortest)
+                break;
+        }
+        if(node->bits >= limit)
+            break;
+        pos = node->child[cidr_bit(key, node->bits)];
+        if(!pos)
+            break;
+    }
+    return member;
+}
+
 bool cidr::is_member(const struct sockaddr *s) const
 {
     assert(s != NULL);
@@ -1610,7 +2053,7 @@ Socket::Socket(const struct addrinfo *addr)
         so = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
         socket_mapping(addr->ai_family, so);
         if(so != INVALID_SOCKET) {
-            if(!::connect(so, addr->ai_addr, (socklen_t)addr->ai_addrlen))
+            if(!fiber_connect(so, addr->ai_addr, (socklen_t)addr->ai_addrlen))
                 return;
         }
         addr = addr->ai_next;
@@ -1659,7 +2102,11 @@ socket_t Socket::create(const Socket::address &address)
     return so;
 }
 
-socket_t Socket::create(const char *iface, const char *port, int family, int type, int protocol)
+// sockets bound as shared may be bound to the same address as other
+// shared sockets of the same user, and the kernel spreads connections or
+// datagrams across them...
+
+static socket_t bindsocket(const char *iface, const char *port, int family, int type, int protocol, bool shared)
 {
     assert(iface != NULL && *iface != 0);
     assert(port != NULL && *port != 0);
@@ -1689,11 +2136,11 @@ socket_t Socket::create(const char *iface, const char *port, int family, int typ
         socklen_t len = unixaddr((struct sockaddr_un *)&uaddr, iface);
         if(!type)
             type = SOCK_STREAM;
-        so = create(AF_UNIX, type, 0);
+        so = Socket::create(AF_UNIX, type, 0);
         if(so == INVALID_SOCKET)
             return INVALID_SOCKET;
         if(::bind(so, (struct sockaddr *)&uaddr, len)) {
-            release(so);
+            Socket::release(so);
             return INVALID_SOCKET;
         }
         return so;
@@ -1707,15 +2154,19 @@ socket_t Socket::create(const char *iface, const char *port, int family, int typ
     if(res == NULL)
         return INVALID_SOCKET;
 
-    so = create(res->ai_family, res->ai_socktype, res->ai_protocol);
+    so = Socket::create(res->ai_family, res->ai_socktype, res->ai_protocol);
     if(so == INVALID_SOCKET) {
         freeaddrinfo(res);
         return INVALID_SOCKET;
     }
     setsockopt(so, SOL_SOCKET, SO_REUSEADDR, (caddr_t)&reuse, sizeof(reuse));
+#ifdef  SO_REUSEPORT
+    if(shared)
+        setsockopt(so, SOL_SOCKET, SO_REUSEPORT, (caddr_t)&reuse, sizeof(reuse));
+#endif
     if(res->ai_addr) {
         if(::bind(so, res->ai_addr, (socklen_t)res->ai_addrlen)) {
-            release(so);
+            Socket::release(so);
             so = INVALID_SOCKET;
         }
     }
@@ -1723,6 +2174,11 @@ socket_t Socket::create(const char *iface, const char *port, int family, int typ
     return so;
 }
 
+socket_t Socket::create(const char *iface, const char *port, int family, int type, int protocol)
+{
+    return bindsocket(iface, port, family, type, protocol, false);
+}
+
 Socket::~Socket()
 {
     release();
@@ -1893,6 +2349,10 @@ ssize_t Socket::recvfrom(socket_t so, void *data, size_t len, int flags, struct
     assert(len > 0);
 
     socklen_t slen = sizeof(struct sockaddr_storage);
+#ifdef  USE_FIBERS
+    if(!(flags & MSG_DONTWAIT) && Scheduler::self())
+        return fiber_recv(so, data, len, flags, (struct sockaddr *)addr, &slen);
+#endif
     return ::recvfrom(so, (caddr_t)data, (socksize_t)len, flags, (struct sockaddr *)addr, (socklen_t *)&slen);
 }
 
@@ -1905,8 +2365,7 @@ size_t Socket::readfrom(void *data, size_t len, struct sockaddr_storage *from)
     if(iowait && iowait != Timer::inf && !Socket::wait(so, iowait))
         return 0;
 
-    socklen_t slen = sizeof(struct sockaddr_storage);
-    ssize_t result = ::recvfrom(so, (caddr_t)data, (socksize_t)len, 0, (struct sockaddr *)from, (socklen_t *)&slen);
+    ssize_t result = Socket::recvfrom(so, data, len, 0, from);
 
     if(result < 0) {
         ioerr = Socket::error();
@@ -1920,11 +2379,7 @@ size_t Socket::writeto(const void *data, size_t dlen, const struct sockaddr *des
     assert(data != NULL);
     assert(len > 0);
 
-    socklen_t slen = 0;
-    if(dest)
-        slen = len(dest);
-
-    ssize_t result = ::sendto(so, (caddr_t)data, (socksize_t)dlen, MSG_NOSIGNAL, dest, (socklen_t)slen);
+    ssize_t result = Socket::sendto(so, data, dlen, 0, dest);
 
     if(result < 0) {
         ioerr = Socket::error();
@@ -1942,9 +2397,275 @@ ssize_t Socket::sendto(socket_t so, const void *data, size_t dlen, int flags, co
     if(dest)
         slen = len(dest);
 
+#ifdef  USE_FIBERS
+    if(!(flags & MSG_DONTWAIT) && Scheduler::self())
+        return fiber_send(so, data, dlen, MSG_NOSIGNAL | flags, dest, (socklen_t)slen);
+#endif
     return ::sendto(so, (caddr_t)data, (socksize_t)dlen, MSG_NOSIGNAL | flags, dest, (socklen_t)slen);
 }
 
+ssize_t Socket::recvfrom(socket_t so, PacketBuffer& packets, int flags)
+{
+    bool suspend = false;
+    unsigned total = 0;
+
+#ifdef  USE_FIBERS
+    suspend = !(flags & MSG_DONTWAIT) && Scheduler::self() != NULL;
+#endif
+
+    while(packets.used < packets.limit) {
+        unsigned tail = (packets.head + packets.used) % packets.limit;
+        unsigned count = packets.limit - packets.used;
+        if(tail + count > packets.limit)
+            count = packets.limit - tail;
+
+        // only the first datagram is waited for, the rest are what is
+        // already queued, including any past the wrap of the ring...
+        int mode = flags;
+        if(total || suspend)
+            mode |= MSG_DONTWAIT;
+
+        ssize_t result = recvbatch(so, packets.vectors, &packets.list[tail], count, packets.bufsize, mode);
+        if(result < 0) {
+            if(total)
+                break;
+            if(errno == EINTR)
+                continue;
+#ifdef  USE_FIBERS
+            if(suspend && fiber_blocked()) {
+                Scheduler::wait(so, Reactor::READABLE);
+                continue;
+            }
+#endif
+            return -1;
+        }
+        packets.used += (unsigned)result;
+        total += (unsigned)result;
+        if((unsigned)result < count || !MSG_DONTWAIT)
+            break;
+    }
+    return (ssize_t)total;
+}
+
+ssize_t Socket::sendto(socket_t so, PacketBuffer& packets, int flags, const struct sockaddr *dest)
+{
+    bool suspend = false;
+    unsigned total = 0;
+    socklen_t dlen = 0;
+
+    if(dest)
+        dlen = len(dest);
+
+#ifdef  USE_FIBERS
+    suspend = !(flags & MSG_DONTWAIT) && Scheduler::self() != NULL;
+    if(suspend)
+        flags |= MSG_DONTWAIT;
+#endif
+
+    while(packets.used) {
+        unsigned count = packets.used;
+        if(packets.head + count > packets.limit)
+            count = packets.limit - packets.head;
+
+        ssize_t result = sendbatch(so, packets.vectors, &packets.list[packets.head], count, flags | MSG_NOSIGNAL, dest, dlen);
+        if(result < 0) {
+            if(errno == EINTR)
+                continue;
+#ifdef  USE_FIBERS
+            if(suspend && fiber_blocked()) {
+                Scheduler::wait(so, Reactor::WRITABLE);
+                continue;
+            }
+#endif
+            if(total)
+                break;
+            return -1;
+        }
+        packets.release((unsigned)result);
+        total += (unsigned)result;
+        if((unsigned)result < count && !suspend)
+            break;
+    }
+    return (ssize_t)total;
+}
+
+ssize_t Socket::recvfrom(socket_t so, segments& views, void *data, size_t len, int flags, struct sockaddr_storage *addr)
+{
+    assert(data != NULL);
+    assert(len > 0);
+
+#ifdef  UDP_GRO
+    struct msghdr msg;
+    struct iovec iov;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    bool suspend = false;
+    ssize_t result;
+
+#ifdef  USE_FIBERS
+    suspend = !(flags & MSG_DONTWAIT) && Scheduler::self() != NULL;
+    if(suspend)
+        flags |= MSG_DONTWAIT;
+#endif
+
+    for(;;) {
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base = data;
+        iov.iov_len = len;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_name = addr;
+        msg.msg_namelen = addr ? sizeof(struct sockaddr_storage) : 0;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        result = ::recvmsg(so, &msg, flags);
+        if(result >= 0 || errno != EINTR) {
+#ifdef  USE_FIBERS
+            if(result < 0 && suspend && fiber_blocked()) {
+                Scheduler::wait(so, Reactor::READABLE);
+                continue;
+            }
+#endif
+            break;
+        }
+    }
+
+    if(result < 0) {
+        views.set(data, 0);
+        return -1;
+    }
+
+    // without a coalescing message the receive is one datagram...
+    size_t segment = 0;
+    for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if(cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int size;
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            segment = (size_t)size;
+        }
+    }
+    views.set(data, (size_t)result, segment);
+    return result;
+#else
+    ssize_t result = Socket::recvfrom(so, data, len, flags, addr);
+    views.set(data, result > 0 ? (size_t)result : 0);
+    return result;
+#endif
+}
+
+ssize_t Socket::sendto(socket_t so, const segments& views, int flags, const struct sockaddr *dest)
+{
+    unsigned count = views.count(), index = 0;
+    size_t total = 0;
+
+#ifdef  UDP_SEGMENT
+    bool suspend = false;
+    socklen_t slen = 0;
+
+    if(dest)
+        slen = len(dest);
+
+#ifdef  USE_FIBERS
+    suspend = !(flags & MSG_DONTWAIT) && Scheduler::self() != NULL;
+#endif
+
+    // each send passes up to the kernel limit of datagrams, and the
+    // datagrams are sent one at a time if the kernel refuses...
+    while(count - index > 1) {
+        unsigned batch = 0;
+        size_t size = 0;
+        while(index + batch < count && batch < MAX_SEGMENTS) {
+            if(size + views.size(index + batch) > MAX_SEGMENTED)
+                break;
+            size += views.size(index + batch);
+            ++batch;
+        }
+        if(batch < 2)
+            break;
+
+        struct msghdr msg;
+        struct iovec iov;
+        union {
+            char buf[CMSG_SPACE(sizeof(uint16_t))];
+            struct cmsghdr align;
+        } control;
+        uint16_t segment = (uint16_t)views.segment();
+
+        memset(&msg, 0, sizeof(msg));
+        memset(&control, 0, sizeof(control));
+        iov.iov_base = views[index];
+        iov.iov_len = size;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_name = (void *)dest;
+        msg.msg_namelen = slen;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = IPPROTO_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(segment));
+        memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+
+        ssize_t result = ::sendmsg(so, &msg, flags | MSG_NOSIGNAL | (suspend ? MSG_DONTWAIT : 0));
+        if(result < 0) {
+            if(errno == EINTR)
+                continue;
+#ifdef  USE_FIBERS
+            if(suspend && fiber_blocked()) {
+                Scheduler::wait(so, Reactor::WRITABLE);
+                continue;
+            }
+#endif
+            if(errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+                break;
+            return total ? (ssize_t)total : -1;
+        }
+        total += (size_t)result;
+        index += batch;
+    }
+#endif
+
+    while(index < count) {
+        ssize_t result = Socket::sendto(so, views[index], views.size(index), flags, dest);
+        if(result < 0)
+            return total ? (ssize_t)total : -1;
+        total += (size_t)result;
+        ++index;
+    }
+    return (ssize_t)total;
+}
+
+unsigned Socket::readfrom(PacketBuffer& packets)
+{
+    // wait for input by timer if possible...
+    if(iowait && iowait != Timer::inf && !Socket::wait(so, iowait))
+        return 0;
+
+    ssize_t result = Socket::recvfrom(so, packets);
+
+    if(result < 0) {
+        ioerr = Socket::error();
+        return 0;
+    }
+    return (unsigned)result;
+}
+
+unsigned Socket::writeto(PacketBuffer& packets, const struct sockaddr *dest)
+{
+    ssize_t result = Socket::sendto(so, packets, 0, dest);
+
+    if(result < 0) {
+        ioerr = Socket::error();
+        return 0;
+    }
+    return (unsigned)result;
+}
+
 size_t Socket::writes(const char *str)
 {
     if(!str)
@@ -2020,7 +2741,7 @@ ssize_t Socket::readline(socket_t so, char *data, size_t max, timeout_t timeout)
             if(!wait(so, timeout))
                 return 0;
         }
-        nstat = ::recv(so, data, (socksize_t)nleft, MSG_PEEK);
+        nstat = (int)Socket::recvfrom(so, data, nleft, MSG_PEEK);
         if(nstat < 0)
             return -1;
 
@@ -2037,7 +2758,7 @@ ssize_t Socket::readline(socket_t so, char *data, size_t max, timeout_t timeout)
             }
         }
 
-        nstat = ::recv(so, (caddr_t)data, c, 0);
+        nstat = (int)Socket::recvfrom(so, data, c);
         if(nstat < 0)
             break;
 
@@ -2194,6 +2915,23 @@ int Socket::nodelay(socket_t so)
     return err;
 }
 
+int Socket::coalesce(socket_t so, bool enable)
+{
+    if(so == INVALID_SOCKET)
+        return EBADF;
+#if defined(UDP_GRO)
+    int opt = (enable ? 1 : 0);
+    if(!::setsockopt(so, IPPROTO_UDP, UDP_GRO, (char *)&opt, (socklen_t)sizeof(opt)))
+        return 0;
+    int err = Socket::error();
+    if(!err)
+        err = EIO;
+    return err;
+#else
+    return ENOSYS;
+#endif
+}
+
 int Socket::keepalive(socket_t so, bool enable)
 {
     if(so == INVALID_SOCKET)
@@ -2489,7 +3227,7 @@ socket_t Socket::create(const struct addrinfo *node, int stype, int sprotocol)
             so = Socket::create(sfamily, ctype, cprotocol);
         }
         if(so != INVALID_SOCKET) {
-            if(!::connect(so, node->ai_addr, (socklen_t)node->ai_addrlen))
+            if(!fiber_connect(so, node->ai_addr, (socklen_t)node->ai_addrlen))
                 return so;
         }
 next:
@@ -2500,11 +3238,252 @@ next:
     return INVALID_SOCKET;
 }
 
+#if defined(POLLOUT) && !defined(_MSWINDOWS_)
+#define USE_RACE
+
+// attempts alternate between the family of the first usable address and
+// all other families, so an unreachable family costs at most one delay
+// before the other is tried...
+
+static const struct addrinfo *race_next(const struct addrinfo *node, int family, bool same, int type, int protocol)
+{
+    for(; node; node = node->ai_next) {
+        if(type && node->ai_socktype && node->ai_socktype != type)
+            continue;
+
+        if(protocol && node->ai_protocol && node->ai_protocol != protocol)
+            continue;
+
+        if(node->ai_addr && (node->ai_family == family) == same)
+            return node;
+    }
+    return NULL;
+}
+
+static unsigned race_order(const struct addrinfo *list, const struct addrinfo **order, int type, int protocol)
+{
+    const struct addrinfo *first = race_next(list, AF_UNSPEC, false, type, protocol);
+    const struct addrinfo *other;
+    unsigned count = 0;
+    bool turn = true;
+    int family;
+
+    if(!first)
+        return 0;
+
+    family = first->ai_family;
+    other = race_next(list, family, false, type, protocol);
+    while(first || other) {
+        if(!other || (turn && first)) {
+            order[count++] = first;
+            first = race_next(first->ai_next, family, true, type, protocol);
+        }
+        else {
+            order[count++] = other;
+            other = race_next(other->ai_next, family, false, type, protocol);
+        }
+        turn = !turn;
+    }
+    return count;
+}
+
+// attempts are closed directly, as shutdown fails on a socket that never
+// connected...
+
+static void race_cancel(socket_t so)
+{
+    ::close(so);
+}
+
+static int race_start(const struct addrinfo *node, int type, int protocol, socket_t *so)
+{
+    int err;
+
+    if(!type)
+        type = node->ai_socktype;
+    if(!type)
+        type = SOCK_STREAM;
+    if(!protocol)
+        protocol = node->ai_protocol;
+
+    *so = Socket::create(node->ai_family, type, protocol);
+    if(*so == INVALID_SOCKET) {
+        err = Socket::error();
+        return err ? err : EIO;
+    }
+
+    err = Socket::blocking(*so, false);
+    if(!err) {
+        if(!::connect(*so, node->ai_addr, (socklen_t)node->ai_addrlen))
+            return 0;
+        err = Socket::error();
+        if(err == EINPROGRESS || err == EINTR)
+            return EINPROGRESS;
+    }
+
+    race_cancel(*so);
+    *so = INVALID_SOCKET;
+    return err ? err : EIO;
+}
+
+#endif
+
+socket_t Socket::race(const struct addrinfo *list, timeout_t timeout, timeout_t delay, int type, int protocol)
+{
+    assert(list != NULL);
+
+#ifdef  USE_RACE
+    const struct addrinfo *node;
+    unsigned count = 0, started = 0, active = 0, index;
+    socket_t so = INVALID_SOCKET, attempt;
+    int err = EADDRNOTAVAIL, rtn, status;
+    bool hurry = false;
+    timeout_t wait, left;
+    Timer expires, next;
+
+    for(node = list; node; node = node->ai_next)
+        ++count;
+
+    const struct addrinfo **order = new const struct addrinfo *[count];
+    struct pollfd *pending = new struct pollfd[count];
+
+    count = race_order(list, order, type, protocol);
+    if(timeout != Timer::inf)
+        expires.set(timeout);
+
+    while(so == INVALID_SOCKET) {
+        if(timeout != Timer::inf && !expires.get()) {
+            err = ETIMEDOUT;
+            break;
+        }
+
+        // the next attempt starts when its delay passes, or at once when
+        // an earlier attempt has failed...
+        if(started < count && (!active || hurry || !next.get())) {
+            hurry = false;
+            rtn = race_start(order[started++], type, protocol, &attempt);
+            if(!rtn) {
+                so = attempt;
+                break;
+            }
+            if(rtn != EINPROGRESS) {
+                err = rtn;
+                hurry = true;
+                continue;
+            }
+            pending[active].fd = attempt;
+            pending[active].events = POLLOUT;
+            pending[active].revents = 0;
+            ++active;
+            next.set(delay);
+            continue;
+        }
+
+        if(!active)
+            break;
+
+        wait = Timer::inf;
+        if(started < count)
+            wait = next.get();
+        if(timeout != Timer::inf) {
+            left = expires.get();
+            if(left < wait)
+                wait = left;
+        }
+
+#ifdef  USE_FIBERS
+        // a fiber can only suspend on one descriptor, so it waits on the
+        // oldest attempt for no more than a delay and then looks at all...
+        if(Scheduler::self()) {
+            status = ::poll(pending, active, 0);
+            if(!status && wait) {
+                if(delay && wait > delay)
+                    wait = delay;
+                else if(!delay && wait > 10)
+                    wait = 10;
+                Scheduler::wait(pending[0].fd, Reactor::WRITABLE, wait);
+                status = ::poll(pending, active, 0);
+            }
+        }
+        else
+#endif
+        if(wait == Timer::inf)
+            status = ::poll(pending, active, -1);
+        else
+            status = ::poll(pending, active, wait);
+
+        if(status < 0) {
+            if(errno == EINTR)
+                continue;
+            err = Socket::error();
+            break;
+        }
+
+        index = 0;
+        while(index < active) {
+            if(!pending[index].revents) {
+                ++index;
+                continue;
+            }
+            rtn = Socket::error(pending[index].fd);
+            if(!rtn) {
+                so = pending[index].fd;
+                pending[index] = pending[--active];
+                break;
+            }
+            race_cancel(pending[index].fd);
+            pending[index] = pending[--active];
+            err = rtn;
+            hurry = true;
+        }
+    }
+
+    while(active)
+        race_cancel(pending[--active].fd);
+
+    delete[] order;
+    delete[] pending;
+
+    if(so == INVALID_SOCKET) {
+        errno = err;
+        return INVALID_SOCKET;
+    }
+
+    Socket::blocking(so, true);
+    return so;
+#else
+    return create(list, type, protocol);
+#endif
+}
+
 int Socket::connectto(struct addrinfo *node)
 {
     return (ioerr = connectto(so, node));
 }
 
+int Socket::connectto(struct addrinfo *list, timeout_t timeout, timeout_t delay)
+{
+    int stype = 0;
+
+    if(so != INVALID_SOCKET)
+        stype = type(so);
+
+    socket_t connected = race(list, timeout, delay, stype);
+    if(connected == INVALID_SOCKET) {
+        ioerr = Socket::error();
+        if(!ioerr)
+            ioerr = EIO;
+        return ioerr;
+    }
+
+    timeout_t prior = iowait;
+    release();
+    so = connected;
+    if(prior != Timer::inf && !blocking(so, false))
+        iowait = prior;
+    return 0;
+}
+
 int Socket::disconnect(void)
 {
     return (ioerr = disconnect(so));
@@ -2524,7 +3503,7 @@ int Socket::connectto(socket_t so, struct addrinfo *node)
 
     while(node) {
         if(node->ai_family == socket_family) {
-            if(!::connect(so, node->ai_addr, (socklen_t)node->ai_addrlen)) {
+            if(!fiber_connect(so, node->ai_addr, (socklen_t)node->ai_addrlen)) {
                 rtn = 0;
                 goto exit;
             }
@@ -2656,6 +3635,10 @@ unsigned Socket::pending(socket_t so)
 socket_t Socket::acceptfrom(socket_t so, struct sockaddr_storage *addr)
 {
     socklen_t len = sizeof(struct sockaddr_storage);
+#ifdef  USE_FIBERS
+    if(Scheduler::self())
+        return fiber_accept(so, (struct sockaddr *)addr, addr ? &len : NULL);
+#endif
     if(addr)
         return ::accept(so, (struct sockaddr *)addr, &len);
     else
@@ -2671,6 +3654,11 @@ bool Socket::wait(socket_t so, timeout_t timeout)
 {
     int status;
 
+#ifdef  USE_FIBERS
+    if(timeout && so != INVALID_SOCKET && Scheduler::self())
+        return Scheduler::wait(so, Reactor::READABLE, timeout) != 0;
+#endif
+
 #ifdef  USE_POLL
     struct pollfd pfd;
 
@@ -2725,6 +3713,11 @@ bool Socket::wait(socket_t so, timeout_t timeout)
 bool Socket::waitSending(timeout_t timeout) const
 {
     int status;
+
+#ifdef  USE_FIBERS
+    if(timeout && so != INVALID_SOCKET && Scheduler::self())
+        return Scheduler::wait(so, Reactor::WRITABLE, timeout) != 0;
+#endif
 #ifdef  USE_POLL
     struct pollfd pfd;
 
@@ -2776,6 +3769,98 @@ bool Socket::waitSending(timeout_t timeout) const
 #endif
 }
 
+PacketBuffer::PacketBuffer(unsigned count, size_t size)
+{
+    assert(count > 0);
+    assert(size > 0);
+
+    // slots are whole cache lines, so datagrams being filled by the
+    // kernel and read by the application never share a line...
+    size_t stride = ((size + 63) / 64) * 64;
+
+    bufsize = size;
+    limit = count;
+    head = used = 0;
+    pool = (caddr_t)::malloc(stride * count);
+    if(!pool)
+        __THROW_ALLOC();
+
+    list = new packet[count];
+    for(unsigned pos = 0; pos < count; ++pos) {
+        list[pos].data = pool + (pos * stride);
+        list[pos].size = 0;
+        list[pos].set(NULL);
+    }
+
+#ifdef  USE_MMSG
+    vectors = ::malloc((sizeof(struct mmsghdr) + sizeof(struct iovec)) * count);
+    if(!vectors)
+        __THROW_ALLOC();
+#else
+    vectors = NULL;
+#endif
+}
+
+PacketBuffer::~PacketBuffer()
+{
+    delete[] list;
+    ::free(pool);
+    if(vectors)
+        ::free(vectors);
+}
+
+void PacketBuffer::packet::set(const struct sockaddr *from)
+{
+    if(!from) {
+        memset(&address, 0, sizeof(address));
+        return;
+    }
+
+    memcpy(&address, from, Socket::len(from));
+}
+
+bool PacketBuffer::put(const void *data, size_t size, const struct sockaddr *to)
+{
+    if(used >= limit || size > bufsize)
+        return false;
+
+    packet *item = slot(used);
+    memcpy(item->data, data, size);
+    item->size = size;
+    item->set(to);
+    ++used;
+    return true;
+}
+
+PacketBuffer::packet *PacketBuffer::reserve(void)
+{
+    if(used >= limit)
+        return NULL;
+
+    packet *item = slot(used);
+    item->size = 0;
+    item->set(NULL);
+    return item;
+}
+
+void PacketBuffer::commit(void)
+{
+    if(used < limit)
+        ++used;
+}
+
+void PacketBuffer::release(unsigned count)
+{
+    if(count > used)
+        count = used;
+
+    used -= count;
+    if(used)
+        head = (head + count) % limit;
+    else
+        head = 0;
+}
+
 ListenSocket::ListenSocket(const char *iface, const char *svc, unsigned backlog, int family, int type, int protocol) :
 Socket()
 {
@@ -2786,15 +3871,33 @@ Socket()
     assert(svc != NULL && *svc != 0);
     assert(backlog > 0);
 
-    so = create(iface, svc, backlog, family, type, protocol);
+    so = create(iface, svc, backlog, family, type, protocol, false);
+}
+
+ListenSocket::ListenSocket(const char *iface, const char *svc, unsigned backlog, int family, int type, int protocol, bool shared) :
+Socket()
+{
+    if(!iface)
+        iface = "*";
+
+    assert(iface != NULL && *iface != 0);
+    assert(svc != NULL && *svc != 0);
+    assert(backlog > 0);
+
+    so = create(iface, svc, backlog, family, type, protocol, shared);
 }
 
 socket_t ListenSocket::create(const char *iface, const char *svc, unsigned backlog, int family, int type, int protocol)
+{
+    return create(iface, svc, backlog, family, type, protocol, false);
+}
+
+socket_t ListenSocket::create(const char *iface, const char *svc, unsigned backlog, int family, int type, int protocol, bool shared)
 {
     if(!type)
         type = SOCK_STREAM;
 
-    socket_t so = Socket::create(iface, svc, family, type, protocol);
+    socket_t so = bindsocket(iface, svc, family, type, protocol, shared);
 
     if(so == INVALID_SOCKET)
         return so;
@@ -2809,17 +3912,127 @@ socket_t ListenSocket::create(const char *iface, const char *svc, unsigned backl
 socket_t ListenSocket::accept(struct sockaddr_storage *addr) const
 {
     socklen_t len = sizeof(struct sockaddr_storage);
+#ifdef  USE_FIBERS
+    if(Scheduler::self())
+        return fiber_accept(so, (struct sockaddr *)addr, addr ? &len : NULL);
+#endif
     if(addr)
         return ::accept(so, (struct sockaddr *)addr, &len);
     else
         return ::accept(so, NULL, NULL);
 }
 
+// batched connections are set non-blocking and close on exec as part of
+// the accept where the platform allows, saving two calls per connection...
+
+static socket_t accept_nonblocking(socket_t so, struct sockaddr *addr, socklen_t *len)
+{
+#if defined(HAVE_ACCEPT4) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+    return ::accept4(so, addr, len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    socket_t client = ::accept(so, addr, len);
+    if(client != INVALID_SOCKET) {
+        Socket::blocking(client, false);
+#ifdef  FD_CLOEXEC
+        fcntl(client, F_SETFD, FD_CLOEXEC);
+#endif
+    }
+    return client;
+#endif
+}
+
+unsigned ListenSocket::accept(socket_t *list, unsigned max, struct sockaddr_storage *addrs) const
+{
+    assert(list != NULL);
+
+    unsigned count = 0;
+
+#if !defined(_MSWINDOWS_) && defined(O_NONBLOCK)
+    int flags = fcntl(so, F_GETFL);
+    if(flags == -1)
+        return 0;
+
+    // the listener's flags are shared with other acceptors and are left
+    // alone, so a blocking listener is only accepted from once it is
+    // ready, and the batch ends when no more connections are pending...
+    bool blocking = !(flags & O_NONBLOCK);
+
+    while(count < max) {
+        if(blocking) {
+            if(count) {
+                if(!Socket::wait(so, 0))
+                    break;
+            }
+            else if(!Scheduler::self() || !Scheduler::wait(so, Reactor::READABLE))
+                Socket::wait(so, Timer::inf);
+        }
+        struct sockaddr *addr = addrs ? (struct sockaddr *)&addrs[count] : NULL;
+        socklen_t len = sizeof(struct sockaddr_storage);
+        socket_t client = accept_nonblocking(so, addr, addr ? &len : NULL);
+        if(client != INVALID_SOCKET) {
+            list[count++] = client;
+            continue;
+        }
+        if(errno == EINTR || errno == ECONNABORTED)
+            continue;
+        break;
+    }
+#else
+    if(max) {
+        struct sockaddr *addr = addrs ? (struct sockaddr *)&addrs[0] : NULL;
+        socklen_t len = sizeof(struct sockaddr_storage);
+        socket_t client = accept_nonblocking(so, addr, addr ? &len : NULL);
+        if(client != INVALID_SOCKET)
+            list[count++] = client;
+    }
+#endif
+    return count;
+}
+
 TCPServer::TCPServer(const char *address, const char *service, unsigned backlog) :
 ListenSocket(address, service, backlog)
 {
 }
 
+TCPServer::TCPServer(const char *address, const char *service, unsigned backlog, bool shared) :
+ListenSocket(address, service, backlog, AF_UNSPEC, 0, 0, shared)
+{
+}
+
+TCPShards::TCPShards(const char *address, const char *service, unsigned shards, unsigned backlog)
+{
+    if(!shards)
+        shards = 1;
+
+    servers = new TCPServer *[shards];
+    count = 0;
+
+    TCPServer *first = new TCPServer(address, service, backlog, true);
+    if(first->handle() == INVALID_SOCKET) {
+        delete first;
+        return;
+    }
+    servers[count++] = first;
+
+    // a shard that cannot share the address means none can, so the
+    // remaining workers use the servers already bound...
+    while(count < shards) {
+        TCPServer *server = new TCPServer(address, service, backlog, true);
+        if(server->handle() == INVALID_SOCKET) {
+            delete server;
+            break;
+        }
+        servers[count++] = server;
+    }
+}
+
+TCPShards::~TCPShards()
+{
+    for(unsigned pos = 0; pos < count; ++pos)
+        delete servers[pos];
+    delete[] servers;
+}
+
 #ifdef  _MSWINDOWS_
 #undef  AF_UNIX
 #endif
@@ -0,0 +1,426 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ucommon-config.h>
+#include <ucommon/export.h>
+#include <ucommon/tasks.h>
+#include <stdlib.h>
+
+namespace ucommon {
+
+enum {
+    TASK_IDLE = 0,
+    TASK_PENDING,
+    TASK_DONE
+};
+
+class __LOCAL TaskPool::worker : public JoinableThread
+{
+private:
+    __DELETE_DEFAULTS(worker);
+
+public:
+    TaskPool *pool;
+    unsigned id;
+    deque local;
+    Mutex lock;
+    OrderedIndex inbox;
+    volatile atomic_t queued;
+
+    worker(TaskPool *tp, unsigned index, unsigned size, size_t stack);
+    ~worker();
+
+    using JoinableThread::join;
+
+    task *get(void);
+    void put(task *item);
+
+    void run(void) __OVERRIDE;
+};
+
+// the worker a thread runs is kept in thread local storage, so submit and
+// wait can find it without searching the pool...
+
+class __LOCAL worker_local : public Thread::Local
+{
+private:
+    void release(void *mem) __FINAL {
+    }
+};
+
+static Thread::Local& workers_local(void)
+{
+    static worker_local locals;
+    return locals;
+}
+
+TaskPool::deque::deque(unsigned size)
+{
+    top = bottom = 0;
+    mask = (intptr_t)size - 1;
+    slots = (task * volatile *)::malloc(sizeof(task *) * size);
+    if(!slots)
+        __THROW_ALLOC();
+}
+
+TaskPool::deque::~deque()
+{
+    if(slots)
+        ::free((void *)slots);
+    slots = NULL;
+}
+
+bool TaskPool::deque::is_empty(void) const
+{
+    return Atomic::load(&top) >= Atomic::load(&bottom);
+}
+
+// only the owning worker pushes and pops from the bottom...
+
+bool TaskPool::deque::push(task *item)
+{
+    intptr_t b = bottom;
+    intptr_t t = Atomic::load(&top);
+
+    if(b - t > mask)
+        return false;
+
+    Atomic::store(&slots[b & mask], item);
+    Atomic::store(&bottom, b + 1);
+    return true;
+}
+
+TaskPool::task *TaskPool::deque::pop(void)
+{
+    intptr_t b = bottom - 1;
+    Atomic::store(&bottom, b);
+    Atomic::fence();
+    intptr_t t = Atomic::load(&top);
+
+    if(t > b) {
+        Atomic::store(&bottom, b + 1);
+        return NULL;
+    }
+
+    task *item = Atomic::load(&slots[b & mask]);
+    if(t == b) {
+        // last entry, race with thieves for it...
+        if(!Atomic::compare_exchange(&top, t, t + 1))
+            item = NULL;
+        Atomic::store(&bottom, b + 1);
+    }
+    return item;
+}
+
+// any other worker may steal from the top...
+
+TaskPool::task *TaskPool::deque::steal(void)
+{
+    intptr_t t = Atomic::load(&top);
+    Atomic::fence();
+    intptr_t b = Atomic::load(&bottom);
+
+    if(t >= b)
+        return NULL;
+
+    task *item = Atomic::load(&slots[t & mask]);
+    if(!Atomic::compare_exchange(&top, t, t + 1))
+        return NULL;
+
+    return item;
+}
+
+TaskPool::worker::worker(TaskPool *tp, unsigned index, unsigned size, size_t stack) :
+JoinableThread(stack), local(size)
+{
+    pool = tp;
+    id = index;
+    queued = 0;
+}
+
+// join before our deque and inbox are destroyed...
+
+TaskPool::worker::~worker()
+{
+    join();
+}
+
+TaskPool::task *TaskPool::worker::get(void)
+{
+    task *item;
+
+    if(!Atomic::load(&queued))
+        return NULL;
+
+    lock.acquire();
+    item = static_cast<task *>(inbox.get());
+    if(item)
+        Atomic::fetch_add(&queued, -1);
+    lock.release();
+    return item;
+}
+
+void TaskPool::worker::put(task *item)
+{
+    lock.acquire();
+    item->enlistTail(&inbox);
+    Atomic::fetch_add(&queued, 1);
+    lock.release();
+}
+
+void TaskPool::worker::run(void)
+{
+    map();
+    workers_local().set(this);
+
+    for(;;) {
+        task *item = pool->next(this);
+        if(item) {
+            pool->execute(item);
+            continue;
+        }
+        if(pool->stopping && !pool->pending())
+            break;
+        pool->park();
+    }
+    workers_local().clear();
+}
+
+TaskPool::task::task(bool autodelete) :
+OrderedObject()
+{
+    state = TASK_IDLE;
+    pool = NULL;
+    detached = autodelete;
+}
+
+TaskPool::task::~task()
+{
+}
+
+bool TaskPool::task::is_done(void) const
+{
+    return Atomic::load(&state) == TASK_DONE;
+}
+
+bool TaskPool::task::wait(timeout_t timeout)
+{
+    if(is_done())
+        return true;
+
+    if(!pool || detached)
+        return false;
+
+    // a worker waiting on a sub-task helps run pool work instead...
+    worker *self = pool->current();
+    if(self) {
+        Timer expires;
+        if(timeout != Timer::inf)
+            expires.set(timeout);
+        while(!is_done()) {
+            task *item = pool->next(self);
+            if(item)
+                pool->execute(item);
+            else if(timeout != Timer::inf && !expires.get())
+                return is_done();
+            else
+                Thread::yield();
+        }
+        return true;
+    }
+
+    bool result = true;
+    struct timespec ts;
+
+    if(timeout != Timer::inf)
+        Conditional::set(&ts, timeout);
+
+    pool->lock();
+    Atomic::fetch_add(&pool->waiting, 1);
+    Atomic::fence();
+    while(!is_done()) {
+        if(timeout == Timer::inf)
+            pool->finished.wait();
+        else if(!pool->finished.wait(&ts)) {
+            result = is_done();
+            break;
+        }
+    }
+    Atomic::fetch_add(&pool->waiting, -1);
+    pool->unlock();
+    return result;
+}
+
+TaskPool::TaskPool(unsigned size, unsigned limit, size_t stack) :
+Conditional(), finished(this)
+{
+    if(!size)
+        size = Thread::cpus();
+
+    capacity = 1;
+    while(capacity < limit)
+        capacity <<= 1;
+
+    count = size;
+    sleeping = wakeups = waiting = 0;
+    submits = 0;
+    stopping = false;
+
+    Thread::init();
+    workers = new worker *[count];
+    for(unsigned pos = 0; pos < count; ++pos)
+        workers[pos] = new worker(this, pos, capacity, stack);
+
+    for(unsigned pos = 0; pos < count; ++pos)
+        workers[pos]->start();
+}
+
+TaskPool::~TaskPool()
+{
+    lock();
+    stopping = true;
+    broadcast();
+    unlock();
+
+    // workers may still be stealing from each other until all have exited...
+    for(unsigned pos = 0; pos < count; ++pos)
+        workers[pos]->join();
+
+    for(unsigned pos = 0; pos < count; ++pos)
+        delete workers[pos];
+
+    delete[] workers;
+    workers = NULL;
+    count = 0;
+}
+
+TaskPool::worker *TaskPool::current(void)
+{
+    worker *self = (worker *)workers_local().get();
+
+    if(!self || self->pool != this)
+        return NULL;
+
+    return self;
+}
+
+void TaskPool::submit(task *item)
+{
+    assert(item != NULL);
+
+    item->pool = this;
+    item->Next = NULL;
+    Atomic::store(&item->state, (atomic_t)TASK_PENDING);
+
+    worker *self = current();
+    if(!self || !self->local.push(item)) {
+        unsigned pos = (unsigned)Atomic::fetch_add(&submits, 1) % count;
+        workers[pos]->put(item);
+    }
+    wakeup();
+}
+
+TaskPool::task *TaskPool::next(worker *self)
+{
+    task *item = self->local.pop();
+
+    if(!item)
+        item = self->get();
+
+    if(!item)
+        item = search(self->id + 1);
+
+    return item;
+}
+
+TaskPool::task *TaskPool::search(unsigned start)
+{
+    for(unsigned offset = 0; offset < count; ++offset) {
+        worker *victim = workers[(start + offset) % count];
+        task *item = victim->local.steal();
+        if(!item)
+            item = victim->get();
+        if(item)
+            return item;
+    }
+    return NULL;
+}
+
+bool TaskPool::pending(void)
+{
+    for(unsigned pos = 0; pos < count; ++pos) {
+        if(Atomic::load(&workers[pos]->queued) || !workers[pos]->local.is_empty())
+            return true;
+    }
+    return false;
+}
+
+void TaskPool::execute(task *item)
+{
+    item->run();
+
+    if(item->detached) {
+        delete item;
+        return;
+    }
+
+    Atomic::store(&item->state, (atomic_t)TASK_DONE);
+    Atomic::fence();
+    if(Atomic::load(&waiting)) {
+        lock();
+        finished.broadcast();
+        unlock();
+    }
+}
+
+// the fence pairs with the one in park, so either the submitter sees a
+// sleeping worker, or the worker sees the pending task before sleeping...
+
+void TaskPool::wakeup(void)
+{
+    Atomic::fence();
+    if(!Atomic::load(&sleeping))
+        return;
+
+    lock();
+    if(sleeping > wakeups) {
+        Atomic::fetch_add(&wakeups, 1);
+        signal();
+    }
+    unlock();
+}
+
+void TaskPool::park(void)
+{
+    lock();
+    Atomic::fetch_add(&sleeping, 1);
+    Atomic::fence();
+    // a wakeup is only taken by a worker that waited, as one already
+    // outstanding belongs to a worker that was signalled but not yet run...
+    if(!pending() && !stopping) {
+        do {
+            Conditional::wait();
+        } while(!wakeups && !stopping);
+        if(wakeups)
+            Atomic::fetch_add(&wakeups, -1);
+    }
+    Atomic::fetch_add(&sleeping, -1);
+    unlock();
+}
+
+} // namespace ucommon
@@ -27,6 +27,12 @@
 #include <stdarg.h>
 #include <limits.h>
 
+#ifdef  HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #if _POSIX_PRIORITY_SCHEDULING > 0
 #include <sched.h>
 static int realtime_policy = SCHED_FIFO;
@@ -41,6 +47,13 @@ extern int _posix_clocking;
 int _posix_clocking = CLOCK_REALTIME;
 #endif
 
+// guard tables are striped over cache line padded indexes, and each index
+// holds a few embedded entries so most guards never need to allocate...
+
+#define LOCK_STRIPES    64
+#define LOCK_ENTRIES    2
+#define LOCK_ALIGNED    64
+
 struct mutex_entry
 {
     pthread_mutex_t mutex;
@@ -58,38 +71,78 @@ public:
     unsigned count;
 };
 
-class __LOCAL mutex_index : public Mutex
+class __LOCAL lock_stripe : public Mutex
+{
+public:
+    // pads each stripe to whole cache lines...
+    __ALIGNED(LOCK_ALIGNED) unsigned long lookups;
+    unsigned long contended;
+
+    lock_stripe();
+
+    void lookup(void);
+};
+
+class __LOCAL mutex_index : public lock_stripe
 {
 public:
     struct mutex_entry *list;
+    struct mutex_entry entries[LOCK_ENTRIES];
 
     mutex_index();
 };
 
-class __LOCAL rwlock_index : public Mutex
+class __LOCAL rwlock_index : public lock_stripe
 {
 public:
     rwlock_entry *list;
+    rwlock_entry entries[LOCK_ENTRIES];
 
     rwlock_index();
 };
 
-static rwlock_index single_rwlock;
-static rwlock_index *rwlock_table = &single_rwlock;
-static mutex_index single_table;
-static mutex_index *mutex_table = &single_table;
-static unsigned mutex_indexing = 1;
-static unsigned rwlock_indexing = 1;
+static rwlock_index default_rwlock[LOCK_STRIPES];
+static rwlock_index *rwlock_table = default_rwlock;
+static mutex_index default_mutex[LOCK_STRIPES];
+static mutex_index *mutex_table = default_mutex;
+static unsigned mutex_indexing = LOCK_STRIPES - 1;
+static unsigned rwlock_indexing = LOCK_STRIPES - 1;
 static pthread_key_t threadmap;
 
-mutex_index::mutex_index() : Mutex()
+lock_stripe::lock_stripe() : Mutex()
+{
+    lookups = contended = 0;
+}
+
+void lock_stripe::lookup(void)
+{
+    if(pthread_mutex_trylock(&mlock)) {
+        pthread_mutex_lock(&mlock);
+        ++contended;
+    }
+    ++lookups;
+}
+
+mutex_index::mutex_index() : lock_stripe()
 {
     list = NULL;
+    for(unsigned pos = 0; pos < LOCK_ENTRIES; ++pos) {
+        entries[pos].count = 0;
+        entries[pos].pointer = NULL;
+        pthread_mutex_init(&entries[pos].mutex, NULL);
+        entries[pos].next = list;
+        list = &entries[pos];
+    }
 }
 
-rwlock_index::rwlock_index() : Mutex()
+rwlock_index::rwlock_index() : lock_stripe()
 {
     list = NULL;
+    for(unsigned pos = 0; pos < LOCK_ENTRIES; ++pos) {
+        entries[pos].object = NULL;
+        entries[pos].next = list;
+        list = &entries[pos];
+    }
 }
 
 rwlock_entry::rwlock_entry() : RWLock()
@@ -97,27 +150,60 @@ rwlock_entry::rwlock_entry() : RWLock()
     count = 0;
 }
 
-static unsigned hash_address(const void *ptr, unsigned indexing)
+// mix all pointer bits, since low bits are aligned and high bits shared...
+
+static unsigned hash_address(const void *ptr, unsigned mask)
 {
-    assert(ptr != NULL);
+    uint64_t key = (uint64_t)(uintptr_t)ptr;
 
-    unsigned key = 0;
-    unsigned count = 0;
-    const unsigned char *addr = (unsigned char *)(&ptr);
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
 
-    if(indexing < 2)
-        return 0;
+    return (unsigned)key & mask;
+}
 
-    // skip lead zeros if little endian...
-    while(count < sizeof(const void *) && *addr == 0) {
-        ++count;
-        ++addr;
-    }
+static unsigned stripes(unsigned size)
+{
+    unsigned count = 1;
 
-    while(count++ < sizeof(const void *) && *addr)
-        key = (key << 1) ^ *(addr++);
+    while(count < size)
+        count <<= 1;
 
-    return key % indexing;
+    return count;
+}
+
+template<class T>
+static T *striped(unsigned count)
+{
+    caddr_t base = (caddr_t)::malloc(sizeof(T) * count + LOCK_ALIGNED);
+
+    if(!base)
+        __THROW_ALLOC();
+
+    base += LOCK_ALIGNED - ((uintptr_t)base & (LOCK_ALIGNED - 1));
+    T *table = (T *)base;
+    for(unsigned pos = 0; pos < count; ++pos)
+        new((caddr_t)&table[pos]) T;
+    return table;
+}
+
+template<class T>
+static void statistics(T *table, unsigned mask, unsigned long *lookups, unsigned long *contended)
+{
+    unsigned long total = 0, waits = 0;
+
+    for(unsigned pos = 0; pos <= mask; ++pos) {
+        total += table[pos].lookups;
+        waits += table[pos].contended;
+    }
+
+    if(lookups)
+        *lookups = total;
+    if(contended)
+        *contended = waits;
 }
 
 ReusableAllocator::ReusableAllocator() :
@@ -125,6 +211,46 @@ Conditional()
 {
     freelist = NULL;
     waiting = 0;
+    slots = 0;
+    base = NULL;
+    stride = 0;
+    table = NULL;
+}
+
+// objects are never freed while the pool exists, so reading the link of
+// an object another thread popped is safe, and the tag fails the swap...
+
+ReusableObject *ReusableAllocator::pop(void)
+{
+    uint64_t top = Atomic::load(&slots);
+    uint64_t update;
+    ReusableObject *obj;
+
+    do {
+        unsigned index = (unsigned)(top & 0xffffffff);
+        if(!index)
+            return NULL;
+        obj = slot(index - 1);
+        if(!obj)
+            return NULL;
+        uintptr_t link = (uintptr_t)Atomic::load((LinkedObject * volatile *)&obj->Next);
+        update = (((top >> 32) + 1) << 32) | (uint64_t)(link & 0xffffffff);
+    } while(!Atomic::compare_exchange(&slots, top, update));
+
+    obj->Next = NULL;
+    return obj;
+}
+
+void ReusableAllocator::push(ReusableObject *obj)
+{
+    uint64_t top = Atomic::load(&slots);
+    uint64_t index = (uint64_t)slot(obj) + 1;
+    uint64_t update;
+
+    do {
+        Atomic::store((LinkedObject * volatile *)&obj->Next, (LinkedObject *)(uintptr_t)(top & 0xffffffff));
+        update = (((top >> 32) + 1) << 32) | index;
+    } while(!Atomic::compare_exchange(&slots, top, update));
 }
 
 void ReusableAllocator::release(ReusableObject *obj)
@@ -136,6 +262,18 @@ void ReusableAllocator::release(ReusableObject *obj)
     obj->retain();
     obj->release();
 
+    // pairs with the fence a consumer uses before it re-checks and waits...
+    if(is_indexed()) {
+        push(obj);
+        Atomic::fence();
+        if(Atomic::load(&waiting)) {
+            lock();
+            signal();
+            unlock();
+        }
+        return;
+    }
+
     lock();
     obj->enlist(ru);
 
@@ -463,20 +601,32 @@ Mutex::~Mutex()
 
 void Mutex::indexing(unsigned index)
 {
-    if(index > 1) {
-        mutex_table = new mutex_index[index];
-        mutex_indexing = index;
+    index = stripes(index);
+    if(index > 1 && index != mutex_indexing + 1) {
+        mutex_table = striped<mutex_index>(index);
+        mutex_indexing = index - 1;
     }
 }
 
 void RWLock::indexing(unsigned index)
 {
-    if(index > 1) {
-        rwlock_table = new rwlock_index[index];
-        rwlock_indexing = index;
+    index = stripes(index);
+    if(index > 1 && index != rwlock_indexing + 1) {
+        rwlock_table = striped<rwlock_index>(index);
+        rwlock_indexing = index - 1;
     }
 }
 
+void Mutex::statistics(unsigned long *lookups, unsigned long *contended)
+{
+    ucommon::statistics(mutex_table, mutex_indexing, lookups, contended);
+}
+
+void RWLock::statistics(unsigned long *lookups, unsigned long *contended)
+{
+    ucommon::statistics(rwlock_table, rwlock_indexing, lookups, contended);
+}
+
 RWLock::reader::reader()
 {
     object = NULL;
@@ -555,7 +705,7 @@ bool RWLock::reader::lock(const void *ptr, timeout_t timeout)
     if(!ptr)
         return false;
 
-    index->acquire();
+    index->lookup();
     entry = index->list;
     while(entry) {
         if(entry->count && entry->object == ptr)
@@ -592,7 +742,7 @@ bool RWLock::writer::lock(const void *ptr, timeout_t timeout)
     if(!ptr)
         return false;
 
-    index->acquire();
+    index->lookup();
     entry = index->list;
     while(entry) {
         if(entry->count && entry->object == ptr)
@@ -649,7 +799,7 @@ bool Mutex::protect(const void *ptr)
     if(!ptr)
         return false;
 
-    index->acquire();
+    index->lookup();
     entry = index->list;
     while(entry) {
         if(entry->count && entry->pointer == ptr)
@@ -685,7 +835,7 @@ bool RWLock::release(const void *ptr)
     if(!ptr)
         return false;
 
-    index->acquire();
+    index->lookup();
     entry = index->list;
     while(entry) {
         if(entry->count && entry->object == ptr)
@@ -711,7 +861,7 @@ bool Mutex::release(const void *ptr)
     if(!ptr)
         return false;
 
-    index->acquire();
+    index->lookup();
     entry = index->list;
     while(entry) {
         if(entry->count && entry->pointer == ptr)
@@ -740,6 +890,140 @@ void Mutex::_unlock(void)
     pthread_mutex_unlock(&mlock);
 }
 
+TicketLock::TicketLock()
+{
+    next = serving = 0;
+}
+
+void TicketLock::acquire(void)
+{
+    atomic_t ticket = Atomic::fetch_add(&next, (atomic_t)1);
+    atomic_t prior = Atomic::load(&serving);
+    unsigned rounds = 0;
+
+    for(;;) {
+        atomic_t current = Atomic::load(&serving);
+        if(current == ticket)
+            return;
+
+        // a holder or the next in line may have been preempted, so once
+        // the queue stops moving for a while the processor is given up...
+        if(current != prior) {
+            prior = current;
+            rounds = 0;
+        }
+
+        // wait longer the further back in the queue we are...
+        unsigned ahead = (unsigned)(ticket - current);
+        if(ahead > 8 || ++rounds > 64) {
+            Thread::yield();
+            rounds = 0;
+        }
+        else {
+            for(unsigned count = 0; count < ahead * 16; ++count)
+                Atomic::pause();
+        }
+    }
+}
+
+bool TicketLock::try_acquire(void)
+{
+    atomic_t current = Atomic::load(&serving);
+    atomic_t ticket = current;
+    return Atomic::compare_exchange(&next, ticket, (atomic_t)(current + 1));
+}
+
+void TicketLock::release(void)
+{
+    Atomic::store(&serving, (atomic_t)(serving + 1));
+}
+
+void TicketLock::_lock(void)
+{
+    acquire();
+}
+
+void TicketLock::_unlock(void)
+{
+    release();
+}
+
+// the futex word is 0 when free, 1 when held, and 2 when held with parked
+// waiters, so an uncontended release never needs to wake anyone...
+
+AdaptiveMutex::AdaptiveMutex(unsigned count)
+{
+    state = 0;
+    spins = count;
+    if(pthread_mutex_init(&mlock, NULL))
+         __THROW_RUNTIME("mutex init failed");
+}
+
+AdaptiveMutex::~AdaptiveMutex()
+{
+    pthread_mutex_destroy(&mlock);
+}
+
+bool AdaptiveMutex::try_acquire(void)
+{
+#ifdef  HAVE_LINUX_FUTEX_H
+    atomic_t expected = 0;
+    return Atomic::compare_exchange(&state, expected, (atomic_t)1);
+#else
+    return pthread_mutex_trylock(&mlock) == 0;
+#endif
+}
+
+void AdaptiveMutex::acquire(void)
+{
+    unsigned delay = 1;
+
+    if(try_acquire())
+        return;
+
+    // spin without yielding, since a yield is as costly as parking...
+    for(unsigned count = 0; count < spins; ++count) {
+#ifdef  HAVE_LINUX_FUTEX_H
+        if(!Atomic::load(&state) && try_acquire())
+            return;
+#else
+        if(try_acquire())
+            return;
+#endif
+        for(unsigned pause = 0; pause < delay; ++pause)
+            Atomic::pause();
+        if(delay < 16)
+            delay <<= 1;
+    }
+
+#ifdef  HAVE_LINUX_FUTEX_H
+    while(Atomic::exchange(&state, (atomic_t)2) != 0)
+        syscall(SYS_futex, &state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&mlock);
+#endif
+}
+
+void AdaptiveMutex::release(void)
+{
+#ifdef  HAVE_LINUX_FUTEX_H
+    if(Atomic::exchange(&state, (atomic_t)0) == 2)
+        syscall(SYS_futex, &state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    pthread_mutex_unlock(&mlock);
+#endif
+}
+
+void AdaptiveMutex::_lock(void)
+{
+    acquire();
+}
+
+void AdaptiveMutex::_unlock(void)
+{
+    release();
+}
+
 #ifdef  _MSTHREADS_
 
 TimedEvent::TimedEvent() :
@@ -829,7 +1113,7 @@ void TimedEvent::wait(void)
 TimedEvent::TimedEvent() :
 Timer()
 {
-    signalled = false;
+    signalled = waiting = 0;
     if(pthread_cond_init(&cond, Conditional::initializer()))
         __THROW_RUNTIME("conditional init failed");
     if(pthread_mutex_init(&mutex, NULL))
@@ -840,7 +1124,7 @@ Timer()
 TimedEvent::TimedEvent(timeout_t timeout) :
 Timer(timeout)
 {
-    signalled = false;
+    signalled = waiting = 0;
     if(pthread_cond_init(&cond, Conditional::initializer()))
         __THROW_RUNTIME("conditional init failed");
     if(pthread_mutex_init(&mutex, NULL))
@@ -850,7 +1134,7 @@ Timer(timeout)
 TimedEvent::TimedEvent(time_t timer) :
 Timer(timer)
 {
-    signalled = false;
+    signalled = waiting = 0;
     if(pthread_cond_init(&cond, Conditional::initializer()))
         __THROW_RUNTIME("conditional init failed");
     if(pthread_mutex_init(&mutex, NULL))
@@ -863,6 +1147,86 @@ TimedEvent::~TimedEvent()
     pthread_mutex_destroy(&mutex);
 }
 
+#ifdef  HAVE_LINUX_FUTEX_H
+
+// the signal is latched in a futex word, and waiters only enter the kernel
+// when it is not yet set, so a signal with nobody parked is one exchange...
+
+bool TimedEvent::consume(struct timespec *deadline)
+{
+    bool expired = false;
+
+    for(;;) {
+        if(Atomic::exchange(&signalled, (atomic_t)0))
+            return true;
+        if(expired)
+            return false;
+        Atomic::fetch_add(&waiting, (atomic_t)1);
+        expired = !Conditional::park(&signalled, 0, deadline);
+        Atomic::fetch_add(&waiting, (atomic_t)-1);
+    }
+}
+
+void TimedEvent::reset(void)
+{
+    pthread_mutex_lock(&mutex);
+    Atomic::store(&signalled, (atomic_t)0);
+    set();
+    pthread_mutex_unlock(&mutex);
+}
+
+void TimedEvent::signal(void)
+{
+    Atomic::exchange(&signalled, (atomic_t)1);
+    Atomic::fence();
+    if(Atomic::load(&waiting))
+        Conditional::unpark(&signalled);
+}
+
+bool TimedEvent::sync(void)
+{
+    timeout_t timeout = get();
+    struct timespec ts;
+    bool result;
+
+    if(Atomic::exchange(&signalled, (atomic_t)0))
+        return true;
+
+    if(!timeout)
+        return false;
+
+    Conditional::set(&ts, timeout);
+
+    // give up the object lock while parked, as a conditional wait would...
+    pthread_mutex_unlock(&mutex);
+    result = consume(&ts);
+    pthread_mutex_lock(&mutex);
+    return result;
+}
+
+void TimedEvent::wait(void)
+{
+    consume(NULL);
+}
+
+bool TimedEvent::wait(timeout_t timeout)
+{
+    struct timespec ts;
+
+    pthread_mutex_lock(&mutex);
+    operator+=(timeout);
+    timeout = get();
+    pthread_mutex_unlock(&mutex);
+
+    if(!timeout)
+        return Atomic::exchange(&signalled, (atomic_t)0) != 0;
+
+    Conditional::set(&ts, timeout);
+    return consume(&ts);
+}
+
+#else
+
 void TimedEvent::reset(void)
 {
     pthread_mutex_lock(&mutex);
@@ -921,6 +1285,8 @@ bool TimedEvent::wait(timeout_t timeout)
     pthread_mutex_unlock(&mutex);
     return result;
 }
+
+#endif
 #endif
 
 void TimedEvent::lock(void)
@@ -1336,6 +1702,27 @@ size_t Thread::cache(void)
 #endif
 }
 
+unsigned Thread::cpus(void)
+{
+    static volatile unsigned count = 0;
+
+    if(count)
+        return count;
+
+#ifdef  _MSWINDOWS_
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    count = (unsigned)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if(online > 0)
+        count = (unsigned)online;
+#endif
+    if(!count)
+        count = 1;
+    return count;
+}
+
 pthread_t Thread::self(void)
 {
     return pthread_self();
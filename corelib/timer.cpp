@@ -63,12 +63,16 @@ static void adj(struct timeval *ts)
 TimerQueue::event::event(timeout_t timeout) :
 Timer(), DLinkedObject()
 {
+    wheel_next = wheel_prev = NULL;
+    wheel_list = NULL;
     set(timeout);
 }
 
 TimerQueue::event::event(TimerQueue *tq, timeout_t timeout) :
 Timer(), DLinkedObject()
 {
+    wheel_next = wheel_prev = NULL;
+    wheel_list = NULL;
     set(timeout);
     Timer::update();
     attach(tq);
@@ -148,6 +152,8 @@ void TimerQueue::event::attach(TimerQueue *tq)
     tq->modify();
     enlist(tq);
     Timer::update();
+    if(tq->wheel && is_active())
+        tq->insert(this);
     tq->update();
 }
 
@@ -157,6 +163,8 @@ void TimerQueue::event::arm(timeout_t timeout)
     if(tq)
         tq->modify();
     set(timeout);
+    if(tq && tq->wheel)
+        tq->insert(this);
     if(tq)
         tq->update();
 }
@@ -169,6 +177,8 @@ void TimerQueue::event::disarm(void)
     if(tq && flag)
         tq->modify();
     clear();
+    if(tq && flag && tq->wheel)
+        tq->remove(this);
     if(tq && flag)
         tq->update();
 }
@@ -178,6 +188,10 @@ void TimerQueue::event::update(void)
     TimerQueue *tq = list();
     if(Timer::update() && tq) {
         tq->modify();
+        if(tq->wheel && is_active())
+            tq->insert(this);
+        else if(tq->wheel)
+            tq->remove(this);
         tq->update();
     }
 }
@@ -188,6 +202,8 @@ void TimerQueue::event::detach(void)
     if(tq) {
         tq->modify();
         clear();
+        if(tq->wheel)
+            tq->remove(this);
         delist();
         tq->update();
     }
@@ -423,17 +439,255 @@ timeout_t TQEvent::timeout(void)
     return timeout;
 }
 
+// the wheel has WHEEL_LEVELS levels of WHEEL_SIZE slots, with each level
+// covering WHEEL_SIZE times the span of the level below it...
+
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS    5
+
 TimerQueue::TimerQueue() : OrderedIndex()
 {
+    resolution = 0;
+    origin = current = 0;
+    wheel = NULL;
+    pending = NULL;
+    occupied = NULL;
+    count = 0;
+}
+
+TimerQueue::TimerQueue(timeout_t res) : OrderedIndex()
+{
+    resolution = res;
+    origin = current = 0;
+    wheel = NULL;
+    pending = NULL;
+    occupied = NULL;
+    count = 0;
+
+    if(!res)
+        return;
+
+    wheel = (event **)::calloc(WHEEL_LEVELS * WHEEL_SIZE, sizeof(event *));
+    occupied = (uint64_t *)::calloc(WHEEL_LEVELS, sizeof(uint64_t));
+    if(!wheel || !occupied)
+        __THROW_ALLOC();
+
+    Timer now;
+    now.set();
+    origin = msec(&now, false);
 }
 
 TimerQueue::~TimerQueue()
 {
+    if(wheel)
+        ::free(wheel);
+    if(occupied)
+        ::free(occupied);
+    wheel = NULL;
+    occupied = NULL;
+}
+
+// each level keeps a bitmap of its slots in use, so expire can jump to
+// the next occupied slot rather than step through empty ticks...
+
+static unsigned lowest(uint64_t bits)
+{
+#ifdef  __GNUC__
+    return (unsigned)__builtin_ctzll(bits);
+#else
+    unsigned pos = 0;
+    while(!(bits & 1)) {
+        bits >>= 1;
+        ++pos;
+    }
+    return pos;
+#endif
+}
+
+static unsigned distance(uint64_t bits, unsigned pos)
+{
+    if(!bits)
+        return WHEEL_SIZE;
+
+    if(pos)
+        bits = (bits >> pos) | (bits << (WHEEL_SIZE - pos));
+    return lowest(bits);
+}
+
+uint64_t TimerQueue::msec(const Timer *timer, bool upper) const
+{
+#if _POSIX_TIMERS > 0 && defined(POSIX_TIMERS)
+    long frac = timer->timer.tv_nsec, scale = 1000000l;
+#else
+    long frac = timer->timer.tv_usec, scale = 1000l;
+#endif
+    // deadlines round up so a wheel tick never fires ahead of its timer...
+    if(upper)
+        frac += scale - 1;
+    return (uint64_t)timer->timer.tv_sec * 1000 + (uint64_t)(frac / scale);
+}
+
+void TimerQueue::remove(event *timer)
+{
+    if(!timer->wheel_list)
+        return;
+
+    if(timer->wheel_next)
+        timer->wheel_next->wheel_prev = timer->wheel_prev;
+    if(timer->wheel_prev)
+        timer->wheel_prev->wheel_next = timer->wheel_next;
+    else
+        *(timer->wheel_list) = timer->wheel_next;
+
+    event **list = timer->wheel_list;
+    if(!*list && list >= wheel && list < wheel + WHEEL_LEVELS * WHEEL_SIZE) {
+        size_t index = (size_t)(list - wheel);
+        occupied[index / WHEEL_SIZE] &= ~((uint64_t)1 << (index & WHEEL_MASK));
+    }
+
+    timer->wheel_next = timer->wheel_prev = NULL;
+    timer->wheel_list = NULL;
+    --count;
+}
+
+void TimerQueue::insert(event *timer)
+{
+    remove(timer);
+
+    uint64_t expires = msec(timer, true);
+    if(expires > origin)
+        expires = (expires - origin + resolution - 1) / resolution;
+    else
+        expires = 0;
+    if(expires < current)
+        expires = current;
+
+    // beyond the wheel span the event is re-inserted when it is reached...
+    uint64_t delta = expires - current;
+    if(delta >= ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)))
+        expires = current + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+    unsigned level = 0;
+    while(level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+        ++level;
+
+    unsigned pos = (unsigned)((expires >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    event **list = &wheel[level * WHEEL_SIZE + pos];
+    occupied[level] |= (uint64_t)1 << pos;
+    timer->wheel_list = list;
+    timer->wheel_prev = NULL;
+    timer->wheel_next = *list;
+    if(*list)
+        (*list)->wheel_prev = timer;
+    *list = timer;
+    ++count;
+}
+
+void TimerQueue::cascade(unsigned level)
+{
+    unsigned pos = (unsigned)((current >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    event **list = &wheel[level * WHEEL_SIZE + pos];
+    event *timer = *list;
+
+    *list = NULL;
+    occupied[level] &= ~((uint64_t)1 << pos);
+    while(timer) {
+        event *next = timer->wheel_next;
+        timer->wheel_list = NULL;
+        timer->wheel_next = timer->wheel_prev = NULL;
+        --count;
+        insert(timer);
+        timer = next;
+    }
 }
 
 timeout_t TimerQueue::expire(void)
 {
     timeout_t first = Timer::inf, next;
+
+    if(wheel) {
+        Timer clock;
+        clock.set();
+        uint64_t ms = msec(&clock, false);
+        uint64_t now = (ms > origin) ? (ms - origin) / resolution : 0;
+
+        while(current <= now && count) {
+            unsigned level = 1;
+            while(level < WHEEL_LEVELS && !((current >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK)) {
+                cascade(level);
+                if((current >> (WHEEL_BITS * level)) & WHEEL_MASK)
+                    break;
+                ++level;
+            }
+
+            // skip empty slots, up to the next cascade at the latest...
+            unsigned pos = (unsigned)(current & WHEEL_MASK);
+            uint64_t ahead = occupied[0] >> pos;
+            uint64_t next = ahead ? current + lowest(ahead) : (current | WHEEL_MASK) + 1;
+            if(next > now) {
+                current = now + 1;
+                break;
+            }
+            current = next;
+            if(!ahead)
+                continue;
+
+            // detach the whole slot as a batch, and advance first so any
+            // event re-armed by a callback lands in a later slot...
+            pos = (unsigned)(current & WHEEL_MASK);
+            pending = wheel[pos];
+            wheel[pos] = NULL;
+            occupied[0] &= ~((uint64_t)1 << pos);
+            for(event *timer = pending; timer; timer = timer->wheel_next)
+                timer->wheel_list = &pending;
+            ++current;
+
+            // events fire against the clock read above, and only those
+            // clamped beyond the wheel span may still be waiting...
+            while(pending) {
+                event *tp = pending;
+                remove(tp);
+                if(msec(tp, true) > ms) {
+                    insert(tp);
+                    continue;
+                }
+                tp->disarm();
+                tp->expired();
+                tp->Timer::update();
+                if(!tp->wheel_list && tp->is_active() && tp->list() == this)
+                    insert(tp);
+            }
+        }
+        if(current <= now)
+            current = now + 1;
+
+        if(!count)
+            return Timer::inf;
+
+        // find the nearest slot that is due or must be cascaded...
+        uint64_t due = (uint64_t)-1;
+        unsigned pos = distance(occupied[0], (unsigned)(current & WHEEL_MASK));
+        if(pos < WHEEL_SIZE)
+            due = current + pos;
+        for(unsigned level = 1; level < WHEEL_LEVELS; ++level) {
+            // a slot is due at its cascade, which may be the current tick...
+            uint64_t span = (uint64_t)1 << (WHEEL_BITS * level);
+            uint64_t base = (current + span - 1) >> (WHEEL_BITS * level);
+            pos = distance(occupied[level], (unsigned)(base & WHEEL_MASK));
+            if(pos < WHEEL_SIZE) {
+                uint64_t at = (base + pos) << (WHEEL_BITS * level);
+                if(at < due)
+                    due = at;
+            }
+        }
+        if(due == (uint64_t)-1)
+            return Timer::inf;
+
+        return (timeout_t)(origin + due * resolution - ms);
+    }
+
     linked_pointer<TimerQueue::event> timer = begin();
     TimerQueue::event *tp;
 
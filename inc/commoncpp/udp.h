@@ -214,6 +214,24 @@ public:
      */
     ssize_t receive(void *buf, size_t len, bool reply = false);
 
+    /**
+     * Send the message packets queued in a packet buffer to the peer
+     * host, or to the address held by each packet.
+     *
+     * @param packets buffer of packets to send.
+     * @return number of packets sent.
+     */
+    ssize_t send(ucommon::PacketBuffer& packets);
+
+    /**
+     * Receive a batch of waiting messages from any host.  The sender of
+     * each is saved with the packet.
+     *
+     * @param packets buffer to receive packets into.
+     * @return number of packets received.
+     */
+    ssize_t receive(ucommon::PacketBuffer& packets);
+
     /**
      * Examine address of sender of next waiting packet.  This also
      * sets "peer" address to the sender so that the next "send"
@@ -387,6 +405,15 @@ protected:
     inline ssize_t send(const void *buf, size_t len)
         {return ::send(so, (const char *)buf, (socksize_t)len, MSG_NOSIGNAL);}
 
+    /**
+     * Transmit a batch of packets using "connected" sends.
+     *
+     * @return number of packets sent.
+     * @param packets buffer of packets to send.
+     */
+    inline ssize_t send(ucommon::PacketBuffer& packets)
+        {return ucommon::Socket::sendto(so, packets);}
+
     /**
      * Stop transmitter.
      */
@@ -420,6 +447,15 @@ public:
     inline ssize_t transmit(const char *buffer, size_t len)
         {return ::send(so, buffer, (socksize_t)len, MSG_DONTWAIT|MSG_NOSIGNAL);}
 
+    /**
+     * Transmit as many queued packets as can be sent without blocking.
+     *
+     * @return number of packets sent.
+     * @param packets buffer of packets to send.
+     */
+    inline ssize_t transmit(ucommon::PacketBuffer& packets)
+        {return ucommon::Socket::sendto(so, packets, MSG_DONTWAIT);}
+
     /**
      * See if output queue is empty for sending more packets.
      *
@@ -540,6 +576,15 @@ public:
     inline ssize_t receive(void *buf, size_t len)
         {return ::recv(so, (char *)buf, (socksize_t)len, 0);}
 
+    /**
+     * Receive a batch of data packets from the connected peer host.
+     *
+     * @return number of packets received.
+     * @param packets buffer to receive packets into.
+     */
+    inline ssize_t receive(ucommon::PacketBuffer& packets)
+        {return ucommon::Socket::recvfrom(so, packets);}
+
     /**
      * See if input queue has data packets available.
      *
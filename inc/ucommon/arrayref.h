@@ -54,7 +54,7 @@ namespace ucommon {
 class __EXPORT ArrayRef : public TypeRef
 {
 protected:
-	typedef enum {ARRAY, STACK, QUEUE, FALLBACK} arraytype_t;
+	typedef enum {ARRAY, STACK, QUEUE, FALLBACK, MPMC, SPSC} arraytype_t;
 
 	class __EXPORT Array : public Counted, public ConditionalAccess
 	{
@@ -68,8 +68,46 @@ protected:
 
 		arraytype_t type;
 
+		caddr_t ring;
+
+		size_t line;
+
+		volatile atomic_t producers, consumers;
+
 		explicit Array(arraytype_t mode, void *addr, size_t size);
 
+		/**
+		 * Try to add an object to a lock-free queue without waiting.
+		 * @param object to add, retained if added.
+		 * @return true if added, false if full.
+		 */
+		bool enqueue(Counted *object);
+
+		/**
+		 * Try to remove an object from a lock-free queue without waiting.
+		 * @return object removed, or NULL if empty.
+		 */
+		Counted *dequeue(void);
+
+		/**
+		 * Add to a lock-free queue, waiting only while it is full.
+		 * @param object to add.
+		 * @param timeout to wait, or Timer::inf.
+		 * @return true if added.
+		 */
+		bool push(Counted *object, timeout_t timeout);
+
+		/**
+		 * Remove from a lock-free queue, waiting only while it is empty.
+		 * @param timeout to wait, or Timer::inf.
+		 * @return object removed, or NULL if timed out.
+		 */
+		Counted *pull(timeout_t timeout);
+
+		inline bool lockfree(void) const {
+			return type == MPMC || type == SPSC;
+		}
+
 		void assign(size_t index, Counted *object);
 
 		Counted *remove(size_t index);
@@ -201,6 +239,11 @@ public:
 
 	inline queueref(size_t size, bool fallback = false) : ArrayRef(fallback ? FALLBACK : QUEUE, size + 1) {};
 
+protected:
+	inline queueref(arraytype_t mode, size_t size) : ArrayRef(mode, size) {};
+
+public:
+
 	inline queueref& operator=(const queueref& copy) {
 		TypeRef::set(copy);
 		return *this;
@@ -259,6 +302,52 @@ public:
 	}
 };
 
+/**
+ * A bounded lock-free queue of typed objects for many producer and many
+ * consumer threads.  Each slot carries a sequence number, so producers and
+ * consumers claim slots with a single compare and swap and never take a
+ * lock.  Blocking push and pull only touch the conditional lock while the
+ * queue is full or empty.  Indexed access to queued objects is not
+ * supported.
+ */
+template<typename T>
+class mpmcref : public queueref<T>
+{
+public:
+	inline mpmcref() : queueref<T>() {};
+
+	inline mpmcref(const mpmcref& copy) : queueref<T>(copy) {};
+
+	inline mpmcref(size_t size) : queueref<T>(ArrayRef::MPMC, size) {};
+
+	inline mpmcref& operator=(const mpmcref& copy) {
+		TypeRef::set(copy);
+		return *this;
+	}
+};
+
+/**
+ * A bounded lock-free queue of typed objects for exactly one producer and
+ * one consumer thread, such as between pipeline stages.  Each side keeps a
+ * cached copy of the other side's position, so the shared positions are
+ * only read when the cached copy says the queue is full or empty.
+ */
+template<typename T>
+class spscref : public queueref<T>
+{
+public:
+	inline spscref() : queueref<T>() {};
+
+	inline spscref(const spscref& copy) : queueref<T>(copy) {};
+
+	inline spscref(size_t size) : queueref<T>(ArrayRef::SPSC, size) {};
+
+	inline spscref& operator=(const spscref& copy) {
+		TypeRef::set(copy);
+		return *this;
+	}
+};
+
 template<typename T>
 class arrayref : public ArrayRef
 {
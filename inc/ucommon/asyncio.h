@@ -0,0 +1,361 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Asynchronous file and socket i/o.  Requests for reads, writes, syncs,
+ * sends, receives, accepts, and connects are queued and submitted to the
+ * kernel as a batch, and complete later through a callback or by waiting
+ * on the request.  On Linux this uses io_uring directly, so a batch of
+ * operations costs a single system call.  Elsewhere, or where io_uring is
+ * not available, requests are performed by a task pool instead.
+ * @file ucommon/asyncio.h
+ */
+
+#ifndef _UCOMMON_ASYNCIO_H_
+#define _UCOMMON_ASYNCIO_H_
+
+#ifndef _UCOMMON_TASKS_H_
+#include <ucommon/tasks.h>
+#endif
+
+#ifndef _UCOMMON_FSYS_H_
+#include <ucommon/fsys.h>
+#endif
+
+#ifndef _UCOMMON_SOCKET_H_
+#include <ucommon/socket.h>
+#endif
+
+namespace ucommon {
+
+/**
+ * An asynchronous i/o engine.  Operations are prepared against request
+ * objects and are held until flush is called, or until the submission
+ * queue fills, so that many operations are passed to the kernel at once.
+ * An operation may be linked to the one prepared after it, in which case
+ * the next only starts once this one fully succeeds, and is cancelled
+ * otherwise.  Buffers and descriptors may be registered with the engine,
+ * and are then used through the kernel's fixed buffer and file tables
+ * automatically.  Completions are delivered from an engine thread.  All
+ * methods may be called from any thread.
+ */
+class __EXPORT AsyncIO : protected Conditional
+{
+private:
+    __DELETE_COPY(AsyncIO);
+
+    class __LOCAL ring;
+    class __LOCAL reaper;
+    class __LOCAL job;
+
+    friend class reaper;
+    friend class job;
+
+public:
+    /**
+     * An asynchronous i/o request.  The request holds the operation while
+     * it is in progress, and its result once complete.  A derived class
+     * may implement completed to receive a callback from the engine
+     * thread.  A detached request is deleted by the engine once its
+     * callback returns, and hence cannot be waited on.  The buffer and
+     * address an operation uses must remain valid until it completes.
+     */
+    class __EXPORT request : public OrderedObject
+    {
+    private:
+        friend class AsyncIO;
+
+        volatile atomic_t state;
+        AsyncIO *owner;
+        ssize_t status;
+        unsigned opcode, options;
+        intptr_t fd;
+        caddr_t data;
+        size_t size;
+        fsys::offset_t offset;
+        struct sockaddr *address;
+        socklen_t addrlen;
+        int flags;
+        bool detached;
+        request *before, *after;
+
+        __DELETE_COPY(request);
+
+    protected:
+        /**
+         * Create a request.
+         * @param detached if deleted by the engine when completed.
+         */
+        request(bool detached = false);
+
+        /**
+         * Called from the engine thread when the operation completes.
+         * The result is already set when this is called.
+         */
+        virtual void completed(void);
+
+    public:
+        virtual ~request();
+
+        /**
+         * Test if request has completed.
+         * @return true if completed.
+         */
+        bool is_done(void) const;
+
+        /**
+         * Wait for the request to complete.  Any operations still held
+         * for submission are flushed first.
+         * @param timeout to wait in milliseconds.
+         * @return true if completed, false if timed out or never queued.
+         */
+        bool wait(timeout_t timeout = Timer::inf);
+
+        /**
+         * Get the result of a completed operation.  This is the number of
+         * bytes transferred, the descriptor of an accepted connection, or
+         * 0 for sync and connect.  Failures are the negative error number.
+         * @return operation result.
+         */
+        inline ssize_t result(void) const {
+            return status;
+        }
+
+        inline operator bool() const {
+            return is_done();
+        }
+
+        inline bool operator!() const {
+            return !is_done();
+        }
+    };
+
+protected:
+    ring *uring;
+    reaper *thread;
+    TaskPool *pool;
+    OrderedIndex queued;
+    ConditionVar finished;
+    volatile atomic_t waiting;
+    volatile atomic_t inflight;
+    volatile atomic_t stopping;
+    request *active;
+    caddr_t buffer;
+    size_t bufsize;
+    unsigned bufcount;
+    fd_t *filelist;
+    unsigned filecount;
+
+    /**
+     * Queue a prepared request for submission.  A chain is never split
+     * to make room in a full queue, so if the queue holds nothing but the
+     * chain the request fails and the chain ends at the request before.
+     * @param item to queue.
+     * @param linked if next request depends on this one.
+     * @return true if queued.
+     */
+    bool submit(request *item, bool linked);
+
+    /**
+     * Remove a request from those in flight.
+     * @param item that completed.
+     */
+    void retire(request *item);
+
+    /**
+     * Complete a request from the engine.
+     * @param item that completed.
+     * @param result of operation.
+     */
+    void complete(request *item, ssize_t result);
+
+public:
+    /**
+     * Create an asynchronous i/o engine.
+     * @param entries in the submission queue, rounded to power of 2.
+     * @param threads for task pool emulation, or 0 for one per processor.
+     * @param emulated to always use task pool emulation.
+     */
+    AsyncIO(unsigned entries = 256, unsigned threads = 0, bool emulated = false);
+
+    /**
+     * Stop the engine.  Queued requests are flushed.  With io_uring,
+     * requests still in progress are cancelled, and the engine waits for
+     * all of them to complete, so their callbacks run and detached
+     * requests are deleted.  Emulated socket requests still waiting for
+     * their socket are cancelled, and other emulated requests are run to
+     * completion.
+     */
+    virtual ~AsyncIO();
+
+    /**
+     * Read from a file.
+     * @param item to hold request.
+     * @param fd to read from.
+     * @param data buffer to read into.
+     * @param size of buffer.
+     * @param offset in file, or -1 for current position.
+     * @param linked if next request depends on this one.
+     * @return true if queued.
+     */
+    bool read(request *item, fd_t fd, void *data, size_t size, fsys::offset_t offset = -1, bool linked = false);
+
+    /**
+     * Write to a file.
+     * @param item to hold request.
+     * @param fd to write to.
+     * @param data buffer to write from.
+     * @param size of buffer.
+     * @param offset in file, or -1 for current position.
+     * @param linked if next request depends on this one.
+     * @return true if queued.
+     */
+    bool write(request *item, fd_t fd, const void *data, size_t size, fsys::offset_t offset = -1, bool linked = false);
+
+    /**
+     * Commit a file to the filesystem.
+     * @param item to hold request.
+     * @param fd to sync.
+     * @param linked if next request depends on this one.
+     * @return true if queued.
+     */
+    bool sync(request *item, fd_t fd, bool linked = false);
+
+    /**
+     * Receive from a socket.
+     * @param item to hold request.
+     * @param so to receive from.
+     * @param data buffer to receive into.
+     * @param size of buffer.
+     * @param flags for receive.
+     * @param linked if next request depends on this one.
+     * @return true if queued.
+     */
+    bool recv(request *item, socket_t so, void *data, size_t size, int flags = 0, bool linked = false);
+
+    /**
+     * Send to a connected socket.
+     * @param item to hold request.
+     * @param so to send to.
+     * @param data buffer to send from.
+     * @param size of buffer.
+     * @param flags for send.
+     * @param linked if next request depends on this one.
+     * @return true if queued.
+     */
+    bool send(request *item, socket_t so, const void *data, size_t size, int flags = 0, bool linked = false);
+
+    /**
+     * Accept a connection from a listening socket.
+     * @param item to hold request.
+     * @param so to accept from.
+     * @param address of peer to save, or NULL.
+     * @param linked if next request depends on this one.
+     * @return true if queued.
+     */
+    bool accept(request *item, socket_t so, struct sockaddr_storage *address = NULL, bool linked = false);
+
+    /**
+     * Connect a socket.
+     * @param item to hold request.
+     * @param so to connect.
+     * @param address to connect to.
+     * @param linked if next request depends on this one.
+     * @return true if queued.
+     */
+    bool connect(request *item, socket_t so, const struct sockaddr *address, bool linked = false);
+
+    inline bool read(request *item, fsys& file, void *data, size_t size, fsys::offset_t offset = -1, bool linked = false) {
+        return read(item, *file, data, size, offset, linked);
+    }
+
+    inline bool write(request *item, fsys& file, const void *data, size_t size, fsys::offset_t offset = -1, bool linked = false) {
+        return write(item, *file, data, size, offset, linked);
+    }
+
+    inline bool sync(request *item, fsys& file, bool linked = false) {
+        return sync(item, *file, linked);
+    }
+
+    inline bool recv(request *item, Socket& socket, void *data, size_t size, int flags = 0, bool linked = false) {
+        return recv(item, (socket_t)socket, data, size, flags, linked);
+    }
+
+    inline bool send(request *item, Socket& socket, const void *data, size_t size, int flags = 0, bool linked = false) {
+        return send(item, (socket_t)socket, data, size, flags, linked);
+    }
+
+    inline bool accept(request *item, ListenSocket& socket, struct sockaddr_storage *address = NULL, bool linked = false) {
+        return accept(item, (socket_t)socket, address, linked);
+    }
+
+    inline bool connect(request *item, Socket& socket, const struct sockaddr *address, bool linked = false) {
+        return connect(item, (socket_t)socket, address, linked);
+    }
+
+    /**
+     * Submit all queued requests as a batch.
+     */
+    void flush(void);
+
+    /**
+     * Register a set of equal sized buffers with the kernel.  Reads and
+     * writes that fall within one of these buffers then use it without
+     * the kernel mapping pages for each operation.  Registration is
+     * replaced by each call, and removed when count is 0.  This should
+     * only be changed while no requests are outstanding.
+     * @param base of first buffer.
+     * @param size of each buffer.
+     * @param count of buffers.
+     * @return true if registered or emulated.
+     */
+    bool buffers(void *base, size_t size, unsigned count = 1);
+
+    /**
+     * Register descriptors with the kernel.  Operations on these files or
+     * sockets then avoid looking up the descriptor for each operation.
+     * Registration is replaced by each call, and removed when count is 0.
+     * This should only be changed while no requests are outstanding.
+     * @param list of descriptors.
+     * @param count of descriptors.
+     * @return true if registered or emulated.
+     */
+    bool files(const fd_t *list, unsigned count);
+
+    /**
+     * Test if the engine uses native io_uring support.
+     * @return true if io_uring is used.
+     */
+    inline bool is_native(void) const {
+        return uring != NULL;
+    }
+};
+
+/**
+ * Convenience type for asynchronous i/o requests.
+ */
+typedef AsyncIO::request AsyncRequest;
+
+/**
+ * Convenience type for asynchronous i/o engines.
+ */
+typedef AsyncIO asyncio_t;
+
+} // namespace ucommon
+
+#endif
@@ -91,6 +91,33 @@ public:
         }
     };
 
+    /**
+     * Exponential spin backoff.  Each call pauses the processor for twice
+     * as long as the last, up to a limit, after which the thread yields.
+     * This is used by spinning locks so that waiting threads do not flood
+     * the lock word's cache line.
+     */
+    class __EXPORT backoff
+    {
+    private:
+        unsigned spins;
+
+    public:
+        inline backoff() : spins(1) {}
+
+        /**
+         * Wait for the next backoff interval.
+         */
+        void operator()(void);
+
+        /**
+         * Restart from the shortest interval.
+         */
+        inline void reset(void) {
+            spins = 1;
+        }
+    };
+
     /**
      * Atomic spinlock class.  Used as high-performance sync lock between
      * threads.
@@ -171,7 +198,375 @@ public:
         }
     };
 
+    /**
+     * Cache line padded object.  The object is placed on a cache line
+     * boundary, and its storage is rounded up to whole cache lines as found
+     * from Thread::cache(), so no other object can share its lines.  This
+     * is used to keep hot per-thread or per-core data from false sharing.
+     */
+    template<typename T>
+    class padded : public Aligned
+    {
+    protected:
+        inline T* get() const {
+            return static_cast<T*>(address);
+        }
+
+    public:
+        inline padded() : Aligned(padding(sizeof(T))) {
+            new((caddr_t)address) T;
+        }
+
+        inline ~padded() {
+            get()->~T();
+        }
+
+        inline T& operator*() const {
+            return *get();
+        }
+
+        inline T* operator->() const {
+            return get();
+        }
+
+        inline operator T&() {
+            return *get();
+        }
+
+        inline void operator()(T value) {
+            *get() = value;
+        }
+    };
+
+    /**
+     * Sharded statistics counter.  Each thread adds into its own cache line
+     * padded shard, so increments from many cores do not contend for one
+     * line.  Reading the counter sums every shard, so reads are slower and
+     * are not an atomic snapshot of concurrent updates.
+     */
+    class __EXPORT sharded
+    {
+    private:
+        void *memory;
+        volatile int64_t *cells;
+        unsigned stride, mask;
+
+        __DELETE_COPY(sharded);
+
+    public:
+        /**
+         * Construct sharded counter.
+         * @param shards to use, or 0 for one per processor.
+         */
+        sharded(unsigned shards = 0);
+
+        ~sharded();
+
+        /**
+         * Add to the shard of the current thread.
+         * @param offset to add.
+         */
+        void add(int64_t offset = 1);
+
+        /**
+         * Sum all shards.
+         * @return current total.
+         */
+        int64_t get(void) const;
+
+        /**
+         * Reset all shards to zero.
+         */
+        void clear(void);
+
+        inline void operator++() {
+            add(1);
+        }
+
+        inline void operator--() {
+            add(-1);
+        }
+
+        inline void operator+=(int64_t offset) {
+            add(offset);
+        }
+
+        inline void operator-=(int64_t offset) {
+            add(-offset);
+        }
+
+        inline operator int64_t() const {
+            return get();
+        }
+
+        inline int64_t operator*() const {
+            return get();
+        }
+    };
+
+    /**
+     * Round an object size up to whole cache lines.
+     * @param size of object.
+     * @return padded size.
+     */
+    static size_t padding(size_t size);
+
     static bool is_lockfree(void);
+
+    /**
+     * Hint to the processor that we are in a spin wait loop.
+     */
+    inline static void pause(void) {
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+        __builtin_ia32_pause();
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__arm__))
+        __asm__ __volatile__("yield" ::: "memory");
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+        _mm_pause();
+#endif
+    }
+
+#if defined(__GNUC_PREREQ__) && (__GNUC_PREREQ__(4, 7) || defined(__clang__)) && !defined(sparc)
+    /**
+     * Atomically load a value shared between threads.  This is an acquire
+     * operation, so memory written before a matching store is visible.
+     * @param pointer to shared value.
+     * @return current value.
+     */
+    template<typename T>
+    inline static T load(const volatile T *pointer) {
+        return __atomic_load_n(pointer, __ATOMIC_ACQUIRE);
+    }
+
+    /**
+     * Atomically store a value shared between threads.  This is a release
+     * operation, so prior memory writes are visible to a matching load.
+     * @param pointer to shared value.
+     * @param value to store.
+     */
+    template<typename T>
+    inline static void store(volatile T *pointer, T value) {
+        __atomic_store_n(pointer, value, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Atomically exchange a shared value.
+     * @param pointer to shared value.
+     * @param value to store.
+     * @return previous value.
+     */
+    template<typename T>
+    inline static T exchange(volatile T *pointer, T value) {
+        return __atomic_exchange_n(pointer, value, __ATOMIC_SEQ_CST);
+    }
+
+    /**
+     * Atomically compare and swap a shared value.  If the shared value is
+     * not what was expected, expected is updated with the current value.
+     * @param pointer to shared value.
+     * @param expected value, updated if compare fails.
+     * @param value to store if the compare succeeds.
+     * @return true if swapped.
+     */
+    template<typename T>
+    inline static bool compare_exchange(volatile T *pointer, T& expected, T value) {
+        return __atomic_compare_exchange_n(pointer, &expected, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+
+    /**
+     * Atomically add to a shared integer value.
+     * @param pointer to shared value.
+     * @param offset to add.
+     * @return previous value.
+     */
+    template<typename T>
+    inline static T fetch_add(volatile T *pointer, T offset) {
+        return __atomic_fetch_add(pointer, offset, __ATOMIC_SEQ_CST);
+    }
+
+    /**
+     * Full memory barrier between threads.
+     */
+    inline static void fence(void) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    /**
+     * Acquire memory barrier.  Loads before the barrier complete before
+     * any loads or stores after it.  This is lighter than a full fence,
+     * and is for readers that must not write shared memory.
+     */
+    inline static void fence_acquire(void) {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+#else
+private:
+    static void _lock(const volatile void *pointer);
+    static void _unlock(const volatile void *pointer);
+
+public:
+    template<typename T>
+    inline static T load(const volatile T *pointer) {
+        _lock(pointer);
+        T value = *pointer;
+        _unlock(pointer);
+        return value;
+    }
+
+    template<typename T>
+    inline static void store(volatile T *pointer, T value) {
+        _lock(pointer);
+        *pointer = value;
+        _unlock(pointer);
+    }
+
+    template<typename T>
+    inline static T exchange(volatile T *pointer, T value) {
+        _lock(pointer);
+        T prior = *pointer;
+        *pointer = value;
+        _unlock(pointer);
+        return prior;
+    }
+
+    template<typename T>
+    inline static bool compare_exchange(volatile T *pointer, T& expected, T value) {
+        bool result = false;
+        _lock(pointer);
+        if(*pointer == expected) {
+            *pointer = value;
+            result = true;
+        }
+        else
+            expected = *pointer;
+        _unlock(pointer);
+        return result;
+    }
+
+    template<typename T>
+    inline static T fetch_add(volatile T *pointer, T offset) {
+        _lock(pointer);
+        T prior = *pointer;
+        *pointer = prior + offset;
+        _unlock(pointer);
+        return prior;
+    }
+
+    static void fence(void);
+
+    inline static void fence_acquire(void) {
+        fence();
+    }
+#endif
+};
+
+/**
+ * Sequence lock for small read-mostly records.  Writers are serialized by
+ * a spinlock, and bump a sequence count before and after they change the
+ * record, so it is odd while a write is in progress.  Readers copy the
+ * record optimistically and retry if the sequence changed, so they never
+ * write shared memory and never block writers.  This suits hot scalar
+ * state such as timestamps, Timer and DateTime values, or rate limits.
+ * The record type must be copyable, and its copy must not follow
+ * pointers that a writer may free, since readers may copy a torn record
+ * before discarding it.
+ */
+template<typename T>
+class seqlock
+{
+private:
+    mutable volatile atomic_t sequence;
+    Atomic::spinlock writer;
+    T data;
+
+    __DELETE_COPY(seqlock);
+
+public:
+    inline seqlock() : sequence(0), data() {}
+
+    inline seqlock(const T& initial) : sequence(0), data(initial) {}
+
+    /**
+     * Copy the current record into existing storage.  This retries while a
+     * write is in progress or if a write completed during the copy.  This
+     * is cheaper than get() for types like DateTime whose constructors do
+     * real work.
+     * @param copy to assign record to.
+     */
+    void get(T& copy) const {
+        for(;;) {
+            atomic_t before = Atomic::load(&sequence);
+            if(before & 1) {
+                Atomic::pause();
+                continue;
+            }
+            copy = data;
+            Atomic::fence_acquire();
+            if(Atomic::load(&sequence) == before)
+                return;
+        }
+    }
+
+    /**
+     * Copy the current record.
+     * @return consistent copy of record.
+     */
+    T get(void) const {
+        for(;;) {
+            atomic_t before = Atomic::load(&sequence);
+            if(before & 1) {
+                Atomic::pause();
+                continue;
+            }
+            T copy(data);
+            Atomic::fence_acquire();
+            if(Atomic::load(&sequence) == before)
+                return copy;
+        }
+    }
+
+    /**
+     * Begin changing the record in place.  Writers are serialized, and
+     * readers retry until commit is called.
+     * @return reference to record to change.
+     */
+    T& modify(void) {
+        writer.wait();
+        Atomic::fetch_add(&sequence, (atomic_t)1);
+        // odd sequence must be visible before any store to the record...
+        Atomic::fence();
+        return data;
+    }
+
+    /**
+     * Publish a change made through modify.
+     */
+    void commit(void) {
+        Atomic::store(&sequence, (atomic_t)(sequence + 1));
+        writer.release();
+    }
+
+    /**
+     * Replace the record.
+     * @param value to store.
+     */
+    inline void set(const T& value) {
+        modify() = value;
+        commit();
+    }
+
+    inline T operator*() const {
+        return get();
+    }
+
+    inline operator T() const {
+        return get();
+    }
+
+    inline seqlock& operator=(const T& value) {
+        set(value);
+        return *this;
+    }
 };
 
 } // namespace ucommon
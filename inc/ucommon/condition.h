@@ -50,6 +50,10 @@
 #include <ucommon/memory.h>
 #endif
 
+#ifndef _UCOMMON_ATOMIC_H_
+#include <ucommon/atomic.h>
+#endif
+
 namespace ucommon {
 
 /**
@@ -252,6 +256,24 @@ protected:
 
     friend class TimedEvent;
 
+    /**
+     * Park the calling thread on a futex word while it still holds an
+     * expected value.  This is only used where futexes are supported, and
+     * may return early, so callers must recheck their own state.
+     * @param word to park on.
+     * @param value expected in word.
+     * @param deadline to wait until, or NULL to wait forever.
+     * @return false if deadline expired.
+     */
+    __LOCAL static bool park(volatile atomic_t *word, atomic_t value, struct timespec *deadline = NULL);
+
+    /**
+     * Wake threads parked on a futex word.
+     * @param word threads are parked on.
+     * @param count of threads to wake.
+     */
+    __LOCAL static void unpark(volatile atomic_t *word, unsigned count = 1);
+
     /**
      * Conditional wait for signal on millisecond timeout.
      * @param timeout in milliseconds.
@@ -573,6 +595,172 @@ public:
     virtual void share(void);
 };
 
+/**
+ * A reader biased conditional lock.  This may be used instead of a
+ * conditional lock for read-mostly data, such as through a shared lock.
+ * Readers only update a reader counter that is striped by thread and
+ * padded to a cache line, and never touch the lock mutex unless a writer
+ * has declared intent to modify.  Writers declare intent and then wait for
+ * the reader counters to drain.  Recursive sharing by a thread, and
+ * conversion between shared and exclusive access, behave the same as for
+ * the conditional lock.
+ */
+class __EXPORT BiasedLock : protected ConditionalAccess, public __PROTOCOL SharedProtocol
+{
+private:
+    __DELETE_COPY(BiasedLock);
+
+protected:
+    volatile atomic_t intent;
+    volatile atomic_t *readers;
+    void *counters;
+    unsigned stride, mask;
+
+    virtual void _share(void) __OVERRIDE;
+    virtual void _unshare(void) __OVERRIDE;
+
+    /**
+     * Wait with the lock held until reader counters drain.
+     */
+    void drain(void);
+
+    /**
+     * Wake the next writer, or waiting readers if no writers remain.
+     */
+    void resume(void);
+
+public:
+    /**
+     * Construct reader biased lock.
+     * @param slots of reader counters, or 0 for one per processor.
+     */
+    BiasedLock(unsigned slots = 0);
+
+    /**
+     * Destroy reader biased lock.
+     */
+    ~BiasedLock();
+
+    /**
+     * Acquire write (exclusive modify) lock.
+     */
+    void modify(void);
+
+    /**
+     * Commit changes / release a modify lock.
+     */
+    void commit(void);
+
+    /**
+     * Acquire access (shared read) lock.
+     */
+    void access(void);
+
+    /**
+     * Release a shared lock.
+     */
+    void release(void);
+
+    /**
+     * Convert read lock into exclusive (write/modify) access.
+     */
+    virtual void exclusive(void) __OVERRIDE;
+
+    /**
+     * Return an exclusive access lock back to share mode.
+     */
+    virtual void share(void) __OVERRIDE;
+};
+
+/**
+ * A shared lock selected when it is created, which is either a conditional
+ * lock or a reader biased lock.  This lets a container choose the locking
+ * used for its data while both locks keep their own interfaces.  The
+ * shared lock only refers to the selected lock, which is owned elsewhere.
+ */
+class __EXPORT SharedLock
+{
+private:
+    ConditionalLock *conditional;
+    BiasedLock *bias;
+
+public:
+    /**
+     * Create an empty shared lock.
+     */
+    inline SharedLock() : conditional(NULL), bias(NULL) {}
+
+    /**
+     * Select a conditional lock.
+     * @param lock to use.
+     */
+    inline SharedLock(ConditionalLock *lock) : conditional(lock), bias(NULL) {}
+
+    /**
+     * Select a reader biased lock.
+     * @param lock to use.
+     */
+    inline SharedLock(BiasedLock *lock) : conditional(NULL), bias(lock) {}
+
+    /**
+     * Get the conditional lock selected.
+     * @return conditional lock or NULL if biased.
+     */
+    inline ConditionalLock *get(void) const {
+        return conditional;
+    }
+
+    /**
+     * Get the reader biased lock selected.
+     * @return biased lock or NULL if conditional.
+     */
+    inline BiasedLock *biased(void) const {
+        return bias;
+    }
+
+    inline void modify(void) {
+        if(bias)
+            bias->modify();
+        else
+            conditional->modify();
+    }
+
+    inline void commit(void) {
+        if(bias)
+            bias->commit();
+        else
+            conditional->commit();
+    }
+
+    inline void access(void) {
+        if(bias)
+            bias->access();
+        else
+            conditional->access();
+    }
+
+    inline void release(void) {
+        if(bias)
+            bias->release();
+        else
+            conditional->release();
+    }
+
+    inline void exclusive(void) {
+        if(bias)
+            bias->exclusive();
+        else
+            conditional->exclusive();
+    }
+
+    inline void share(void) {
+        if(bias)
+            bias->share();
+        else
+            conditional->share();
+    }
+};
+
 /**
  * A portable implementation of "barrier" thread sychronization.  A barrier
  * waits until a specified number of threads have all reached the barrier,
@@ -582,7 +770,9 @@ public:
  * required can be changed dynamically at runtime, unlike pthread barriers
  * which, when supported, have a fixed limit defined at creation time.  Since
  * we use conditionals, another feature we can add is optional support for a
- * wait with timeout.
+ * wait with timeout.  Where futexes are available, arrivals are counted in
+ * a single atomic word, and only threads that must block enter the kernel.
+ * This limits a barrier to 65535 waiting threads.
  * @author David Sugar <dyfet@gnutelephony.org>
  */
 class __EXPORT Barrier : private Conditional
@@ -590,6 +780,10 @@ class __EXPORT Barrier : private Conditional
 private:
     unsigned count;
     unsigned waits;
+    volatile atomic_t state;
+
+    __LOCAL bool trip(void);
+    __LOCAL bool arrive(struct timespec *deadline);
 
     __DELETE_DEFAULTS(Barrier);
 
@@ -649,11 +843,17 @@ public:
  * to pass through it until the count is reached, and blocks further threads.
  * Unlike pthread semaphore, our semaphore class supports it's count limit
  * to be altered during runtime and the use of timed waits.  This class also
- * implements the shared_lock protocol.
+ * implements the shared_lock protocol.  Where futexes are available, an
+ * uncontended wait or release is a single atomic operation.
  * @author David Sugar <dyfet@gnutelephony.org>
  */
 class __EXPORT Semaphore : public __PROTOCOL SharedProtocol, protected Conditional
 {
+private:
+    volatile atomic_t sequence;
+
+    __LOCAL bool claim(struct timespec *deadline);
+
 protected:
     unsigned count, waits, used;
 
@@ -724,6 +924,16 @@ public:
  */
 typedef ConditionalLock condlock_t;
 
+/**
+ * Convenience type for using reader biased locks.
+ */
+typedef BiasedLock biasedlock_t;
+
+/**
+ * Convenience type for selecting between conditional and biased locks.
+ */
+typedef SharedLock sharedlock_t;
+
 /**
  * Convenience type for scheduling access.
  */
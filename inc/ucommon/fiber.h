@@ -0,0 +1,250 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Stackful fibers and a per-thread fiber scheduler.  Each fiber runs on
+ * its own small stack, and the scheduler switches between them from a
+ * socket event reactor.  Socket operations performed from within a fiber
+ * suspend only that fiber while the descriptor is not ready, so ordinary
+ * blocking style stream code can service many thousands of concurrent
+ * sessions from a few threads.
+ * @file ucommon/fiber.h
+ */
+
+#ifndef _UCOMMON_FIBER_H_
+#define _UCOMMON_FIBER_H_
+
+#ifndef _UCOMMON_REACTOR_H_
+#include <ucommon/reactor.h>
+#endif
+
+namespace ucommon {
+
+/**
+ * A cooperative fiber scheduler.  The scheduler is a reactor that also
+ * owns a run queue of fibers.  Fibers are resumed in turn from the thread
+ * that runs the scheduler, and a fiber that waits on a socket or sleeps is
+ * suspended until the reactor reports the socket ready or the timer
+ * expires.  Fiber stacks are allocated with a guard page where the
+ * platform permits, and idle stacks are kept in a pool for reuse.  All
+ * scheduler methods other than stop and notify must be called from the
+ * thread that runs it.  Socket, tcpstream, and ListenSocket operations
+ * automatically use the scheduler when invoked from within a fiber.
+ */
+class __EXPORT Scheduler : public Reactor
+{
+private:
+    __DELETE_COPY(Scheduler);
+
+    class __LOCAL frame;
+    class __LOCAL clock;
+
+    __LOCAL frame *create(size_t size);
+    __LOCAL void destroy(frame *fp);
+    __LOCAL static void entry(void);
+
+public:
+    /**
+     * A fiber of execution.  A derived class implements the run method,
+     * which executes on the fiber's own stack once started by a scheduler.
+     * A detached fiber is deleted by the scheduler when it completes.
+     */
+    class __EXPORT fiber
+    {
+    private:
+        friend class Scheduler;
+
+        Scheduler *owner;
+        fiber *next;
+        frame *context;
+        size_t stack;
+        bool detached, done, queued;
+
+        __DELETE_COPY(fiber);
+
+    protected:
+        /**
+         * Create a fiber.
+         * @param detached if deleted by the scheduler when completed.
+         * @param stack size to use, or 0 for scheduler default.
+         */
+        fiber(bool detached = false, size_t stack = 0);
+
+        /**
+         * Method to perform the work of the fiber on its own stack.
+         */
+        virtual void run(void) = 0;
+
+    public:
+        virtual ~fiber();
+
+        /**
+         * Test if fiber has completed.
+         * @return true if completed.
+         */
+        inline bool is_done(void) const {
+            return done;
+        }
+
+        /**
+         * Get the scheduler the fiber was started from.
+         * @return scheduler or NULL if never started.
+         */
+        inline Scheduler *scheduler(void) const {
+            return owner;
+        }
+
+        inline operator bool() const {
+            return done;
+        }
+
+        inline bool operator!() const {
+            return !done;
+        }
+    };
+
+protected:
+    fiber *executing;
+    fiber *first, *last;
+    frame *idle;
+    frame *waiting;
+    clock *clocks;
+    void *context;
+    size_t stacksize;
+    unsigned active, cached, stacks;
+
+    /**
+     * Queue a fiber to be resumed.
+     * @param item to make ready.
+     */
+    void ready(fiber *item);
+
+    /**
+     * Switch into a fiber until it suspends or completes.
+     * @param item to resume.
+     */
+    void resume(fiber *item);
+
+    /**
+     * Suspend the running fiber and return to the scheduler.
+     */
+    void suspend(void);
+
+public:
+    /**
+     * Create a fiber scheduler.
+     * @param stack size of fiber stacks, or 0 for default.
+     * @param stacks to keep pooled for reuse.
+     * @param maximum number of events collected per wait.
+     */
+    Scheduler(size_t stack = 0, unsigned stacks = 64, unsigned maximum = 64);
+
+    /**
+     * Destroy scheduler.  Fibers should have completed first, as pooled
+     * stacks are released.
+     */
+    virtual ~Scheduler();
+
+    /**
+     * Start a fiber.  The fiber is queued and first runs when the
+     * scheduler is run, or when the current fiber next suspends.
+     * @param item to start.
+     * @return true if started, false if no stack or no fiber support.
+     */
+    bool start(fiber *item);
+
+    /**
+     * Run fibers and reactor events until stopped, or until no fibers or
+     * socket handlers remain.
+     */
+    void run(void);
+
+    /**
+     * Get the number of fibers started and not yet completed.
+     * @return active fiber count.
+     */
+    inline unsigned fibers(void) const {
+        return active;
+    }
+
+    /**
+     * Convenience operator to start a fiber.
+     * @param item to start.
+     */
+    inline Scheduler& operator<<(fiber *item) {
+        start(item);
+        return *this;
+    }
+
+    /**
+     * Get the scheduler being run by the current thread.
+     * @return scheduler or NULL if none.
+     */
+    static Scheduler *current(void);
+
+    /**
+     * Get the fiber running in the current thread.
+     * @return fiber or NULL if not called from a fiber.
+     */
+    static fiber *self(void);
+
+    /**
+     * Let other ready fibers run before the current fiber continues.
+     */
+    static void yield(void);
+
+    /**
+     * Suspend the current fiber for a period of time.  Outside of a
+     * fiber this sleeps the calling thread instead.
+     * @param timeout to sleep in milliseconds.
+     */
+    static void sleep(timeout_t timeout);
+
+    /**
+     * Suspend the current fiber until a socket is ready.  This must be
+     * called from a fiber.  Several fibers may wait on the same socket,
+     * such as a reader and a writer of one connection.  A socket that is
+     * attached to the scheduler by a handler of its own cannot be waited
+     * on, and 0 is returned with errno set to EEXIST.
+     * @param socket descriptor to wait on.
+     * @param events to wait for, Reactor::READABLE and/or WRITABLE.
+     * @param timeout to wait in milliseconds.
+     * @return events that are ready, or 0 if timed out or not waited on.
+     */
+    static unsigned wait(socket_t socket, unsigned events, timeout_t timeout = Timer::inf);
+
+    /**
+     * Test if fibers are supported on this platform.
+     * @return true if fibers can be started.
+     */
+    static bool is_supported(void);
+};
+
+/**
+ * Convenience type for fibers.
+ */
+typedef Scheduler::fiber Fiber;
+
+/**
+ * Convenience type for fiber schedulers.
+ */
+typedef Scheduler scheduler_t;
+
+} // namespace ucommon
+
+#endif
@@ -0,0 +1,406 @@
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Flat open addressing hash maps.  Keys and values are stored inline in a
+ * single slot array, and a parallel array of one byte control tags is
+ * probed a group at a time, so most lookups touch one cache line of tags
+ * and one slot rather than chasing a chain of separately allocated nodes.
+ * Shared and exclusive locking is used based on lookup or modify operations.
+ * @file ucommon/flatmap.h
+ */
+
+#ifndef _UCOMMON_FLATMAP_H_
+#define _UCOMMON_FLATMAP_H_
+
+#ifndef _UCOMMON_CPR_H_
+#include <ucommon/cpr.h>
+#endif
+
+#ifndef _UCOMMON_TYPEREF_H_
+#include <ucommon/typeref.h>
+#endif
+
+#ifndef _UCOMMON_MAPREF_H_
+#include <ucommon/mapref.h>
+#endif
+
+#ifndef _UCOMMON_CONDITION_H_
+#include <ucommon/condition.h>
+#endif
+
+namespace ucommon {
+
+/**
+ * Untyped base of the flat hash map.  This manages the control tags, the
+ * slot array, group probing, and growth.  Each slot begins with the full
+ * hash of its key, so slots can be re-homed on growth without knowing
+ * their type.  The typed template supplies how slots are moved and
+ * destroyed.
+ */
+class __EXPORT FlatMap
+{
+private:
+    __DELETE_COPY(FlatMap);
+
+protected:
+    /**
+     * Width of a probe group of control tags.
+     */
+    static const size_t group = 16;
+
+    sharedlock_t lock;
+    bool owned;
+
+    uint8_t *control;
+    caddr_t slots;
+    size_t slotsize, capacity, used, deleted;
+
+    FlatMap(size_t size, size_t initial = 0, condlock_t *locking = NULL, bool biased = false);
+
+    virtual ~FlatMap();
+
+    /**
+     * Move a slot into uninitialized storage and destroy the original.
+     * @param target slot to construct.
+     * @param source slot to move from.
+     */
+    virtual void relocate(caddr_t target, caddr_t source) = 0;
+
+    /**
+     * Destroy the key and value held in a slot.
+     * @param slot to destroy.
+     */
+    virtual void destroy(caddr_t slot) = 0;
+
+    /**
+     * Match a tag against a probe group.
+     * @param offset of group in control tags.
+     * @param tag to match.
+     * @return bitmask of matching positions in the group.
+     */
+    unsigned match(size_t offset, uint8_t tag) const;
+
+    /**
+     * Find empty positions in a probe group.
+     * @param offset of group in control tags.
+     * @return bitmask of empty positions in the group.
+     */
+    unsigned empty(size_t offset) const;
+
+    /**
+     * Find a free position to insert a hash into.  The table is grown
+     * first if needed.
+     * @param hash of key to insert.
+     * @return slot position to use.
+     */
+    size_t insert(size_t hash);
+
+    /**
+     * Set the control tag for a slot position.
+     * @param position of slot.
+     * @param tag to set.
+     */
+    void tag(size_t position, uint8_t tag);
+
+    /**
+     * Mark a slot deleted after its contents were destroyed.
+     * @param position of slot.
+     */
+    void erase(size_t position);
+
+    /**
+     * Rebuild the table into a new capacity.
+     * @param size of new table, a power of two.
+     */
+    void rehash(size_t size);
+
+    inline caddr_t slot(size_t position) const {
+        return slots + (position * slotsize);
+    }
+
+    inline static size_t hashof(caddr_t slot) {
+        return *(reinterpret_cast<size_t *>(slot));
+    }
+
+    inline static uint8_t tagof(size_t hash) {
+        return (uint8_t)(hash >> (sizeof(size_t) * 8 - 7));
+    }
+
+    inline static unsigned lowest(unsigned bits) {
+#ifdef  __GNUC__
+        return (unsigned)__builtin_ctz(bits);
+#else
+        unsigned pos = 0;
+        while(!(bits & 1)) {
+            bits >>= 1;
+            ++pos;
+        }
+        return pos;
+#endif
+    }
+
+    /**
+     * Acquire shared access to the map.
+     */
+    inline void access(void) {
+        lock.access();
+    }
+
+    /**
+     * Acquire exclusive access to modify the map.
+     */
+    inline void modify(void) {
+        lock.modify();
+    }
+
+    /**
+     * Release exclusive access.
+     */
+    inline void commit(void) {
+        lock.commit();
+    }
+
+    /**
+     * Release shared access.
+     */
+    inline void release(void) {
+        lock.release();
+    }
+
+public:
+    /**
+     * Number of entries in the map.
+     * @return count of entries.
+     */
+    inline size_t count(void) const {
+        return used;
+    }
+
+    /**
+     * Number of slots in the map.
+     * @return slot capacity.
+     */
+    inline size_t size(void) const {
+        return capacity;
+    }
+};
+
+/**
+ * Hash a key for a flat map.  This may be specialized for keys that hold
+ * pointers or padding.
+ * @param key to hash.
+ * @return hash of key.
+ */
+template<typename T>
+inline size_t flatmap_keypath(const T& key)
+{
+    size_t path = sizeof(T);
+    return MapRef::mixed(path, (const uint8_t *)&key, sizeof(T));
+}
+
+template<>
+inline size_t flatmap_keypath<const char *>(const char * const& key)
+{
+    size_t path = 1;
+    if(!key)
+        return 0;
+    return MapRef::mixed(path, (const uint8_t *)key, strlen(key));
+}
+
+/**
+ * Compare keys for a flat map.
+ * @param key1 to compare.
+ * @param key2 to compare.
+ * @return true if same key.
+ */
+template<typename T>
+inline bool flatmap_keyequal(const T& key1, const T& key2)
+{
+    return key1 == key2;
+}
+
+template<>
+inline bool flatmap_keyequal<const char *>(const char * const& key1, const char * const& key2)
+{
+    return eq(key1, key2);
+}
+
+/**
+ * A flat open addressing hash map of inline keys and values.  This is
+ * meant for hot read-mostly lookup tables.  Lookups take the shared lock,
+ * and get() returns a pointer to the stored value that remains valid until
+ * release() is called, as with mapped_pointer.  Keys may also be given as
+ * typeref objects.
+ */
+template<typename K, typename V>
+class flatmap : public FlatMap
+{
+private:
+    typedef struct {
+        size_t hash;
+        K key;
+        V value;
+    } entry;
+
+    void relocate(caddr_t target, caddr_t source) __FINAL {
+        entry *from = reinterpret_cast<entry *>(source);
+        entry *to = reinterpret_cast<entry *>(target);
+        to->hash = from->hash;
+        new((caddr_t)&to->key) K(from->key);
+        new((caddr_t)&to->value) V(from->value);
+        destroy(source);
+    }
+
+    void destroy(caddr_t slot) __FINAL {
+        entry *ep = reinterpret_cast<entry *>(slot);
+        ep->key.~K();
+        ep->value.~V();
+    }
+
+    entry *search(const K& key, size_t hash, size_t *position = NULL) {
+        size_t mask = capacity - 1;
+        size_t offset = hash & mask;
+        uint8_t id = tagof(hash);
+
+        for(size_t step = group; ; step += group) {
+            unsigned bits = match(offset, id);
+            while(bits) {
+                unsigned pos = lowest(bits);
+                size_t index = (offset + pos) & mask;
+                entry *ep = reinterpret_cast<entry *>(slot(index));
+                if(ep->hash == hash && flatmap_keyequal<K>(ep->key, key)) {
+                    if(position)
+                        *position = index;
+                    return ep;
+                }
+                bits &= bits - 1;
+            }
+            if(empty(offset) || step > capacity)
+                return NULL;
+            offset = (offset + step) & mask;
+        }
+    }
+
+public:
+    /**
+     * Create a flat map.
+     * @param initial capacity hint.
+     * @param locking to use, or NULL for an internal lock.
+     * @param biased to use a reader biased internal lock.
+     */
+    inline flatmap(size_t initial = 0, condlock_t *locking = NULL, bool biased = false) :
+    FlatMap(sizeof(entry), initial, locking, biased) {}
+
+    inline ~flatmap() {
+        for(size_t pos = 0; pos < capacity; ++pos) {
+            if(!(control[pos] & 0x80))
+                destroy(slot(pos));
+        }
+    }
+
+    /**
+     * Find a value and hold shared access while it is used.
+     * @param key to find.
+     * @return pointer to value, or NULL if not found.
+     */
+    const V *get(const K& key) {
+        access();
+        entry *ep = search(key, flatmap_keypath<K>(key));
+        if(!ep) {
+            FlatMap::release();
+            return nullptr;
+        }
+        return &ep->value;
+    }
+
+    inline const V *get(typeref<K>& key) {
+        return get(*key);
+    }
+
+    /**
+     * Release shared access held by a found value.
+     * @param object returned from get.
+     */
+    inline void release(const V *object) {
+        if(object)
+            FlatMap::release();
+    }
+
+    /**
+     * Test if a key is in the map.
+     * @param key to find.
+     * @return true if found.
+     */
+    bool find(const K& key) {
+        access();
+        bool result = (search(key, flatmap_keypath<K>(key)) != NULL);
+        FlatMap::release();
+        return result;
+    }
+
+    /**
+     * Set or replace the value for a key.
+     * @param key to set.
+     * @param value to store.
+     */
+    void set(const K& key, const V& value) {
+        size_t hash = flatmap_keypath<K>(key);
+        modify();
+        entry *ep = search(key, hash);
+        if(ep)
+            ep->value = value;
+        else {
+            size_t position = insert(hash);
+            ep = reinterpret_cast<entry *>(slot(position));
+            ep->hash = hash;
+            new((caddr_t)&ep->key) K(key);
+            new((caddr_t)&ep->value) V(value);
+            tag(position, tagof(hash));
+        }
+        commit();
+    }
+
+    inline void set(typeref<K>& key, const V& value) {
+        set(*key, value);
+    }
+
+    /**
+     * Remove a key from the map.
+     * @param key to remove.
+     * @return true if removed.
+     */
+    bool remove(const K& key) {
+        size_t position;
+        modify();
+        entry *ep = search(key, flatmap_keypath<K>(key), &position);
+        if(ep) {
+            destroy((caddr_t)ep);
+            erase(position);
+        }
+        commit();
+        return ep != NULL;
+    }
+
+    inline bool remove(typeref<K>& key) {
+        return remove(*key);
+    }
+};
+
+} // namespace ucommon
+
+#endif
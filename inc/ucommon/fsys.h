@@ -390,14 +390,49 @@ public:
     static int erase(const char *path);
 
     /**
-     * Copy a file.
+     * Copy a file.  The contents are copied with transfer, so the kernel
+     * moves the data directly where it can.
      * @param source file.
      * @param target file.
-     * @param size of buffer.
+     * @param size of buffer, no longer used.
      * @return error number or 0 on success.
      */
     static int copy(const char *source, const char *target, size_t size = 1024);
 
+    /**
+     * Transfer data between files.  Where supported the kernel copies the
+     * data, possibly by sharing extents, without it passing through user
+     * memory.  Otherwise it is copied through a large aligned buffer.  Data
+     * is read and written at the current position of each descriptor.
+     * @param target descriptor to write to.
+     * @param source descriptor to read from.
+     * @param size to transfer, or 0 for until end of file.
+     * @return bytes transferred, or -1 on error with errno set.
+     */
+    static ssize_t transfer(fd_t target, fd_t source, size_t size = 0);
+
+    /**
+     * Send data from a file to a connected socket.  Where supported the
+     * kernel sends directly from the page cache.  Data is read from the
+     * current file position.
+     * @param target socket to send to.
+     * @param source descriptor to read from.
+     * @param size to send, or 0 for until end of file.
+     * @return bytes sent, or -1 on error with errno set.
+     */
+    static ssize_t sendfile(socket_t target, fd_t source, size_t size = 0);
+
+    /**
+     * Receive data from a connected socket into a file.  Where supported
+     * the kernel splices the data through a pipe without it passing
+     * through user memory.  Data is written at the current file position.
+     * @param target descriptor to write to.
+     * @param source socket to receive from.
+     * @param size to receive, or 0 for until the peer closes.
+     * @return bytes received, or -1 on error with errno set.
+     */
+    static ssize_t recvfile(fd_t target, socket_t source, size_t size = 0);
+
     /**
      * Rename a file.
      * @param oldpath to rename from.
@@ -201,7 +201,7 @@ protected:
     MappedReuse(size_t osize);
 
     inline void create(const char *fname, unsigned count)
-        {MappedMemory::create(fname, count * objsize);}
+        {MappedMemory::create(fname, count * objsize); base = addr();}
 
 public:
     /**
@@ -57,6 +57,12 @@ namespace ucommon {
 
 class __EXPORT MapRef : public TypeRef
 {
+public:
+	/**
+	 * Hash function used to compute key paths.
+	 */
+	typedef size_t (*hash_t)(size_t& key, const uint8_t *addr, size_t len);
+
 protected:
 	class Map;
     class Instance;
@@ -74,6 +80,7 @@ protected:
 		Index();
 
 		Counted *key, *value;
+		size_t path;
 	};
 
 	class __EXPORT Map : public Counted
@@ -90,16 +97,50 @@ protected:
 		friend class MapRef;
 
 		memalloc pool;
-		condlock_t lock;
+		condlock_t locking;
+		sharedlock_t lock;
+		sharedlock_t *stripes;
+		unsigned ways;
+		Mutex guard;
+		volatile bool growing;
+		hash_t hashing;
 		LinkedObject *free, *last;
-		size_t count, alloc;
+		LinkedObject **table, **prior;
+		size_t count, alloc, limit, moved;
+		size_t *moving;
 
-		explicit Map(void *addr, size_t indexes, size_t paging = 0);
+		explicit Map(void *addr, size_t indexes, size_t paging = 0, bool biased = false, unsigned stripes = 0, hash_t hash = NULL);
 	
 		inline LinkedObject **get(void) {
 			return reinterpret_cast<LinkedObject **>(((caddr_t)(this)) + sizeof(Map));
 		}
 
+		/**
+		 * Spread a key path over the buckets with the hash of the map.
+		 * @param path of key.
+		 * @return path used to select buckets and stripes.
+		 */
+		size_t spread(size_t path) const;
+
+		LinkedObject **locate(size_t path);
+
+		LinkedObject *bucket(size_t offset);
+
+		size_t paths(void);
+
+		void grow(void);
+
+		void migrate(size_t offset);
+
+		void rehash(size_t buckets);
+
+		/**
+		 * Migrate prior buckets of one stripe, with that stripe held.
+		 * @param stripe to migrate.
+		 * @param buckets to migrate at most.
+		 */
+		void rehash(unsigned stripe, size_t buckets);
+
 		Index *create(size_t path);
 
 		Index *append();
@@ -109,6 +150,37 @@ protected:
 		LinkedObject *modify(size_t key = 0);
 
 		LinkedObject *access(size_t key = 0);
+
+		/**
+		 * Release exclusive access to the bucket of a key.  In striped
+		 * mode a growth deferred by create is completed here.
+		 * @param key path that was modified.
+		 */
+		void commit(size_t key = 0);
+
+		/**
+		 * Release shared access to the bucket of a key.
+		 * @param key path that was accessed.
+		 */
+		void unlock(size_t key = 0);
+
+		/**
+		 * Lock the whole map, taking every stripe in order.
+		 * @param exclusive access if true, else shared.
+		 */
+		void enter(bool exclusive = false);
+
+		/**
+		 * Unlock the whole map.
+		 * @param exclusive access if true, else shared.
+		 */
+		void leave(bool exclusive = false);
+
+		/**
+		 * Grow a striped map with all stripes held.  Each stripe then
+		 * migrates its own buckets as it is modified.
+		 */
+		void expand(void);
 	};
 
 	class __EXPORT Instance
@@ -156,13 +228,25 @@ protected:
 		}
 	};
 
-	MapRef(size_t paths, size_t paging = 0);
+	MapRef(size_t paths, size_t paging = 0, bool biased = false, unsigned stripes = 0, hash_t hash = NULL);
 	MapRef(const MapRef& copy);
 	MapRef();
 
 	void assign(TypeRef& key, TypeRef& value);
 
-	static Map *create(size_t paths, size_t paging = 0);
+	/**
+	 * Create a map.  A striped map has one lock per group of buckets
+	 * rather than a single map lock, so that writers to different buckets
+	 * may proceed in parallel.
+	 * @param paths of initial buckets.
+	 * @param paging size of index pool.
+	 * @param biased to use reader biased locks.
+	 * @param stripes of bucket locks, or 0 for a single lock.
+	 * @param hash to spread key paths over buckets, or NULL to use them
+	 * directly.
+	 * @return new map.
+	 */
+	static Map *create(size_t paths, size_t paging = 0, bool biased = false, unsigned stripes = 0, hash_t hash = NULL);
 
 	linked_pointer<Index> access(size_t keyvalue = 0);
 
@@ -176,9 +260,9 @@ protected:
 
 	void remove(Index *ind, size_t path = 0);
 
-	void release();
+	void release(size_t keyvalue = 0);
 
-	void commit();
+	void commit(size_t keyvalue = 0);
 
 public:
 	size_t count(void);
@@ -187,7 +271,23 @@ public:
 
 	void purge(void);
 
+	/**
+	 * Get load statistics for the map.  The load factor is the count of
+	 * entries divided by the number of buckets.
+	 * @param buckets in the map, including any still being rehashed.
+	 * @param chains that are not empty.
+	 * @param longest chain found.
+	 */
+	void statistics(size_t *buckets, size_t *chains = NULL, size_t *longest = NULL);
+
 	static size_t index(size_t& key, const uint8_t *addr, size_t len);
+
+	/**
+	 * Stronger hash a map may be created with to spread key paths over its
+	 * buckets, which mixes a word at a time through a folded 64 bit
+	 * multiply as in wyhash.
+	 */
+	static size_t mixed(size_t& key, const uint8_t *addr, size_t len);
 };
 
 template<typename T>
@@ -222,12 +322,12 @@ protected:
 			typeref<K> kv(ip->key);
 			if(is(kv) && kv == key) {
 				MapRef::remove(*ip, path);
-				MapRef::commit();
+				MapRef::commit(path);
 				return true;
 			}
 			ip.next();
 		}
-		MapRef::commit();
+		MapRef::commit(path);
 		return false;
 	}	
 
@@ -267,7 +367,7 @@ public:
 
 	inline mapref(const mapref& copy) : MapRef(copy) {};
 
-	inline mapref(size_t paths = 37, size_t paging = 0) : MapRef(paths, paging) {};
+	inline mapref(size_t paths = 37, size_t paging = 0, bool biased = false, unsigned stripes = 0, hash_t hash = NULL) : MapRef(paths, paging, biased, stripes, hash) {};
 
 	inline mapref& operator=(const mapref& copy) {
 		TypeRef::set(copy);
@@ -285,27 +385,28 @@ public:
 			typeref<K> kv(ip->key);
 			if(is(kv) && kv == key) {
 				update(*ip, val);
-				commit();
+				commit(path);
 				return;
 			}
 			ip.next();
 		}
 		add(path, key, val);
-		commit();
+		commit(path);
 	}
 
 	typeref<V> at(typeref<K>& key) {
-		linked_pointer<Index> ip = access(mapkeypath<K>(key));
+		size_t path = mapkeypath<K>(key);
+		linked_pointer<Index> ip = access(path);
 		while(is(ip)) {
 			typeref<K> kv(ip->key);
 			if(is(kv) && kv == key) {
 				typeref<V> result(ip->value);
-				release();
+				release(path);
 				return result;
 			}
 			ip.next();
 		}
-		release();
+		release(path);
 		return typeref<V>();
 	}	
 
@@ -318,12 +419,12 @@ public:
 				typeref<V> result(ip->value);
 				if(is(result.is))
 					MapRef::remove(*ip, path);
-				commit();
+				commit(path);
 				return result;
 			}
 			ip.next();
 		}
-		commit();
+		commit(path);
 		return typeref<V>();
 	}	
 
@@ -50,6 +50,7 @@
 namespace ucommon {
 
 class PagerPool;
+class slaballoc;
 
 /**
  * A memory protocol pager for private heap manager.  This is used to allocate
@@ -75,6 +76,7 @@ private:
     }   page_t;
 
     page_t *page;
+    slaballoc *slab;
 
 protected:
     unsigned limit;
@@ -143,6 +145,17 @@ public:
      */
     void purge(void);
 
+    /**
+     * Acquire pages from a shared slab allocator rather than the real
+     * heap.  Pages are then returned to the slab when purged, where they
+     * can be reused by other pagers, and the slab releases memory back to
+     * the system as its own pages empty.  This can only be changed while
+     * no pages are allocated.
+     * @param heap to acquire pages from or NULL for real heap.
+     * @return true if changed.
+     */
+    bool attach(slaballoc *heap);
+
 protected:
     /**
      * Allocate memory from the pager heap.  The size of the request must be
@@ -161,6 +174,183 @@ public:
     void assign(memalloc& source);
 };
 
+/**
+ * A size class slab allocator with individual free.  Requests are rounded
+ * up to a size class, with classes at each power of two and at quarter
+ * steps (1.25x) between them.  Each class allocates objects from pages
+ * that hold a free bitmap, so objects can be released individually, and
+ * a page is returned to the system once all its objects are free.  Each
+ * size class has its own lock.  Requests too large for a size class are
+ * allocated separately.  A slab may also be attached to memalloc based
+ * pagers, such as StringPager, ObjectPager, and keyfile, to supply and
+ * reclaim their pages.
+ */
+class __EXPORT slaballoc : public __PROTOCOL MemoryProtocol
+{
+public:
+    class sizeclass;
+
+private:
+    size_t pagesize, maximum;
+    unsigned classes;
+    sizeclass *index;
+    void *large;
+    mutable pthread_mutex_t mutex;
+
+    __DELETE_COPY(slaballoc);
+
+public:
+    /**
+     * Construct a slab allocator.
+     * @param pagesize of slab pages, rounded to a power of 2, or 0 for
+     * default of 64k.
+     */
+    slaballoc(size_t pagesize = 0);
+
+    /**
+     * Destroy slab allocator and release all pages to the system.
+     */
+    virtual ~slaballoc();
+
+    /**
+     * Return memory to the slab.  If the page the memory came from is
+     * now empty, it may be returned to the system.
+     * @param memory to release or NULL.
+     */
+    void dealloc(void *memory);
+
+    /**
+     * Release all pages at once.  Memory previously allocated becomes
+     * invalid.
+     */
+    void purge(void);
+
+    /**
+     * Get the number of pages held from the system.
+     * @return pages allocated.
+     */
+    unsigned pages(void) const;
+
+    /**
+     * Determine utilization (0-100) of slab pages, as the portion of the
+     * page memory held that is allocated to objects.
+     * @return slab utilization.
+     */
+    unsigned utilization(void) const;
+
+    /**
+     * Get the size of slab pages.
+     * @return page size.
+     */
+    inline size_t size(void) const {
+        return pagesize;
+    }
+
+    /**
+     * Get the size of the largest size class.  Larger requests are
+     * allocated separately from the system.
+     * @return largest size class.
+     */
+    inline size_t max(void) const {
+        return maximum;
+    }
+
+    /**
+     * Get the size class a request would be rounded up to.
+     * @param size of request.
+     * @return size class or 0 if allocated separately.
+     */
+    size_t fit(size_t size) const;
+
+protected:
+    /**
+     * Allocate memory from a slab size class.
+     * @param size of memory request.
+     * @return allocated memory or NULL if not possible.
+     */
+    virtual void *_alloc(size_t size) __OVERRIDE;
+};
+
+/**
+ * Per-thread magazine caches for a shared memory pool.  Each thread that
+ * uses the pool is given a small private magazine of memory, so most
+ * requests are served and returned without taking the lock of the shared
+ * pool.  Magazines are refilled from and drained back to the shared pool
+ * in batches, and are given up for reuse by other threads when a thread
+ * exits.  Hit and miss counters are kept per thread and summed when
+ * requested, so the hit rate can be monitored without adding contention.
+ */
+class __EXPORT MagazineCache
+{
+private:
+    friend class mempager;
+    friend class PagerPool;
+
+    __DELETE_COPY(MagazineCache);
+
+public:
+    class magazine;
+
+private:
+    magazine *list;
+    unsigned long serial;
+    unsigned depth;
+    volatile unsigned generation;
+    mutable pthread_mutex_t mutex;
+
+    magazine *get(void);
+
+    inline void invalidate(void) {
+        ++generation;
+    }
+
+public:
+    /**
+     * Create a magazine cache.
+     * @param depth of each magazine or 0 if disabled.
+     */
+    MagazineCache(unsigned depth = 0);
+
+    /**
+     * Release all magazines.  Magazines still held by other threads are
+     * released when those threads exit.
+     */
+    ~MagazineCache();
+
+    /**
+     * Set the depth of thread magazines.  This should be set before the
+     * pool is used by other threads.
+     * @param depth of each magazine or 0 to disable.
+     */
+    void set(unsigned depth);
+
+    /**
+     * Get the depth of thread magazines.
+     * @return magazine depth or 0 if disabled.
+     */
+    inline unsigned size(void) const {
+        return depth;
+    }
+
+    /**
+     * Get number of requests served from thread magazines.
+     * @return hit count.
+     */
+    unsigned long hits(void) const;
+
+    /**
+     * Get number of requests that had to use the shared pool.
+     * @return miss count.
+     */
+    unsigned long misses(void) const;
+
+    /**
+     * Get the percentage (0-100) of requests served from thread magazines.
+     * @return hit rate.
+     */
+    unsigned ratio(void) const;
+};
+
 /**
  * A managed private heap for small allocations.  This is used to allocate
  * a large number of small objects from a paged heap as needed and to then
@@ -185,6 +375,7 @@ class __EXPORT mempager : public memalloc, public __PROTOCOL LockingProtocol
 {
 private:
     mutable pthread_mutex_t mutex;
+    MagazineCache magazines;
 
 protected:
     /**
@@ -240,6 +431,25 @@ public:
      */
     virtual void dealloc(void *memory);
 
+    /**
+     * Enable per-thread caching of pager memory.  Each thread reserves
+     * space for a batch of requests at a time from the shared heap, and
+     * then allocates from that space without locking.  This should be set
+     * before the pager is shared between threads.
+     * @param depth of requests reserved per batch or 0 to disable.
+     */
+    inline void cache(unsigned depth) {
+        magazines.set(depth);
+    }
+
+    /**
+     * Get thread cache statistics for the pager.
+     * @return magazine cache of pager.
+     */
+    inline const MagazineCache& cached(void) const {
+        return magazines;
+    }
+
 protected:
     /**
      * Allocate memory from the pager heap.  The size of the request must be
@@ -334,6 +544,8 @@ protected:
     void *invalid(void) const;
 
 public:
+    using memalloc::attach;
+
     /**
      * Purge all members and release pager member.  The list can then
      * be added to again.
@@ -452,6 +664,8 @@ public:
 
     StringPager(char **list, size_t pagesize = 256);
 
+    using memalloc::attach;
+
     /**
      * Get the number of items in the pager string list.
      * @return number of items stored.
@@ -826,6 +1040,7 @@ class __EXPORT PagerPool : public __PROTOCOL MemoryProtocol
 private:
     LinkedObject *freelist;
     mutable pthread_mutex_t mutex;
+    MagazineCache magazines;
 
     __DELETE_COPY(PagerPool);
 
@@ -841,6 +1056,25 @@ public:
      * @param object to return to pool.
      */
     void put(PagerObject *object);
+
+    /**
+     * Enable per-thread magazines of free pager objects.  Objects are then
+     * recycled through the magazine of the calling thread, and are only
+     * moved to or from the shared free list in batches.  This should be
+     * set before the pool is shared between threads.
+     * @param depth of each thread magazine or 0 to disable.
+     */
+    inline void cache(unsigned depth) {
+        magazines.set(depth);
+    }
+
+    /**
+     * Get thread cache statistics for the pool.
+     * @return magazine cache of pool.
+     */
+    inline const MagazineCache& cached(void) const {
+        return magazines;
+    }
 };
 
 /**
@@ -862,6 +1096,9 @@ public:
      */
     inline pager(mempager *heap = NULL) : MemoryRedirect(heap), PagerPool() {}
 
+    using PagerPool::cache;
+    using PagerPool::cached;
+
     /**
      * Create a managed object by casting reference.
      * @return pointer to typed managed pager pool object.
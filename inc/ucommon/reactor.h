@@ -0,0 +1,279 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Socket event reactor.  This offers a single threaded event loop that
+ * multiplexes many socket descriptors and a timer queue together, so that
+ * one thread can service thousands of mostly idle connections rather than
+ * needing a blocked thread for each.  On platforms with epoll this is used
+ * directly, otherwise a portable poll based backend is used instead.
+ * @file ucommon/reactor.h
+ */
+
+#ifndef _UCOMMON_REACTOR_H_
+#define _UCOMMON_REACTOR_H_
+
+#ifndef _UCOMMON_SOCKET_H_
+#include <ucommon/socket.h>
+#endif
+
+#ifndef _UCOMMON_TIMERS_H_
+#include <ucommon/timers.h>
+#endif
+
+#ifndef _UCOMMON_LINKED_H_
+#include <ucommon/linked.h>
+#endif
+
+namespace ucommon {
+
+/**
+ * An event reactor for sockets.  Socket handlers are attached to the
+ * reactor with the events they are interested in, and the reactor then
+ * dispatches readable, writable, and hangup callbacks from a single thread
+ * as the events occur.  An optional timer queue may be associated with the
+ * reactor, in which case the next timer deadline bounds each wait, and
+ * expired timer events are processed from the same loop as socket i/o.
+ * Attach, modify, and detach are meant to be called from the thread that
+ * runs the reactor, or before it is started.  Only notify and stop may be
+ * safely called from other threads.
+ */
+class __EXPORT Reactor
+{
+private:
+    __DELETE_COPY(Reactor);
+
+public:
+    /**
+     * Event flags used when attaching and modifying handlers.
+     */
+    enum {
+        READABLE = 0x01,
+        WRITABLE = 0x02,
+        EDGE = 0x04,
+        ONESHOT = 0x08
+    };
+
+    /**
+     * A socket event handler.  This is used as a base class for objects
+     * that hold a socket descriptor and want to receive event callbacks
+     * from a reactor.  When edge triggered events are used, the derived
+     * handler must drain the socket until it would block, as no further
+     * event will be reported until new data arrives.
+     */
+    class __EXPORT handler : public DLinkedObject
+    {
+    private:
+        friend class Reactor;
+
+        __DELETE_DEFAULTS(handler);
+
+    protected:
+        socket_t so;
+        Reactor *owner;
+        unsigned flags;
+
+        /**
+         * Construct a handler for a socket descriptor.  The descriptor is
+         * not owned by the handler and is not closed when destroyed.
+         * @param socket descriptor to handle.
+         */
+        handler(socket_t socket);
+
+        /**
+         * Called when the socket has data to read or, for listening
+         * sockets, a connection pending to accept.
+         */
+        virtual void readable(void);
+
+        /**
+         * Called when the socket has buffer space to write.
+         */
+        virtual void writable(void);
+
+        /**
+         * Called when the peer has hung up or the socket is in error.  The
+         * default implementation detaches the handler from the reactor.
+         */
+        virtual void hangup(void);
+
+    public:
+        /**
+         * Detaches from reactor when destroyed.
+         */
+        virtual ~handler();
+
+        /**
+         * Get the socket descriptor we are handling.
+         * @return socket descriptor.
+         */
+        inline socket_t handle(void) const {
+            return so;
+        }
+
+        /**
+         * Get the events we are currently waiting for.
+         * @return event flags.
+         */
+        inline unsigned events(void) const {
+            return flags;
+        }
+
+        /**
+         * Get the reactor we are attached to.
+         * @return reactor or NULL if not attached.
+         */
+        inline Reactor *reactor(void) const {
+            return owner;
+        }
+    };
+
+protected:
+    OrderedIndex handlers;
+    TimerQueue *timers;
+    handler *active;
+    void *events;
+    unsigned limit, pending, current;
+    int efd;
+    socket_t wakeup[2];
+    volatile bool running;
+
+    /**
+     * Dispatch ready events to a handler.
+     * @param handler that is ready.
+     * @param revents ready in native form.
+     */
+    void dispatch(handler *handler, unsigned revents);
+
+    /**
+     * Called when the reactor is woken up by notify.  This may be
+     * overriden to process requests queued from other threads.
+     */
+    virtual void notified(void);
+
+public:
+    /**
+     * Create a reactor.
+     * @param timers queue to process with socket events or NULL.
+     * @param maximum number of events collected per wait.
+     */
+    Reactor(TimerQueue *timers = NULL, unsigned maximum = 64);
+
+    /**
+     * Destroy reactor.  Attached handlers are detached but not deleted.
+     */
+    virtual ~Reactor();
+
+    /**
+     * Attach a handler to the reactor.  If the handler is attached to
+     * another reactor it is detached from it first.
+     * @param handler to attach.
+     * @param events to wait for.
+     * @return true if attached.
+     */
+    bool attach(handler *handler, unsigned events = READABLE);
+
+    /**
+     * Change the events an attached handler waits for.  This is also used
+     * to re-arm a oneshot handler.
+     * @param handler to modify.
+     * @param events to wait for.
+     * @return true if changed.
+     */
+    bool modify(handler *handler, unsigned events);
+
+    /**
+     * Detach a handler from the reactor.  A handler may detach or delete
+     * itself, or any other handler, from within a callback.
+     * @param handler to detach.
+     */
+    void detach(handler *handler);
+
+    /**
+     * Set or change the timer queue processed by the reactor.
+     * @param queue to use or NULL for none.
+     */
+    void set(TimerQueue *queue);
+
+    /**
+     * Wait for and dispatch one batch of events.  Expired timer events are
+     * processed first, and the wait is bounded by both the timeout and the
+     * next timer that will expire.
+     * @param timeout to wait in milliseconds.
+     * @return number of handlers dispatched, or -1 on error.
+     */
+    int poll(timeout_t timeout = Timer::inf);
+
+    /**
+     * Run the reactor event loop until stopped.
+     */
+    void run(void);
+
+    /**
+     * Stop a running event loop.  This may be called from any thread or
+     * from within a handler callback.
+     */
+    void stop(void);
+
+    /**
+     * Wakeup a blocked reactor from another thread.  This would commonly
+     * be called from the update method of a timer queue that is changed
+     * outside the reactor thread, so the next deadline is re-evaluated.
+     */
+    void notify(void);
+
+    /**
+     * Get the number of attached handlers.
+     * @return handler count.
+     */
+    inline unsigned count(void) const {
+        return handlers.count();
+    }
+
+    /**
+     * Test if the reactor backend was created.
+     * @return true if usable.
+     */
+    operator bool() const;
+
+    /**
+     * Test if the reactor backend failed.
+     * @return true if not usable.
+     */
+    bool operator!() const;
+
+    /**
+     * Test if reactor uses native epoll support.
+     * @return true if epoll.
+     */
+    static bool is_native(void);
+};
+
+/**
+ * Convenience type for reactor socket handlers.
+ */
+typedef Reactor::handler ReactorHandler;
+
+/**
+ * Convenience type for reactors.
+ */
+typedef Reactor reactor_t;
+
+} // namespace ucommon
+
+#endif
@@ -46,7 +46,8 @@ class __EXPORT ArrayReuse : public ReusableAllocator
 {
 private:
     size_t objsize;
-    unsigned count, limit, used;
+    unsigned limit;
+    volatile unsigned used;
     caddr_t mem;
 
     __DELETE_DEFAULTS(ArrayReuse);
@@ -79,7 +80,9 @@ protected:
 class __EXPORT PagerReuse : protected __PROTOCOL MemoryRedirect, protected ReusableAllocator
 {
 private:
-    unsigned limit, count;
+    unsigned limit;
+    volatile unsigned count;
+    volatile uint64_t vacant;
     size_t osize;
 
     __DELETE_DEFAULTS(PagerReuse);
@@ -232,7 +235,7 @@ public:
      * @param count of objects of specified type to allocate.
      */
     inline paged_reuse(mempager *pager, unsigned count) :
-        PagerReuse(pager, sizeof(T), count) {}
+        MemoryRedirect(pager), PagerReuse(pager, sizeof(T), count) {}
 
     /**
      * Test if typed objects available from the pager or re-use list.
@@ -69,6 +69,26 @@ protected:
 	void get(TypeRef& object);
 
 	void put(TypeRef& object);
+
+	/**
+	 * Enter an epoch read section and fetch the current snapshot.  The
+	 * snapshot is not retained, but will not be reclaimed until the
+	 * calling thread leaves the read section.  Read sections may nest.
+	 * @return current snapshot or NULL if empty.
+	 */
+	Counted *enter(void);
+
+	/**
+	 * Leave an epoch read section entered by this thread.
+	 */
+	static void leave(void);
+
+public:
+	/**
+	 * Reclaim snapshots retired before the oldest active read section.
+	 * This happens automatically when a new snapshot is published.
+	 */
+	static void reclaim(void);
 };
 
 template<typename T>
@@ -77,20 +97,64 @@ class sharedref : private SharedRef
 private:
 	__DELETE_COPY(sharedref);
 
+	inline const T *view(void) {
+		Counted *obj = enter();
+		if(!obj)
+			return NULL;
+		return &(polystatic_cast<typename typeref<T>::value *>(obj)->data);
+	}
+
 public:
+	/**
+	 * Scoped lock-free reader of the current snapshot.  The snapshot is
+	 * neither locked nor retained while read, and stays valid until the
+	 * reader falls out of scope.
+	 */
+	class reader
+	{
+	private:
+		const T *object;
+
+		__DELETE_COPY(reader);
+
+	public:
+		inline reader(sharedref& from) {
+			object = from.view();
+		}
+
+		inline ~reader() {
+			SharedRef::leave();
+		}
+
+		inline const T* operator->() const {
+			return object;
+		}
+
+		inline const T& operator*() const {
+			__THROW_DEREF(object);
+			return *object;
+		}
+
+		inline operator bool() const {
+			return object != NULL;
+		}
+
+		inline bool operator!() const {
+			return object == NULL;
+		}
+	};
+
 	inline sharedref() : SharedRef() {};
 
 	inline operator typeref<T>() {
-		lock.acquire();
-		typeref<T> ptr(ref);
-		lock.release();
+		typeref<T> ptr(enter());
+		leave();
 		return ptr;
 	}
 
 	inline typeref<T> operator*() {
-		lock.acquire();
-		typeref<T> ptr(ref);
-		lock.release();
+		typeref<T> ptr(enter());
+		leave();
 		return ptr;
 	}
 
@@ -125,7 +189,15 @@ protected:
 		void *value;
 	};
 
-	condlock_t *lock;
+	sharedlock_t lock;
+
+	bool owned;
+
+	sharedlock_t *stripes;
+
+	unsigned ways;
+
+	Mutex guard;
 
 	LinkedObject *free, **list;
 
@@ -133,18 +205,53 @@ protected:
 
 	size_t paths;
 
-	MappedPointer(size_t indexes, condlock_t *locking = NULL, size_t paging = 0);
+	MappedPointer(size_t indexes, condlock_t *locking = NULL, size_t paging = 0, bool biased = false, unsigned stripes = 0);
 	~MappedPointer();
 
+	/**
+	 * Get the lock that covers the bucket of a path.
+	 * @param path of key.
+	 * @return stripe lock, or map lock if not striped.
+	 */
+	inline sharedlock_t *stripe(size_t path) {
+		return ways ? &stripes[(path % paths) % ways] : &lock;
+	}
+
 	LinkedObject *access(size_t path);
 
 	LinkedObject *modify(size_t path);
 
+	/**
+	 * Remember the stripe that shared access to a found object is held
+	 * on, so release can find it again.  Each get of an object is held
+	 * and released separately.
+	 * @param object found.
+	 * @param path of key object was found by.
+	 * @return object.
+	 */
+	void *held(void *object, size_t path);
+
 	void release(void *obj);
 
+	/**
+	 * Release shared access to a bucket that was not kept.
+	 * @param path of key.
+	 */
+	inline void unlock(size_t path) {
+		stripe(path)->release();
+	}
+
+	/**
+	 * Release exclusive access to a bucket that was not changed.
+	 * @param path of key.
+	 */
+	inline void commit(size_t path) {
+		stripe(path)->commit();
+	}
+
 	void insert(const void *key, void *value, size_t path);
 
-	void replace(Index *ind, void *value);
+	void replace(Index *ind, void *value, size_t path);
 
 	void remove(Index *ind, size_t path);
 
@@ -208,7 +315,7 @@ template<typename K, typename V>
 class mapped_pointer : public MappedPointer
 {
 public:
-	inline mapped_pointer(size_t indexes = 37, condlock_t *locking = NULL, size_t paging = 0) : MappedPointer(indexes, locking, paging) {}
+	inline mapped_pointer(size_t indexes = 37, condlock_t *locking = NULL, size_t paging = 0, bool biased = false, unsigned stripes = 0) : MappedPointer(indexes, locking, paging, biased, stripes) {}
 
 	inline void release(V* object) {
 		MappedPointer::release(object);
@@ -224,18 +331,19 @@ public:
 			}
 			ip.next();
 		}
-		lock->commit();
+		commit(path);
 	}
 
 	V* get(const K* key) {
-		linked_pointer<Index> ip = access(mapped_keypath<K>(key));
+		size_t path = mapped_keypath<K>(key);
+		linked_pointer<Index> ip = access(path);
 		while(is(ip)) {
 			if(mapped_keyequal<K>((const K*)(ip->key), key)) {
-				return static_cast<V*>(ip->value);
+				return static_cast<V*>(held(ip->value, path));
 			}
 			ip.next();
 		}
-		lock->release();
+		unlock(path);
 		return nullptr;
 	}
 
@@ -244,9 +352,10 @@ public:
 		linked_pointer<Index> ip = modify(path);
 		while(is(ip)) {
 			if(mapped_keyequal<K>((const K*)(ip->key), key)) {
-				replace(*ip, ptr);
+				replace(*ip, ptr, path);
 				return;
 			}
+			ip.next();
 		}
 		insert((const void *)key, (void *)ptr, path);
 	}
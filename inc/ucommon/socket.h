@@ -183,6 +183,77 @@ public:
      */
     typedef LinkedObject policy;
 
+    /**
+     * An immutable compressed binary trie index over a cidr policy chain.
+     * The index gives longest and shortest prefix matching in time bound
+     * by the prefix length rather than the number of entries.  The nodes
+     * live in a single reference counted block, so copies are cheap and
+     * share the same snapshot.  A sharedref of a table may be used to
+     * atomically swap in a rebuilt snapshot while readers continue to use
+     * the prior one.  Entries reference the cidr objects of the policy it
+     * was built from, which must remain valid while the table is used.
+     */
+    class __EXPORT table
+    {
+    private:
+        typeref<const uint8_t *> nodes;
+        unsigned count;
+
+        const cidr *search(const struct sockaddr *address, bool shortest) const;
+
+    public:
+        /**
+         * Create an empty table.
+         */
+        table();
+
+        /**
+         * Bulk build a table from an existing policy chain.  When several
+         * entries share a prefix the first one in the chain is used.
+         * @param policy chain to index.
+         */
+        table(const policy *policy);
+
+        /**
+         * Create a table sharing the snapshot of another table.
+         * @param copy of table to share.
+         */
+        table(const table& copy);
+
+        /**
+         * Share the snapshot of another table.
+         * @param copy of table to share.
+         * @return table reference.
+         */
+        table& operator=(const table& copy);
+
+        /**
+         * Find the smallest cidr entry that matches the socket address.
+         * @param address to search for.
+         * @return smallest cidr or NULL if none match.
+         */
+        inline const cidr *find(const struct sockaddr *address) const {
+            return search(address, false);
+        }
+
+        /**
+         * Find the largest container cidr entry that matches the address.
+         * @param address to search for.
+         * @return largest cidr or NULL if none match.
+         */
+        inline const cidr *container(const struct sockaddr *address) const {
+            return search(address, true);
+        }
+
+        /**
+         * Number of distinct prefixes indexed.
+         * @return count of entries.
+         */
+        inline unsigned size(void) const {
+            return count;
+        }
+    };
+
     /**
      * Create an uninitialized cidr.
      */
@@ -317,6 +388,8 @@ public:
     }
 };
 
+class PacketBuffer;
+
 /**
  * A generic socket base class.  This class can be used directly or as a
  * base class for building network protocol stacks.  This common base tries
@@ -849,6 +922,91 @@ public:
 
     friend class address;
 
+    /**
+     * Views of the equal sized datagrams held in one buffer.  This
+     * describes a buffer to send as segments, or a coalesced buffer that
+     * was received, and indexes each datagram in place without copying.
+     * The last datagram may be shorter than the rest.
+     */
+    class segments
+    {
+    private:
+        caddr_t base;
+        size_t bytes, step;
+
+    public:
+        /**
+         * Create segment views of a buffer.
+         * @param data of buffer.
+         * @param size of data in buffer.
+         * @param segment size of each datagram, or 0 for one datagram.
+         */
+        inline explicit segments(void *data = NULL, size_t size = 0, size_t segment = 0) {
+            set(data, size, segment);
+        }
+
+        /**
+         * Set the buffer being viewed.
+         * @param data of buffer.
+         * @param size of data in buffer.
+         * @param segment size of each datagram, or 0 for one datagram.
+         */
+        inline void set(void *data, size_t size, size_t segment = 0) {
+            base = (caddr_t)data;
+            bytes = size;
+            step = (segment && segment < size) ? segment : size;
+        }
+
+        /**
+         * Get the number of datagrams in the buffer.
+         * @return datagram count.
+         */
+        inline unsigned count(void) const {
+            return step ? (unsigned)((bytes + step - 1) / step) : 0;
+        }
+
+        /**
+         * Get a datagram.
+         * @param index of datagram.
+         * @return start of datagram, or NULL if past end.
+         */
+        inline caddr_t operator[](unsigned index) const {
+            return (index < count()) ? base + (index * step) : NULL;
+        }
+
+        /**
+         * Get the size of a datagram.
+         * @param index of datagram.
+         * @return size of datagram, or 0 if past end.
+         */
+        inline size_t size(unsigned index) const {
+            if(index >= count())
+                return 0;
+            size_t offset = index * step;
+            return (bytes - offset < step) ? bytes - offset : step;
+        }
+
+        /**
+         * Get the size of each datagram but the last.
+         * @return segment size.
+         */
+        inline size_t segment(void) const {
+            return step;
+        }
+
+        /**
+         * Get the total size of all datagrams.
+         * @return buffer size in use.
+         */
+        inline size_t total(void) const {
+            return bytes;
+        }
+
+        inline caddr_t data(void) const {
+            return base;
+        }
+    };
+
     /**
      * Create a socket object for use.
      */
@@ -992,6 +1150,15 @@ public:
         return keepalive(so, enable);
     }
 
+    /**
+     * Set udp socket to receive coalesced datagrams.
+     * @param enable coalescing if true.
+     * @return 0 on success, error code on failure.
+     */
+    inline int coalesce(bool enable) {
+        return coalesce(so, enable);
+    }
+
     /**
      * Set socket blocking I/O mode.
      * @param enable true for blocking I/O.
@@ -1150,6 +1317,18 @@ public:
      */
     int connectto(struct addrinfo *list);
 
+    /**
+     * Connect to the first address of a list to answer.  Attempts are
+     * raced across address families as described for race, and our
+     * socket is replaced by the connection established, which is of the
+     * same type.
+     * @param list of addresses to connect to.
+     * @param timeout to wait for any connection in milliseconds.
+     * @param delay between starting attempts in milliseconds.
+     * @return 0 on success or error.
+     */
+    int connectto(struct addrinfo *list, timeout_t timeout, timeout_t delay = 250);
+
     /**
      * Disconnect a connected socket.  Depending on the implementation, this
      * might be done by connecting to AF_UNSPEC, connecting to a 0 address,
@@ -1205,6 +1384,21 @@ public:
      */
     size_t writeto(const void *data, size_t number, const struct sockaddr *address = NULL);
 
+    /**
+     * Read a batch of datagrams into the free slots of a packet buffer.
+     * @param packets buffer to receive into.
+     * @return number of datagrams received, 0 if none or error.
+     */
+    unsigned readfrom(PacketBuffer& packets);
+
+    /**
+     * Write the datagrams queued in a packet buffer.
+     * @param packets buffer to send from.
+     * @param address of peer for packets without their own address.
+     * @return number of datagrams sent, 0 if none or error.
+     */
+    unsigned writeto(PacketBuffer& packets, const struct sockaddr *address = NULL);
+
     /**
      * Read a newline of text data from the socket and save in NULL terminated
      * string.  This uses an optimized I/O method that takes advantage of
@@ -1425,6 +1619,17 @@ public:
      */
     static int nodelay(socket_t socket);
 
+    /**
+     * Set udp socket descriptor to receive coalesced datagrams.  When
+     * enabled, the kernel may merge consecutive equal sized datagrams from
+     * the same peer into one receive, which the segments form of recvfrom
+     * reports.
+     * @param socket descriptor.
+     * @param enable coalescing if true.
+     * @return 0 if success, error code if not supported.
+     */
+    static int coalesce(socket_t socket, bool enable);
+
     /**
      * Set packet priority of socket descriptor.
      * @param socket descriptor.
@@ -1495,6 +1700,56 @@ public:
      */
     static ssize_t sendto(socket_t socket, const void *buffer, size_t size, int flags = 0, const struct sockaddr *address = NULL);
 
+    /**
+     * Get a batch of waiting datagrams.  Datagrams are received into the
+     * free slots of the packet buffer, with a single system call where
+     * the platform supports it.  Only the first datagram is waited for.
+     * @param socket to get from.
+     * @param packets buffer to receive into.
+     * @param flags for i/o operation (MSG_DONTWAIT, etc).
+     * @return number of datagrams received, -1 if error.
+     */
+    static ssize_t recvfrom(socket_t socket, PacketBuffer& packets, int flags = 0);
+
+    /**
+     * Get waiting datagrams that may have been coalesced.  The segment
+     * views are set to index each datagram within the buffer, so a socket
+     * set to coalesce may return many datagrams from one call.
+     * @param socket to get from.
+     * @param views set to the datagrams received.
+     * @param buffer to save, large enough for a coalesced receive.
+     * @param size of data buffer.
+     * @param flags for i/o operation.
+     * @param address of source.
+     * @return number of bytes received, -1 if error.
+     */
+    static ssize_t recvfrom(socket_t socket, segments& views, void *buffer, size_t size, int flags = 0, struct sockaddr_storage *address = NULL);
+
+    /**
+     * Send a buffer as a series of equal sized datagrams.  Where the
+     * platform supports segmentation offload the buffer is passed to the
+     * kernel whole and split below the socket layer, otherwise each
+     * datagram is sent in turn.
+     * @param socket to send to.
+     * @param views of datagrams to send.
+     * @param flags for i/o operation.
+     * @param address of destination, NULL if connected.
+     * @return number of bytes sent, -1 if error.
+     */
+    static ssize_t sendto(socket_t socket, const segments& views, int flags = 0, const struct sockaddr *address = NULL);
+
+    /**
+     * Send a batch of datagrams.  The datagrams queued in the packet buffer
+     * are sent, with a single system call where the platform supports it,
+     * and those sent are removed from the buffer.
+     * @param socket to send to.
+     * @param packets buffer to send from.
+     * @param flags for i/o operation.
+     * @param address of destination for packets without one, NULL if connected.
+     * @return number of datagrams sent, -1 if error.
+     */
+    static ssize_t sendto(socket_t socket, PacketBuffer& packets, int flags = 0, const struct sockaddr *address = NULL);
+
     /**
      * Send reply on socket.  Used to reply to a recvfrom message.
      * @param socket to send to.
@@ -1561,6 +1816,23 @@ public:
      */
     static socket_t create(const struct addrinfo *address, int type, int protocol);
 
+    /**
+     * Create a socket connected to the first address of a list to answer.
+     * Connection attempts are raced as described in RFC 8305.  Addresses
+     * alternate between families starting with the first in the list, a
+     * new attempt starts after each delay or as soon as an earlier one
+     * fails, and the first connection established is returned while the
+     * remaining attempts are cancelled.  On failure errno holds the last
+     * error seen, or ETIMEDOUT.
+     * @param address list to connect to, of any family.
+     * @param timeout to wait for any connection in milliseconds.
+     * @param delay between starting attempts in milliseconds.
+     * @param type of socket to create, or 0 for type in list.
+     * @param protocol of socket, or 0 for protocol in list.
+     * @return socket descriptor created or INVALID_SOCKET.
+     */
+    static socket_t race(const struct addrinfo *address, timeout_t timeout = Timer::inf, timeout_t delay = 250, int type = 0, int protocol = 0);
+
     /**
      * Create a bound socket for a service.
      * @param iface to bind.
@@ -1812,6 +2084,157 @@ public:
     static int remote(socket_t socket, struct sockaddr_storage *address);
 };
 
+/**
+ * A ring of preallocated datagram buffers for batched socket i/o.  Each
+ * slot holds one datagram with its length and peer address.  Datagrams are
+ * received at the tail of the ring and sent or released from the head, so
+ * a relay can receive a batch, rewrite addresses in place, and send the
+ * same batch on without copying.  The slot memory is allocated once, as a
+ * single pool, when the buffer is created.
+ */
+class __EXPORT PacketBuffer
+{
+private:
+    __DELETE_COPY(PacketBuffer);
+
+    friend class Socket;
+
+public:
+    /**
+     * A datagram held in a packet buffer.  The data points into the
+     * buffer's pool and remains valid for the life of the buffer.
+     */
+    class __EXPORT packet
+    {
+    public:
+        caddr_t data;
+        size_t size;
+        struct sockaddr_storage address;
+
+        /**
+         * Set the peer address of the datagram.
+         * @param address to set, or NULL to send to a default peer.
+         */
+        void set(const struct sockaddr *address);
+
+        /**
+         * Test if the datagram has its own peer address.
+         * @return true if address is set.
+         */
+        inline bool has_address(void) const {
+            return address.ss_family != 0;
+        }
+
+        inline struct sockaddr *addr(void) {
+            return (struct sockaddr *)&address;
+        }
+    };
+
+protected:
+    packet *list;
+    caddr_t pool;
+    void *vectors;
+    size_t bufsize;
+    unsigned limit, head, used;
+
+    /**
+     * Get a slot by ring position.
+     * @param index from head of ring.
+     * @return packet slot.
+     */
+    inline packet *slot(unsigned index) const {
+        return &list[(head + index) % limit];
+    }
+
+public:
+    /**
+     * Create a packet buffer.
+     * @param count of datagram slots.
+     * @param size of each slot, the largest datagram it can hold.
+     */
+    PacketBuffer(unsigned count = 64, size_t size = 2048);
+
+    /**
+     * Destroy a packet buffer and release its pool.
+     */
+    ~PacketBuffer();
+
+    /**
+     * Queue a copy of a datagram at the tail of the ring.
+     * @param data to copy.
+     * @param size of datagram.
+     * @param address of peer to send to, or NULL for default.
+     * @return true if queued, false if full or too large.
+     */
+    bool put(const void *data, size_t size, const struct sockaddr *address = NULL);
+
+    /**
+     * Get the free slot at the tail of the ring to build a datagram in
+     * place.  The datagram is queued when committed.
+     * @return free slot, or NULL if full.
+     */
+    packet *reserve(void);
+
+    /**
+     * Queue the slot last returned by reserve.
+     */
+    void commit(void);
+
+    /**
+     * Release datagrams from the head of the ring.
+     * @param count of datagrams to release.
+     */
+    void release(unsigned count = 1);
+
+    /**
+     * Release all queued datagrams.
+     */
+    inline void clear(void) {
+        head = used = 0;
+    }
+
+    /**
+     * Get a queued datagram.
+     * @param index from the head of the ring.
+     * @return datagram.
+     */
+    inline packet& operator[](unsigned index) const {
+        return *slot(index);
+    }
+
+    /**
+     * Get the number of queued datagrams.
+     * @return datagram count.
+     */
+    inline unsigned count(void) const {
+        return used;
+    }
+
+    /**
+     * Get the number of free slots.
+     * @return free slot count.
+     */
+    inline unsigned available(void) const {
+        return limit - used;
+    }
+
+    /**
+     * Get the size of each slot.
+     * @return largest datagram size.
+     */
+    inline size_t size(void) const {
+        return bufsize;
+    }
+
+    inline operator bool() const {
+        return used > 0;
+    }
+
+    inline bool operator!() const {
+        return used == 0;
+    }
+};
+
 /**
  * A bound socket used to listen for inbound socket connections.  This class
  * is commonly used for TCP and DCCP listener sockets.
@@ -1834,6 +2257,20 @@ public:
      */
     ListenSocket(const char *address, const char *service, unsigned backlog = 5, int family = AF_UNSPEC, int type = 0, int protocol = 0);
 
+    /**
+     * Create and bind a listener socket that may be shared.  A shared
+     * listener may be bound to the same address as other shared
+     * listeners, with the kernel spreading new connections across them.
+     * @param address to bind on or "*" for all.
+     * @param service port to bind listener.
+     * @param backlog size for buffering pending connections.
+     * @param family of socket.
+     * @param type of socket.
+     * @param protocol for socket if not TCPIP.
+     * @param shared if address may be shared with other listeners.
+     */
+    ListenSocket(const char *address, const char *service, unsigned backlog, int family, int type, int protocol, bool shared);
+
     /**
      * Create a listen socket directly.
      * @param address to bind on or "*" for all.
@@ -1847,12 +2284,40 @@ public:
     static socket_t create(const char *address, const char *service, unsigned backlog = 5, int family = AF_UNSPEC, int type = 0, int protocol = 0);
 
     /**
-     * Accept a socket connection.
+     * Create a listen socket directly that may be shared.
+     * @param address to bind on or "*" for all.
+     * @param service port to bind listener.
+     * @param backlog size for buffering pending connections.
+     * @param family of socket.
+     * @param type of socket.
+     * @param protocol for socket if not TCPIP.
+     * @param shared if address may be shared with other listeners.
+     * @return bound and listened to socket.
+     */
+    static socket_t create(const char *address, const char *service, unsigned backlog, int family, int type, int protocol, bool shared);
+
+    /**
+     * Accept a socket connection.  From a fiber only the fiber waits for
+     * a connection.  A listener also accepted on by other threads should
+     * be non-blocking, so a fiber that loses a connection to another
+     * thread waits again rather than blocking its scheduler.
      * @param address to save peer connecting.
      * @return socket descriptor of connected socket.
      */
     socket_t accept(struct sockaddr_storage *address = NULL) const;
 
+    /**
+     * Accept a batch of pending connections.  The first connection is
+     * waited for unless the listener is non-blocking, and then any others
+     * already pending are accepted without waiting.  Accepted sockets are
+     * non-blocking and are not inherited by exec'd processes.
+     * @param list to save connected socket descriptors in.
+     * @param max number of connections to accept.
+     * @param addresses to save peers connecting, or NULL.
+     * @return number of connections accepted.
+     */
+    unsigned accept(socket_t *list, unsigned max, struct sockaddr_storage *addresses = NULL) const;
+
     /**
      * Wait for a pending connection.
      * @param timeout to wait.
@@ -1911,6 +2376,66 @@ public:
      * @param backlog size for pending connections.
      */
     TCPServer(const char *address, const char *service, unsigned backlog = 5);
+
+    /**
+     * Create and bind a tcp server that may share its address with other
+     * servers.
+     * @param address of interface to bind or "*" for all.
+     * @param service tag to use.
+     * @param backlog size for pending connections.
+     * @param shared if address may be shared with other servers.
+     */
+    TCPServer(const char *address, const char *service, unsigned backlog, bool shared);
+};
+
+/**
+ * A set of tcp servers sharing one address, typically one per worker
+ * thread.  Each shard is a separate listening socket with its own accept
+ * queue, and the kernel spreads new connections across them, so workers
+ * accept in parallel rather than contending on a single listener.  Where
+ * address sharing is not supported only one server is created, and every
+ * shard refers to it.
+ */
+class __EXPORT TCPShards
+{
+private:
+    __DELETE_DEFAULTS(TCPShards);
+
+protected:
+    TCPServer **servers;
+    unsigned count;
+
+public:
+    /**
+     * Create and bind a set of tcp servers.
+     * @param address of interface to bind or "*" for all.
+     * @param service tag to use.
+     * @param shards to create.
+     * @param backlog size for pending connections of each shard.
+     */
+    TCPShards(const char *address, const char *service, unsigned shards, unsigned backlog = 5);
+
+    /**
+     * Close all servers.
+     */
+    ~TCPShards();
+
+    /**
+     * Get the number of separate servers created.
+     * @return server count, or 0 if the address could not be bound.
+     */
+    inline unsigned shards(void) const {
+        return count;
+    }
+
+    /**
+     * Get the server for a shard.
+     * @param shard index, usually of a worker.
+     * @return server to accept from, or NULL if none were bound.
+     */
+    inline TCPServer *operator[](unsigned shard) const {
+        return count ? servers[shard % count] : NULL;
+    }
 };
 
 /**
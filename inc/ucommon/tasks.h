@@ -0,0 +1,234 @@
+// Copyright (C) 2006-2014 David Sugar, Tycho Softworks.
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Work stealing thread pool.  A fixed set of worker threads execute task
+ * objects.  Each worker keeps its own deque of tasks, so tasks spawned from
+ * within a worker are queued without locking, and idle workers steal work
+ * from busy ones rather than all contending on a single shared queue.
+ * @file ucommon/tasks.h
+ */
+
+#ifndef _UCOMMON_TASKS_H_
+#define _UCOMMON_TASKS_H_
+
+#ifndef _UCOMMON_ATOMIC_H_
+#include <ucommon/atomic.h>
+#endif
+
+#ifndef _UCOMMON_CONDITION_H_
+#include <ucommon/condition.h>
+#endif
+
+#ifndef _UCOMMON_THREAD_H_
+#include <ucommon/thread.h>
+#endif
+
+namespace ucommon {
+
+/**
+ * A pool of worker threads that execute tasks with work stealing.  Tasks
+ * submitted from outside the pool are distributed round robin to small
+ * per-worker inboxes.  Tasks submitted from a worker thread, such as when
+ * a task fans out into sub-tasks, are pushed on that worker's lock-free
+ * Chase-Lev deque.  Workers that run out of work steal from the other
+ * workers, and park on a conditional only when no work can be found.
+ */
+class __EXPORT TaskPool : protected Conditional
+{
+private:
+    __DELETE_COPY(TaskPool);
+
+public:
+    /**
+     * A unit of work executed by a task pool.  A task also serves as the
+     * completion handle for the work, and can be waited on by any thread
+     * once submitted.  A detached task is deleted by the pool when it
+     * completes, and hence cannot be waited on.
+     */
+    class __EXPORT task : public OrderedObject
+    {
+    private:
+        friend class TaskPool;
+
+        volatile atomic_t state;
+        TaskPool *pool;
+        bool detached;
+
+        __DELETE_COPY(task);
+
+    protected:
+        /**
+         * Create a task.
+         * @param detached if deleted by the pool when completed.
+         */
+        task(bool detached = false);
+
+        /**
+         * Method to perform the work of the task from a worker thread.
+         */
+        virtual void run(void) = 0;
+
+    public:
+        virtual ~task();
+
+        /**
+         * Test if task has completed.
+         * @return true if completed.
+         */
+        bool is_done(void) const;
+
+        /**
+         * Wait for the task to complete.
+         * @param timeout to wait in milliseconds.
+         * @return true if completed, false if timed out or never submitted.
+         */
+        bool wait(timeout_t timeout = Timer::inf);
+
+        inline operator bool() const {
+            return is_done();
+        }
+
+        inline bool operator!() const {
+            return !is_done();
+        }
+    };
+
+protected:
+    class worker;
+
+    class __LOCAL deque
+    {
+    public:
+        volatile intptr_t top, bottom;
+        task * volatile *slots;
+        intptr_t mask;
+
+        deque(unsigned size);
+        ~deque();
+
+        bool push(task *item);
+        task *pop(void);
+        task *steal(void);
+        bool is_empty(void) const;
+    };
+
+    worker **workers;
+    unsigned count;
+    unsigned capacity;
+    volatile atomic_t sleeping, wakeups, waiting;
+    volatile atomic_t submits;
+    volatile bool stopping;
+    ConditionVar finished;
+
+    friend class worker;
+
+    task *next(worker *self);
+    task *search(unsigned start);
+    bool pending(void);
+    void execute(task *item);
+    void wakeup(void);
+    void park(void);
+    worker *current(void);
+
+public:
+    /**
+     * Create a task pool and start the workers.
+     * @param size of pool, or 0 for one worker per processor.
+     * @param capacity of each worker deque, rounded to power of 2.
+     * @param stack size for worker threads, or 0 for default.
+     */
+    TaskPool(unsigned size = 0, unsigned capacity = 1024, size_t stack = 0);
+
+    /**
+     * Stop the pool.  Tasks already submitted are completed first.
+     */
+    virtual ~TaskPool();
+
+    /**
+     * Submit a task to the pool.  This may be called from any thread,
+     * including from within a task that is running in the pool.
+     * @param item to submit.
+     */
+    void submit(task *item);
+
+    /**
+     * Get the number of workers in the pool.
+     * @return worker count.
+     */
+    inline unsigned size(void) const {
+        return count;
+    }
+
+    /**
+     * Convenience operator to submit a task.
+     * @param item to submit.
+     */
+    inline TaskPool& operator<<(task *item) {
+        submit(item);
+        return *this;
+    }
+};
+
+/**
+ * A task that produces a typed result.  The derived class implements the
+ * compute method, and the result is fetched through get, which waits for
+ * the task to complete.  This gives future/promise semantics to tasks.
+ */
+template<typename T>
+class futuretask : public TaskPool::task
+{
+private:
+    T result;
+
+    inline void run(void) __FINAL {
+        result = compute();
+    }
+
+protected:
+    /**
+     * Compute the result of the task from a worker thread.
+     * @return result value.
+     */
+    virtual T compute(void) = 0;
+
+    inline futuretask() : TaskPool::task(false) {}
+
+public:
+    /**
+     * Wait for and get the result.
+     * @return result of task.
+     */
+    inline const T& get(void) {
+        wait();
+        return result;
+    }
+
+    inline const T& operator*() {
+        return get();
+    }
+};
+
+/**
+ * Convenience type for task pools.
+ */
+typedef TaskPool taskpool_t;
+
+} // namespace ucommon
+
+#endif
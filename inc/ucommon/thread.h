@@ -63,6 +63,10 @@
 #include <ucommon/condition.h>
 #endif
 
+#ifndef _UCOMMON_ATOMIC_H_
+#include <ucommon/atomic.h>
+#endif
+
 namespace ucommon {
 
 /**
@@ -248,13 +252,23 @@ public:
     bool access(timeout_t timeout = Timer::inf);
 
     /**
-     * Specify hash table size for guard protection.  The default is 1.
-     * This should be called at initialization time from the main thread
-     * of the application before any other threads are created.
+     * Specify hash table size for guard protection.  The default is 64,
+     * and the size is rounded up to a power of 2.  This should be called
+     * at initialization time from the main thread of the application
+     * before any other threads are created.
      * @param size of hash table used for guarding.
      */
     static void indexing(unsigned size);
 
+    /**
+     * Get lookup statistics for the guard protection table.  Contended
+     * counts lookups that found the table index held by another thread,
+     * which suggests increasing the table size.
+     * @param lookups made into the table, or NULL.
+     * @param contended lookups that had to wait, or NULL.
+     */
+    static void statistics(unsigned long *lookups, unsigned long *contended);
+
     /**
      * Release an arbitrary object that has been protected by a rwlock.
      * @param object to release.
@@ -282,7 +296,9 @@ private:
     HANDLE event;
 #else
     mutable pthread_cond_t cond;
-    bool signalled;
+    volatile atomic_t signalled, waiting;
+
+    __LOCAL bool consume(struct timespec *deadline);
 #endif
     mutable pthread_mutex_t mutex;
 
@@ -422,6 +438,23 @@ protected:
     ReusableObject *freelist;
     unsigned waiting;
 
+    /**
+     * Lock-free free stack of object slots.  The low 32 bits hold the slot
+     * index + 1 of the top object, or 0 if empty, and the high 32 bits a
+     * tag that changes on every update to avoid ABA races.
+     */
+    volatile uint64_t slots;
+
+    /**
+     * Objects of an indexed allocator are either held in a vector found
+     * from a base address and stride, or in a table of object pointers.
+     * Each object in a table is preceded by a header holding its index.
+     * A derived allocator that sets neither uses the locked free list.
+     */
+    caddr_t base;
+    size_t stride;
+    ReusableObject **table;
+
     /**
      * Initialize reusable allocator through a conditional.  Zero free list.
      */
@@ -437,7 +470,59 @@ protected:
     }
 
     /**
-     * Release resuable object
+     * Test if the allocator indexes its objects for the lock-free stack.
+     * @return true if indexed.
+     */
+    inline bool is_indexed(void) const {
+        return stride || table;
+    }
+
+    /**
+     * Get object held in a slot of an indexed allocator.
+     * @param index of slot.
+     * @return object in slot.
+     */
+    inline ReusableObject *slot(unsigned index) const {
+        if(table)
+            return table[index];
+        return (ReusableObject *)(base + (index * stride));
+    }
+
+    /**
+     * Get slot index of an object of an indexed allocator.
+     * @param object to find.
+     * @return index of slot.
+     */
+    inline unsigned slot(ReusableObject *object) const {
+        if(table)
+            return *(unsigned *)((caddr_t)object - sizeof(void *));
+        return (unsigned)(((caddr_t)object - base) / stride);
+    }
+
+    /**
+     * Pop a released object from the lock-free free stack.
+     * @return object or NULL if none free.
+     */
+    ReusableObject *pop(void);
+
+    /**
+     * Push an object onto the lock-free free stack.
+     * @param object to push.
+     */
+    void push(ReusableObject *object);
+
+    /**
+     * Test if the lock-free free stack has objects.
+     * @return true if objects free.
+     */
+    inline bool is_free(void) const {
+        return (Atomic::load(&slots) & 0xffffffff) != 0;
+    }
+
+    /**
+     * Release resuable object.  For indexed allocators the object is
+     * pushed without locking, and the lock is only used to wake a waiting
+     * consumer.
      * @param object being released.
      */
     void release(ReusableObject *object);
@@ -525,13 +610,23 @@ public:
     }
 
     /**
-     * Specify hash table size for guard protection.  The default is 1.
-     * This should be called at initialization time from the main thread
-     * of the application before any other threads are created.
+     * Specify hash table size for guard protection.  The default is 64,
+     * and the size is rounded up to a power of 2.  This should be called
+     * at initialization time from the main thread of the application
+     * before any other threads are created.
      * @param size of hash table used for guarding.
      */
     static void indexing(unsigned size);
 
+    /**
+     * Get lookup statistics for the guard protection table.  Contended
+     * counts lookups that found the table index held by another thread,
+     * which suggests increasing the table size.
+     * @param lookups made into the table, or NULL.
+     * @param contended lookups that had to wait, or NULL.
+     */
+    static void statistics(unsigned long *lookups, unsigned long *contended);
+
     /**
      * Specify pointer/object/resource to guard protect.  This uses a
      * dynamically managed mutex.
@@ -546,6 +641,117 @@ public:
     static bool release(const void *pointer);
 };
 
+/**
+ * A fair queued spinlock.  Threads take a ticket and spin until it is
+ * served, so the lock is granted in arrival order.  Waiting threads back
+ * off in proportion to how far they are from the head of the queue, and
+ * yield the processor if the queue stops moving.  This
+ * is meant for very short critical sections where a futex syscall would
+ * cost more than the work being protected.
+ */
+class __EXPORT TicketLock : public __PROTOCOL ExclusiveProtocol
+{
+private:
+    __DELETE_COPY(TicketLock);
+
+protected:
+    volatile atomic_t next, serving;
+
+    virtual void _lock(void) __OVERRIDE;
+    virtual void _unlock(void) __OVERRIDE;
+
+public:
+    typedef autoexclusive<TicketLock> autolock;
+
+    /**
+     * Create a ticket lock.
+     */
+    TicketLock();
+
+    /**
+     * Take a ticket and spin until it is served.
+     */
+    void acquire(void);
+
+    /**
+     * Acquire the lock only if no other thread holds or waits for it.
+     * @return true if acquired.
+     */
+    bool try_acquire(void);
+
+    /**
+     * Serve the next ticket.
+     */
+    void release(void);
+
+    inline void lock(void) {
+        acquire();
+    }
+
+    inline void unlock(void) {
+        release();
+    }
+};
+
+/**
+ * An adaptive mutex.  A contended lock is first spun for briefly with
+ * backoff, in case the holder is about to release it, and only then does
+ * the thread park.  On Linux the lock is a single futex word and an
+ * uncontended unlock makes no syscall.  Elsewhere it parks on a native
+ * mutex.
+ */
+class __EXPORT AdaptiveMutex : public __PROTOCOL ExclusiveProtocol
+{
+private:
+    __DELETE_COPY(AdaptiveMutex);
+
+protected:
+    volatile atomic_t state;
+    mutable pthread_mutex_t mlock;
+    unsigned spins;
+
+    virtual void _lock(void) __OVERRIDE;
+    virtual void _unlock(void) __OVERRIDE;
+
+public:
+    typedef autoexclusive<AdaptiveMutex> autolock;
+
+    /**
+     * Create an adaptive mutex.
+     * @param spins to try before parking.
+     */
+    AdaptiveMutex(unsigned spins = 50);
+
+    /**
+     * Destroy adaptive mutex.
+     */
+    ~AdaptiveMutex();
+
+    /**
+     * Acquire the mutex, spinning briefly before parking.
+     */
+    void acquire(void);
+
+    /**
+     * Acquire the mutex only if it is free.
+     * @return true if acquired.
+     */
+    bool try_acquire(void);
+
+    /**
+     * Release the mutex, waking one parked thread if any.
+     */
+    void release(void);
+
+    inline void lock(void) {
+        acquire();
+    }
+
+    inline void unlock(void) {
+        release();
+    }
+};
+
 /**
  * Guard class to apply scope based mutex locking to objects.  The mutex
  * is located from the mutex pool rather than contained in the target
@@ -768,6 +974,11 @@ public:
      */
     static size_t cache(void);
 
+    /**
+     * Get number of online processors.
+     */
+    static unsigned cpus(void);
+
     /**
      * Used to specify scheduling policy for threads above priority "0".
      * Normally we apply static realtime policy SCHED_FIFO (default) or
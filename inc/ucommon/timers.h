@@ -53,6 +53,7 @@ private:
     friend class Conditional;
     friend class Semaphore;
     friend class Event;
+    friend class TimerQueue;
 
 #if _POSIX_TIMERS > 0 && defined(POSIX_TIMERS)
     timespec timer;
@@ -169,6 +170,16 @@ public:
      */
     Timer& operator=(timeout_t expire);
 
+    /**
+     * Assign expiration from another timer.
+     * @param copy of timer to assign from.
+     * @return this timer.
+     */
+    inline Timer& operator=(const Timer& copy) {
+        timer = copy.timer;
+        return *this;
+    }
+
     /**
      * Adjust timer expiration.
      * @param expire time to add in seconds.
@@ -262,7 +273,11 @@ public:
  * on events that have expired.  The timer queue also determines the
  * wait time until the next timer will expire.  When timer events are
  * modified, they can retrigger the queue to re-examine the list to
- * find when the next timer will now expire.
+ * find when the next timer will now expire.  A timer queue may also be
+ * created with a tick resolution, in which case events are kept in a
+ * hierarchical timing wheel so that arming, disarming, and expiring
+ * events does not require scanning every timer.  Events on a wheel must
+ * use arm, disarm, or update to inform the queue of any timer change.
  * @author David Sugar <dyfet@gnutelephony.org>
  */
 class __EXPORT TimerQueue : public OrderedIndex
@@ -287,6 +302,8 @@ public:
     protected:
         friend class TimerQueue;
 
+        event *wheel_next, *wheel_prev, **wheel_list;
+
         /**
          * Construct a timer event object and initially arm.
          * @param expire timer in specified milliseconds.
@@ -308,6 +325,7 @@ public:
         /**
          * Expected next timeout for the timer.  This may be overriden
          * for strategy purposes when evaluted by timer queue's expire.
+         * Events on a timing wheel are instead fired directly once due.
          * @return milliseconds until timer next triggers.
          */
         virtual timeout_t timeout(void);
@@ -367,6 +385,21 @@ public:
         }
     };
 
+private:
+    timeout_t resolution;
+    uint64_t origin, current;
+    event **wheel, *pending;
+    uint64_t *occupied;
+    unsigned count;
+
+    uint64_t msec(const Timer *timer, bool upper) const;
+
+    void insert(event *timer);
+
+    void remove(event *timer);
+
+    void cascade(unsigned level);
+
 protected:
     friend class event;
 
@@ -389,6 +422,12 @@ public:
      */
     TimerQueue();
 
+    /**
+     * Create an empty timer queue using a hierarchical timing wheel.
+     * @param resolution of wheel ticks in milliseconds, 0 for a list.
+     */
+    TimerQueue(timeout_t resolution);
+
     /**
      * Destroy queue, does not remove event objects.
      */
@@ -410,7 +449,10 @@ public:
      * Process timer queue and find when next event triggers.  This function
      * will call the expired methods on expired timers.  Normally this function
      * will be called in the context of a timer thread which sleeps for the
-     * timeout returned unless it is awoken on an update event.
+     * timeout returned unless it is awoken on an update event.  On a timing
+     * wheel only the occupied slots that have come due since the last call
+     * are processed, and their events fire against a single reading of
+     * the clock.
      * @return timeout until next timer expires in milliseconds.
      */
     timeout_t expire();
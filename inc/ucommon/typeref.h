@@ -289,10 +289,16 @@ protected:
 extern __EXPORT TypeRelease auto_release;
 extern __EXPORT TypeRelease secure_release;
 
+template<typename T>
+class sharedref;
+
 template<typename T, TypeRelease& R = auto_release>
 class typeref : public TypeRef
 {
 private:
+	template<typename U>
+	friend class sharedref;
+
 	class value : public Counted
 	{
 	private:
@@ -103,10 +103,15 @@
 #include <ucommon/datetime.h>
 #include <ucommon/keydata.h>
 #include <ucommon/socket.h>
+#include <ucommon/reactor.h>
+#include <ucommon/fiber.h>
 #include <ucommon/condition.h>
 #include <ucommon/thread.h>
+#include <ucommon/tasks.h>
+#include <ucommon/asyncio.h>
 #include <ucommon/arrayref.h>
 #include <ucommon/mapref.h>
+#include <ucommon/flatmap.h>
 #include <ucommon/shared.h>
 #include <ucommon/fsys.h>
 #include <ucommon/temporary.h>
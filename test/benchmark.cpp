@@ -0,0 +1,177 @@
+// Copyright (C) 2015 Cherokees of Idaho.
+//
+// This file is part of GNU uCommon C++.
+//
+// GNU uCommon C++ is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// GNU uCommon C++ is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU uCommon C++.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ucommon/ucommon.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace ucommon;
+
+// compare lookup rates of the chained mapref against the flat map, shared
+// against sharded counters, and seqlock against rwlock readers from 1 to N
+// threads; this is not run as a test, since timings depend on the host...
+
+static unsigned long elapsed(Timer::tick_t start)
+{
+    return (unsigned long)((Timer::ticks() - start) / 10000);
+}
+
+static Atomic::counter shared_count;
+static Atomic::sharded sharded_count;
+static seqlock<DateTime> sequenced_stamp;
+static DateTime guarded_stamp;
+static volatile atomic_t checksum = 0;
+
+// a workload is run by each thread with an iteration count and a flag to
+// select the alternate form being compared...
+
+typedef void (*workload_t)(int count, bool alternate);
+
+static void counting(int increments, bool sharded)
+{
+    if(sharded) {
+        for(int pos = 0; pos < increments; ++pos)
+            ++sharded_count;
+    }
+    else {
+        for(int pos = 0; pos < increments; ++pos)
+            ++shared_count;
+    }
+}
+
+static void reading(int reads, bool sequenced)
+{
+    long total = 0;
+    if(sequenced) {
+        DateTime stamp;
+        for(int pos = 0; pos < reads; ++pos) {
+            sequenced_stamp.get(stamp);
+            total += (long)stamp;
+        }
+    }
+    else {
+        for(int pos = 0; pos < reads; ++pos) {
+            RWLock::reader guard(&guarded_stamp);
+            total += (long)guarded_stamp;
+        }
+    }
+    Atomic::fetch_add(&checksum, (atomic_t)(total & 1));
+}
+
+class worker : public JoinableThread
+{
+private:
+    workload_t workload;
+    int count;
+    bool alternate;
+
+public:
+    worker(workload_t work, int iterations, bool mode) :
+    JoinableThread(), workload(work), count(iterations), alternate(mode) {}
+
+    ~worker() {
+        join();
+    }
+
+    void run(void) __OVERRIDE {
+        workload(count, alternate);
+    }
+};
+
+static unsigned long workers(unsigned threads, workload_t workload, int count, bool alternate)
+{
+    worker *list[64];
+    Timer::tick_t start = Timer::ticks();
+
+    for(unsigned pos = 0; pos < threads; ++pos) {
+        list[pos] = new worker(workload, count, alternate);
+        list[pos]->start();
+    }
+    for(unsigned pos = 0; pos < threads; ++pos)
+        delete list[pos];
+    return elapsed(start);
+}
+
+// thread counts double from 1 and end with the full cpu count, which
+// need not be a power of 2...
+
+static unsigned scale(unsigned threads, unsigned cpus)
+{
+    if(threads >= cpus)
+        return 0;
+    if(threads * 2 > cpus)
+        return cpus;
+    return threads * 2;
+}
+
+static void scaling(unsigned cpus, workload_t workload, int count, const char *base, const char *alternate)
+{
+    for(unsigned threads = 1; threads; threads = scale(threads, cpus)) {
+        unsigned long first = workers(threads, workload, count, false);
+        unsigned long second = workers(threads, workload, count, true);
+        printf("%u threads: %s %ld msec, %s %ld msec\n", threads, base, (long)first, alternate, (long)second);
+    }
+}
+
+extern "C" int main(int argc, char **argv)
+{
+    int entries = 100000, lookups = 1000000;
+    unsigned long hits = 0;
+
+    if(argc > 1)
+        entries = atoi(argv[1]);
+    if(argc > 2)
+        lookups = atoi(argv[2]);
+
+    mapref<int,int> chained(37);
+    flatmap<int,int> flat;
+
+    for(int pos = 0; pos < entries; ++pos) {
+        chained(pos, pos);
+        flat.set(pos, pos);
+    }
+
+    Timer::tick_t start = Timer::ticks();
+    for(int pos = 0; pos < lookups; ++pos) {
+        typeref<int> value = chained(pos % entries);
+        if(is(value))
+            ++hits;
+    }
+    printf("mapref:  %d lookups in %ld msec\n", lookups, (long)elapsed(start));
+
+    start = Timer::ticks();
+    for(int pos = 0; pos < lookups; ++pos) {
+        const int *value = flat.get(pos % entries);
+        if(value)
+            ++hits;
+        flat.release(value);
+    }
+    printf("flatmap: %d lookups in %ld msec\n", lookups, (long)elapsed(start));
+
+    unsigned cpus = Thread::cpus();
+    if(cpus > 64)
+        cpus = 64;
+    scaling(cpus, &counting, lookups, "counter", "sharded");
+    if(*sharded_count != (int64_t)shared_count.get())
+        return 1;
+
+    sequenced_stamp = guarded_stamp;
+    scaling(cpus, &reading, lookups, "rwlock reader", "seqlock");
+
+    return hits == (unsigned long)lookups * 2 ? 0 : 1;
+}
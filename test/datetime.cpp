@@ -98,6 +98,19 @@ int main(int argc, char **argv)
     tmp += 5;   // add 5 seconds to force rollover...
     assert((long)tmp == 20030301l);
 
+    seqlock<DateTime> stamp(tmp);
+    DateTime seen = *stamp;
+    assert(seen == tmp);
+    stamp.modify() += 60;
+    stamp.commit();
+    stamp.get(seen);
+    assert((long)seen == 20030301l && !(seen == tmp));
+
+    seqlock<Timer> deadline;
+    deadline = Timer((timeout_t)10000);
+    Timer expires = *deadline;
+    assert(expires.get() > 0);
+
     return 0;
 }
 
@@ -49,6 +49,39 @@ typedef struct {
     int v;
 } maptest;
 
+class pagetest : public PagerObject
+{
+public:
+    int value;
+};
+
+class reusetest : public ReusableObject
+{
+public:
+    int value;
+};
+
+// another request takes the next slot while an allocation fails...
+
+class failpager : public mempager
+{
+public:
+    paged_reuse<reusetest> *pool;
+    reusetest *taken;
+    bool failing;
+
+    failpager() : mempager(), pool(NULL), taken(NULL), failing(false) {}
+
+protected:
+    void *_alloc(size_t size) __OVERRIDE {
+        if(!failing)
+            return mempager::_alloc(size);
+        failing = false;
+        taken = pool->request();
+        return NULL;
+    }
+};
+
 static uint8_t memdata[7] = {0x20, 0x55, 0x77, 0x78, 0x33, 0x66, 0x55};
 
 extern "C" int main()
@@ -174,6 +207,33 @@ extern "C" int main()
     assert(!sv);
     assert(sv.copies() == 0);
 
+    mpmcref<int> mpmc(4);
+    for(int pos = 0; pos < 4; ++pos)
+        mpmc << pos;
+    bool pushed = mpmc.push(typeref<int>(9), 0);
+    assert(!pushed);
+    assert(mpmc.count() == 4);
+    mpmc >> sv;
+    assert(sv == 0);
+    assert(sv.copies() == 1);
+    mpmc.pop();
+    mpmc.clear();
+    assert(mpmc.count() == 0);
+    sv = mpmc.pull(0);
+    assert(!sv);
+
+    spscref<int> spsc(2);
+    spsc << 61 << 62;
+    pushed = spsc.push(typeref<int>(63), 0);
+    assert(!pushed);
+    spsc >> sv;
+    assert(sv == 61);
+    spsc << 63;
+    spsc >> sv;
+    spsc >> sv;
+    assert(sv == 63);
+    assert(spsc.count() == 0);
+
     mapref<int,Type::Chars> map;
     map(3, "hello");
     stringref_t sr = map(3);
@@ -206,6 +266,67 @@ extern "C" int main()
     sr = map(7);
     assert(*sr == nullptr);
 
+    mapref<int,int> grow(7);
+    for(int pos = 0; pos < 1000; ++pos)
+        grow(pos, pos * 2);
+    size_t buckets, chains, longest;
+    grow.statistics(&buckets, &chains, &longest);
+    assert(buckets > 7);
+    assert(grow.count() == 1000);
+    mapref<int,int>::instance scan = grow;
+    passes = 0;
+    while(is(scan)) {
+        ++scan;
+        ++passes;
+    }
+    assert(passes == 1000);
+    scan = mapref<int,int>::instance();
+    for(int pos = 0; pos < 1000; ++pos)
+        assert(*grow(pos) == pos * 2);
+
+    // key paths may also be spread by a stronger hash for the map...
+    mapref<int,int> mixed(7, 0, false, 0, &MapRef::mixed);
+    for(int pos = 0; pos < 100; ++pos)
+        mixed(pos, pos);
+    for(int pos = 0; pos < 100; ++pos)
+        assert(*mixed(pos) == pos);
+
+    flatmap<int,int> flat;
+    for(int pos = 0; pos < 1000; ++pos)
+        flat.set(pos, pos * 3);
+    assert(flat.count() == 1000);
+    for(int pos = 0; pos < 1000; pos += 2) {
+        bool removed = flat.remove(pos);
+        assert(removed);
+    }
+    assert(flat.count() == 500);
+    const int *found = flat.get(7);
+    assert(found && *found == 21);
+    flat.release(found);
+    assert(flat.get(8) == nullptr);
+    typeref<int> fk(9);
+    found = flat.get(fk);
+    assert(found && *found == 27);
+    flat.release(found);
+    flat.set(fk, 1);
+    assert(flat.find(9));
+    assert(!flat.find(10));
+
+    // group probes filter on the top bits of the key hash...
+    unsigned tagbits = sizeof(size_t) * 8 - 7;
+    size_t tag0 = flatmap_keypath<int>(0) >> tagbits;
+    bool differ = false;
+    for(int pos = 1; pos < 16; ++pos) {
+        if((flatmap_keypath<int>(pos) >> tagbits) != tag0)
+            differ = true;
+    }
+    assert(differ);
+    const char *one = "a", *two = "b", *three = "c";
+    size_t tag1 = flatmap_keypath<const char *>(one) >> tagbits;
+    size_t tag2 = flatmap_keypath<const char *>(two) >> tagbits;
+    size_t tag3 = flatmap_keypath<const char *>(three) >> tagbits;
+    assert(tag1 != tag2 || tag2 != tag3);
+
     listref<int> intlist;
     intlist << 3 << 5 << 7 << 9;
     assert(intlist.count() == 4);
@@ -263,7 +384,112 @@ extern "C" int main()
     al((int)3);
     assert(*al == 3);
 
+    Atomic::padded<int> pad;
+    pad(5);
+    assert(*pad == 5);
+    assert(((uintptr_t)&(*pad)) % Thread::cache() == 0);
+
+    Atomic::sharded hits(3);
+    ++hits;
+    hits += 4;
+    --hits;
+    assert(*hits == 4);
+    hits.clear();
+    assert(*hits == 0);
+
     stringref<secure_release> s4 = "abc";
 
+    mempager heap;
+    heap.cache(8);
+    pager<pagetest> objects(&heap);
+    objects.cache(4);
+    CountedObject *obj = objects();
+    obj->retain();
+    obj->release();
+    assert(objects.cached().misses() == 1);
+    for(unsigned pos = 0; pos < 10; ++pos) {
+        obj = objects();
+        obj->retain();
+        obj->release();
+    }
+    assert(objects.cached().hits() == 10);
+    assert(objects.cached().ratio() == 90);
+    assert(heap.cached().misses() == 1);
+    for(unsigned pos = 0; pos < 7; ++pos) {
+        void *block = heap.alloc(sizeof(void *));
+        assert(block != nullptr);
+    }
+    assert(heap.cached().hits() == 7);
+
+    slaballoc slab(4096);
+    assert(slab.max() == 512);
+    assert(slab.fit(33) == 40);
+    assert(slab.fit(65) == 80);
+    void *blocks[200];
+    for(unsigned pos = 0; pos < 200; ++pos)
+        blocks[pos] = slab.alloc(48);
+    assert(slab.pages() == 3);
+    for(unsigned pos = 0; pos < 200; ++pos)
+        slab.dealloc(blocks[pos]);
+    assert(slab.pages() == 1);
+    void *big = slab.alloc(8000);
+    assert(slab.pages() == 2);
+    slab.dealloc(big);
+    assert(slab.pages() == 1);
+
+    StringPager strings;
+    bool attached = strings.attach(&slab);
+    assert(attached);
+    strings.add("slab");
+    assert(eq(strings[0u], "slab"));
+    assert(slab.pages() == 2);
+    strings.clear();
+    assert(slab.pages() == 2);
+    assert(slab.utilization() == 0);
+
+    array_reuse<reusetest> array(4);
+    reusetest *items[4], *reused;
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        items[pos] = array.create(0);
+        assert(items[pos] != nullptr);
+    }
+    assert(!array);
+    reused = array.request();
+    assert(reused == nullptr);
+    reused = array.get(10);
+    assert(reused == nullptr);
+    array.release(items[2]);
+    array.release(items[0]);
+    reused = array.request();
+    assert(reused == items[0]);
+    reused = array.get(10);
+    assert(reused == items[2]);
+    reused = array.request();
+    assert(reused == nullptr);
+
+    paged_reuse<reusetest> paged(&heap, 2);
+    reusetest *first = paged.create(0);
+    reusetest *second = paged.create();
+    assert(first != nullptr && second != nullptr && first != second);
+    reused = paged.request();
+    assert(reused == nullptr);
+    paged.release(first);
+    reused = paged.get(10);
+    assert(reused == first);
+
+    failpager failing;
+    paged_reuse<reusetest> retry(&failing, 3);
+    failing.pool = &retry;
+    failing.failing = true;
+    reused = retry.request();
+    assert(reused == nullptr);
+    assert(failing.taken != nullptr);
+    reused = retry.request();
+    assert(reused != nullptr);
+    reused = retry.request();
+    assert(reused != nullptr);
+    reused = retry.request();
+    assert(reused == nullptr);
+
     return 0;
 }
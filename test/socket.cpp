@@ -23,6 +23,9 @@
 #include <ucommon/ucommon.h>
 
 #include <stdio.h>
+#ifndef _MSWINDOWS_
+#include <fcntl.h>
+#endif
 
 using namespace ucommon;
 
@@ -34,6 +37,430 @@ static Socket::address testing6("44:022:66::1", 4444);
 static Socket::address localhost6("::1", 4444);
 #endif
 
+static unsigned reads = 0, expires = 0;
+
+class testQueue : public TimerQueue
+{
+public:
+    void modify(void) {}
+    void update(void) {}
+};
+
+class testWheel : public TimerQueue
+{
+public:
+    testWheel() : TimerQueue(1) {}
+
+    void modify(void) {}
+    void update(void) {}
+};
+
+class testTimer : public TimerQueue::event
+{
+public:
+    testTimer(TimerQueue *tq, timeout_t timeout = 10) : TimerQueue::event(tq, timeout) {}
+
+    void expired(void) {
+        ++expires;
+    }
+};
+
+class testHandler : public Reactor::handler
+{
+public:
+    testHandler(socket_t so) : Reactor::handler(so) {}
+
+    void readable(void) {
+        char buf[16];
+        while(::recv(so, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ++reads;
+    }
+};
+
+class testWatch : public Reactor::handler
+{
+public:
+    unsigned readables, writables, hangups;
+
+    testWatch(socket_t so) : Reactor::handler(so), readables(0), writables(0), hangups(0) {}
+
+    void readable(void) {
+        char buf[16];
+        while(::recv(so, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+        ++readables;
+    }
+
+    void writable(void) {
+        ++writables;
+    }
+
+    void hangup(void) {
+        ++hangups;
+        Reactor::handler::hangup();
+    }
+};
+
+#ifndef _MSWINDOWS_
+static volatile atomic_t completions = 0;
+
+class testRequest : public AsyncIO::request
+{
+public:
+    testRequest() : AsyncIO::request() {}
+
+    void completed(void) {
+        Atomic::fetch_add(&completions, (atomic_t)1);
+    }
+};
+
+static void testAsync(bool emulated)
+{
+    static char blocks[2][4096];
+    testRequest wr, sy, rd, bad, skip, rx, tx, ac, cn;
+    char buf[8];
+    bool queued, done;
+
+    completions = 0;
+    AsyncIO aio(16, 2, emulated);
+    if(emulated)
+        assert(!aio.is_native());
+    aio.buffers(blocks, sizeof(blocks[0]), 2);
+
+    fsys file("asyncio.tmp", 0640, fsys::RDWR);
+    assert(is(file));
+    memcpy(blocks[0], "hello async", 12);
+    queued = aio.write(&wr, file, blocks[0], 12, 0, true);
+    assert(queued);
+    queued = aio.sync(&sy, file);
+    assert(queued);
+    done = sy.wait(1000);
+    assert(done);
+    assert(wr.is_done() && wr.result() == 12);
+    assert(sy.result() == 0);
+    queued = aio.read(&rd, file, blocks[1], 12, 0);
+    assert(queued);
+    done = rd.wait(1000);
+    assert(done);
+    assert(rd.result() == 12);
+    assert(eq(blocks[1], "hello async"));
+
+    // a failed request cancels the one linked after it...
+    queued = aio.read(&bad, (fd_t)-1, buf, 4, 0, true);
+    assert(queued);
+    queued = aio.read(&skip, file, buf, 4, 0);
+    assert(queued);
+    done = skip.wait(1000);
+    assert(done);
+    assert(bad.result() < 0);
+    assert(skip.result() == -ECANCELED);
+
+    // a chain is not split to make room when the queue fills...
+    {
+        AsyncIO small(4, 1, emulated);
+        testRequest fill[3], first, last;
+        char spare[5][4];
+        for(unsigned pos = 0; pos < 3; ++pos) {
+            queued = small.read(&fill[pos], file, spare[pos], 4, 0);
+            assert(queued);
+        }
+        queued = small.read(&first, (fd_t)-1, spare[3], 4, 0, true);
+        assert(queued);
+        queued = small.read(&last, file, spare[4], 4, 0);
+        assert(queued);
+        done = last.wait(1000);
+        assert(done);
+        assert(first.result() < 0);
+        assert(last.result() == -ECANCELED);
+    }
+    file.close();
+    fsys::erase("asyncio.tmp");
+
+    socket_t pair[2];
+    int rtn = ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    assert(rtn == 0);
+    queued = aio.files(pair, 2);
+    assert(queued);
+    queued = aio.recv(&rx, pair[0], buf, 5);
+    assert(queued);
+    queued = aio.send(&tx, pair[1], "fiver", 5);
+    assert(queued);
+    aio.flush();
+    done = rx.wait(1000) && tx.wait(1000);
+    assert(done);
+    assert(rx.result() == 5 && tx.result() == 5);
+    assert(!memcmp(buf, "fiver", 5));
+    ::close(pair[0]);
+    ::close(pair[1]);
+    aio.files(NULL, 0);
+
+    ListenSocket listener("127.0.0.1", "4447", 5);
+    Socket::address target("127.0.0.1", 4447);
+    socket_t client = Socket::create(AF_INET, SOCK_STREAM, 0);
+    queued = aio.accept(&ac, listener);
+    assert(queued);
+    queued = aio.connect(&cn, client, target.get(AF_INET));
+    assert(queued);
+    done = cn.wait(1000) && ac.wait(1000);
+    assert(done);
+    assert(cn.result() == 0);
+    assert(ac.result() >= 0);
+    Socket::release((socket_t)ac.result());
+    Socket::release(client);
+    assert(completions == 14);
+
+    // stopping the engine cancels requests still in flight...
+    testRequest idle;
+    AsyncIO *stopping = new AsyncIO(4, 1, emulated);
+    rtn = ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    assert(rtn == 0);
+    queued = stopping->recv(&idle, pair[0], buf, 4);
+    assert(queued);
+    stopping->flush();
+    delete stopping;
+    assert(idle.is_done());
+    assert(idle.result() == -ECANCELED);
+    ::close(pair[0]);
+    ::close(pair[1]);
+}
+
+static void testTransfer(void)
+{
+    static char data[100000], check[100000];
+    unsigned pos;
+
+    for(pos = 0; pos < sizeof(data); ++pos)
+        data[pos] = (char)(pos % 251);
+
+    fsys source("transfer.tmp", 0640, fsys::RDWR);
+    assert(is(source));
+    ssize_t result = source.write(data, sizeof(data));
+    assert(result == (ssize_t)sizeof(data));
+    source.close();
+
+    int rtn = fsys::copy("transfer.tmp", "copied.tmp");
+    assert(rtn == 0);
+    fsys copied("copied.tmp", fsys::RDONLY);
+    assert(is(copied));
+    result = copied.read(check, sizeof(check));
+    assert(result == (ssize_t)sizeof(check));
+    assert(!memcmp(data, check, sizeof(data)));
+    copied.close();
+
+#ifdef  __linux__
+    // procfs files copy nothing in the kernel, yet still have content...
+    rtn = fsys::copy("/proc/self/status", "copied.tmp");
+    assert(rtn == 0);
+    copied.open("copied.tmp", fsys::RDONLY);
+    result = copied.read(check, sizeof(check));
+    assert(result > 0);
+    copied.close();
+#endif
+
+    // a file sent to one end of a socket pair is received from the other
+    // end into a second file...
+    socket_t pair[2];
+    rtn = ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    assert(rtn == 0);
+    source.open("transfer.tmp", fsys::RDONLY);
+    result = fsys::sendfile(pair[0], *source, 4096);
+    assert(result == 4096);
+    source.close();
+    ::close(pair[0]);
+
+    fsys target("received.tmp", 0640, fsys::RDWR);
+    assert(is(target));
+    result = fsys::recvfile(*target, pair[1]);
+    assert(result == 4096);
+    ::close(pair[1]);
+    target.seek(0);
+    result = target.read(check, sizeof(check));
+    assert(result == 4096);
+    assert(!memcmp(data, check, 4096));
+    target.close();
+
+    fsys::erase("transfer.tmp");
+    fsys::erase("copied.tmp");
+    fsys::erase("received.tmp");
+}
+
+static void testPackets(void)
+{
+    PacketBuffer packets(4, 64);
+    char text[8];
+    bool queued;
+    unsigned count;
+    ssize_t result;
+
+    Socket receiver("127.0.0.1", "4448", AF_INET, SOCK_DGRAM);
+    Socket sender(AF_INET, SOCK_DGRAM);
+    Socket::address target("127.0.0.1", 4448);
+
+    queued = packets.put("one", 3, target.get(AF_INET));
+    assert(queued);
+    queued = packets.put("two", 3, target.get(AF_INET));
+    assert(queued);
+    queued = packets.put("three", 5);
+    assert(queued);
+    queued = packets.put(text, 65);
+    assert(!queued);
+    count = sender.writeto(packets, target.get(AF_INET));
+    assert(count == 3);
+    assert(!packets);
+
+    count = receiver.readfrom(packets);
+    assert(count == 3);
+    assert(packets[0].size == 3 && !memcmp(packets[0].data, "one", 3));
+    assert(packets[2].size == 5 && !memcmp(packets[2].data, "three", 5));
+    assert(Socket::port(packets[1].addr()) != 0);
+
+    // datagrams received past the end of the ring wrap to its front...
+    socket_t pair[2];
+    int rtn = ::socketpair(AF_UNIX, SOCK_DGRAM, 0, pair);
+    assert(rtn == 0);
+    packets.release(2);
+    for(unsigned pos = 0; pos < 3; ++pos) {
+        snprintf(text, sizeof(text), "msg%u", pos);
+        result = Socket::sendto(pair[1], text, 4);
+        assert(result == 4);
+    }
+    result = Socket::recvfrom(pair[0], packets);
+    assert(result == 3);
+    assert(packets.count() == 4 && !packets.available());
+    assert(!memcmp(packets[1].data, "msg0", 4));
+    assert(!memcmp(packets[3].data, "msg2", 4));
+    result = Socket::recvfrom(pair[0], packets, MSG_DONTWAIT);
+    assert(result == 0);
+
+    // relay the batch on to the other end...
+    packets.release(1);
+    PacketBuffer::packet *item = packets.reserve();
+    memcpy(item->data, "last", 4);
+    item->size = 4;
+    packets.commit();
+    result = Socket::sendto(pair[0], packets);
+    assert(result == 4);
+    result = Socket::recvfrom(pair[1], packets);
+    assert(result == 4);
+    assert(!memcmp(packets[3].data, "last", 4));
+    ::close(pair[0]);
+    ::close(pair[1]);
+}
+
+static void testSegments(void)
+{
+    static char data[12000], buffer[65536];
+    unsigned pos;
+
+    for(pos = 0; pos < sizeof(data); ++pos)
+        data[pos] = (char)(pos / 1000);
+
+    Socket::segments tail(data, 2500, 1000);
+    assert(tail.count() == 3);
+    assert(tail.size(2) == 500);
+    assert(tail[2] == data + 2000);
+    assert(tail[3] == NULL);
+
+    Socket receiver("127.0.0.1", "4449", AF_INET, SOCK_DGRAM);
+    Socket sender(AF_INET, SOCK_DGRAM);
+    Socket::address target("127.0.0.1", 4449);
+    receiver.coalesce(true);
+
+    Socket::segments out(data, sizeof(data), 1000);
+    assert(out.count() == 12);
+    ssize_t result = Socket::sendto((socket_t)sender, out, 0, target.get(AF_INET));
+    assert(result == (ssize_t)sizeof(data));
+
+    // datagrams may arrive coalesced or singly, either way the views
+    // index them in order...
+    size_t received = 0;
+    unsigned datagrams = 0;
+    while(received < sizeof(data)) {
+        Socket::segments in;
+        result = Socket::recvfrom((socket_t)receiver, in, buffer, sizeof(buffer));
+        assert(result > 0);
+        for(pos = 0; pos < in.count(); ++pos) {
+            assert(in.size(pos) == 1000);
+            assert(!memcmp(in[pos], data + received, 1000));
+            received += 1000;
+            ++datagrams;
+        }
+    }
+    assert(datagrams == 12);
+}
+
+static void testShards(void)
+{
+    TCPShards shards("127.0.0.1", "4450", 2, 16);
+    Socket::address target("127.0.0.1", 4450);
+    socket_t clients[6], accepted[8];
+    unsigned pos, total = 0;
+    int rtn;
+
+    assert(shards.shards() >= 1);
+    assert(shards[0] != shards[1] || shards.shards() == 1);
+    for(pos = 0; pos < 6; ++pos) {
+        clients[pos] = Socket::create(AF_INET, SOCK_STREAM, 0);
+        rtn = Socket::connectto(clients[pos], *target);
+        assert(rtn == 0);
+    }
+
+    // each shard drains its own queue, and together they see them all...
+    for(pos = 0; pos < shards.shards(); ++pos) {
+        TCPServer *server = shards[pos];
+        while(total < 6 && server->wait(100))
+            total += server->accept(accepted + total, 8 - total);
+        assert(!(fcntl(server->handle(), F_GETFL) & O_NONBLOCK));
+    }
+    assert(total == 6);
+    for(pos = 0; pos < total; ++pos) {
+        assert(fcntl(accepted[pos], F_GETFL) & O_NONBLOCK);
+        assert(fcntl(accepted[pos], F_GETFD) & FD_CLOEXEC);
+        Socket::release(accepted[pos]);
+    }
+    for(pos = 0; pos < 6; ++pos)
+        Socket::release(clients[pos]);
+
+    // an address that cannot be bound leaves no server to hand out...
+    TCPShards none("192.0.2.1", "4451", 2);
+    assert(none.shards() == 0);
+    assert(none[0] == NULL);
+}
+
+static void testRace(void)
+{
+    TCPServer server("127.0.0.1", "4452", 4);
+    Socket::address list("192.0.2.1", "4452");
+    Socket::address refused("127.0.0.1", "4453");
+    Socket client(AF_INET, SOCK_STREAM, 0);
+    Timer limit((timeout_t)3000);
+    socket_t so;
+    bool ready;
+    int rtn;
+
+    // an address that never answers only delays the next attempt...
+    list.add("127.0.0.1", "4452");
+    so = Socket::race(*list, 5000, 100);
+    assert(so != INVALID_SOCKET);
+    assert(!(fcntl(so, F_GETFL) & O_NONBLOCK));
+    ready = server.wait(1000);
+    assert(ready);
+    Socket::release(server.accept());
+    Socket::release(so);
+
+    rtn = client.connectto(*list, 5000, 100);
+    assert(rtn == 0);
+    ready = server.wait(1000);
+    assert(ready);
+    Socket::release(server.accept());
+    assert(limit.get() > 0);
+
+    so = Socket::race(*refused, 1000, 100);
+    assert(so == INVALID_SOCKET);
+    assert(errno == ECONNREFUSED);
+}
+#endif
+
 extern "C" int main()
 {
     struct sockaddr_internet addr;
@@ -98,5 +525,108 @@ extern "C" int main()
         assert(0 == strcmp(addrbuf, "44:22:66::1"));
     }
 #endif
+
+    cidr::policy *acl = NULL;
+    cidr all(&acl, "0.0.0.0/0", "all");
+    cidr lan(&acl, "10.0.0.0/8", "lan");
+    cidr dup(&acl, "10.0.0.0/8", "dup");
+    cidr host(&acl, "10.1.2.3/32", "host");
+    cidr site(&acl, "10.1.0.0/16", "site");
+    cidr::table index(acl);
+    Socket::address probe("10.1.2.3", 80), other("10.2.0.1", 80), outside("192.168.1.1", 80);
+    assert(index.size() == 4);
+    assert(index.find(probe.getAddr()) == cidr::find(acl, probe.getAddr()));
+    assert(eq(index.find(probe.getAddr())->getName(), "host"));
+    assert(index.find(other.getAddr()) == cidr::find(acl, other.getAddr()));
+    assert(eq(index.find(outside.getAddr())->getName(), "all"));
+    assert(index.container(probe.getAddr()) == &all);
+    cidr::table copy;
+    assert(copy.find(probe.getAddr()) == NULL);
+    copy = index;
+    assert(copy.find(probe.getAddr()) == &host);
+
+    testWheel wheel;
+    testTimer near(&wheel, 5), far(&wheel, 100), idle(&wheel, 600000);
+    idle.disarm();
+    timeout_t next = wheel.expire();
+    assert(next > 0 && next <= 64);
+    Thread::sleep(20);
+    wheel.expire();
+    assert(expires == 1);
+    far.arm(10);
+    Thread::sleep(100);
+    wheel.expire();
+    assert(expires == 2);
+    idle.arm(150);
+    next = wheel.expire();
+    assert(next > 0 && next <= 150);
+    Thread::sleep(160);
+    wheel.expire();
+    assert(expires == 3);
+    next = wheel.expire();
+    assert(next == Timer::inf);
+    expires = 0;
+
+#ifndef _MSWINDOWS_
+    socket_t pair[2];
+    int rtn = ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    assert(rtn == 0);
+
+    testQueue tq;
+    testTimer tm(&tq);
+    Reactor reactor(&tq);
+    testHandler *hp = new testHandler(pair[0]);
+    assert(reactor);
+    bool attached = reactor.attach(hp, Reactor::READABLE | Reactor::EDGE);
+    assert(attached);
+    assert(reactor.count() == 1);
+    ssize_t sent = ::send(pair[1], "x", 1, 0);
+    assert(sent == 1);
+    rtn = reactor.poll(1000);
+    assert(rtn == 1);
+    assert(reads == 1);
+    rtn = reactor.poll(100);
+    assert(rtn == 0);
+    assert(expires == 1);
+    delete hp;
+    assert(reactor.count() == 0);
+    ::close(pair[0]);
+    ::close(pair[1]);
+
+    // a oneshot reader still collects what was sent before a hangup...
+    rtn = ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    assert(rtn == 0);
+    testWatch *wp = new testWatch(pair[0]);
+    attached = reactor.attach(wp, Reactor::READABLE | Reactor::ONESHOT);
+    assert(attached);
+    sent = ::send(pair[1], "y", 1, 0);
+    assert(sent == 1);
+    ::close(pair[1]);
+    reactor.poll(1000);
+    assert(wp->readables == 1 && wp->hangups == 1);
+    delete wp;
+    ::close(pair[0]);
+
+    // and a writer is not told its peer stopped sending...
+    rtn = ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+    assert(rtn == 0);
+    wp = new testWatch(pair[0]);
+    attached = reactor.attach(wp, Reactor::WRITABLE);
+    assert(attached);
+    ::shutdown(pair[1], SHUT_WR);
+    reactor.poll(1000);
+    assert(wp->writables == 1 && wp->readables == 0 && wp->hangups == 0);
+    delete wp;
+    ::close(pair[0]);
+    ::close(pair[1]);
+
+    testAsync(false);
+    testAsync(true);
+    testTransfer();
+    testPackets();
+    testSegments();
+    testShards();
+    testRace();
+#endif
     return 0;
 }
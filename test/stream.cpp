@@ -41,6 +41,83 @@ public:
     }
 };
 
+static unsigned echoed = 0, replies = 0;
+
+class EchoFiber : public Scheduler::fiber
+{
+private:
+    TCPServer *server;
+    unsigned remaining;
+
+public:
+    EchoFiber(TCPServer *listener, unsigned count) : Scheduler::fiber(true), server(listener), remaining(count) {};
+
+    void run() {
+        char line[64];
+
+        socket_t so = server->accept();
+        if(--remaining)
+            scheduler()->start(new EchoFiber(server, remaining));
+        ssize_t len = Socket::readline(so, line, sizeof(line), Timer::inf);
+        if(len > 0 && Socket::sendto(so, line, (size_t)len) == len)
+            ++echoed;
+        Socket::release(so);
+    }
+};
+
+class ClientFiber : public Scheduler::fiber
+{
+private:
+    unsigned id;
+
+public:
+    ClientFiber(unsigned number) : Scheduler::fiber(true), id(number) {};
+
+    void run() {
+        char line[64], expected[64];
+        Socket::address localhost("127.0.0.1", 9001);
+        tcpstream tcp(localhost);
+        snprintf(expected, sizeof(expected), "fiber %u", id);
+        tcp << expected << endl;
+        tcp.getline(line, sizeof(line));
+        if(eq(line, expected))
+            ++replies;
+    }
+};
+
+static unsigned waited = 0;
+
+class WaitFiber : public Scheduler::fiber
+{
+private:
+    socket_t so;
+    unsigned events, expected;
+    timeout_t timeout;
+
+public:
+    WaitFiber(socket_t socket, unsigned wait, timeout_t limit, unsigned result) :
+    Scheduler::fiber(true), so(socket), events(wait), expected(result), timeout(limit) {};
+
+    void run() {
+        if(Scheduler::wait(so, events, timeout) == expected)
+            ++waited;
+    }
+};
+
+class SendFiber : public Scheduler::fiber
+{
+private:
+    socket_t so;
+
+public:
+    SendFiber(socket_t socket) : Scheduler::fiber(true), so(socket) {};
+
+    void run() {
+        Scheduler::sleep(50);
+        Socket::sendto(so, "x", 1);
+    }
+};
+
 int main(int argc, char *argv[])
 {
     ThreadOut thread;
@@ -63,6 +140,35 @@ int main(int argc, char *argv[])
         String s;
         std::null >> s;
 
+        if(Scheduler::is_supported()) {
+            TCPServer server("127.0.0.1", "9001", 32);
+            Scheduler scheduler(16384);
+            scheduler << new EchoFiber(&server, 24);
+            for(unsigned id = 0; id < 24; ++id)
+                scheduler << new ClientFiber(id);
+            assert(scheduler.fibers() == 25);
+            scheduler.run();
+            assert(scheduler.fibers() == 0);
+            assert(echoed == 24);
+            assert(replies == 24);
+
+#ifndef _MSWINDOWS_
+            // a reader, a writer, and a reader that gives up all wait on
+            // one socket at the same time...
+            socket_t pair[2];
+            int rtn = ::socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+            assert(rtn == 0);
+            scheduler << new WaitFiber(pair[0], Reactor::READABLE, 2000, Reactor::READABLE);
+            scheduler << new WaitFiber(pair[0], Reactor::WRITABLE, 2000, Reactor::WRITABLE);
+            scheduler << new WaitFiber(pair[0], Reactor::READABLE, 20, 0);
+            scheduler << new SendFiber(pair[1]);
+            scheduler.run();
+            assert(waited == 3);
+            ::close(pair[0]);
+            ::close(pair[1]);
+#endif
+        }
+
         return 0;
     }
     assert(0);
@@ -42,6 +42,46 @@ private:
 
 static testLocal local;
 
+static TaskPool *tasks = nullptr;
+static volatile atomic_t finished = 0;
+
+class testSum : public futuretask<unsigned>
+{
+private:
+    unsigned from, to;
+
+    unsigned compute(void) __FINAL {
+        // fan out to sub-tasks from within the pool...
+        if(to - from > 64) {
+            unsigned mid = from + (to - from) / 2;
+            testSum lower(from, mid), upper(mid, to);
+            *tasks << &lower << &upper;
+            return *lower + *upper;
+        }
+        unsigned total = 0;
+        for(unsigned pos = from; pos < to; ++pos)
+            total += pos;
+        return total;
+    }
+
+public:
+    testSum(unsigned start, unsigned end) : futuretask<unsigned>() {
+        from = start;
+        to = end;
+    }
+};
+
+class testDetached : public TaskPool::task
+{
+private:
+    void run(void) __FINAL {
+        Atomic::fetch_add(&finished, 1);
+    }
+
+public:
+    testDetached() : TaskPool::task(true) {}
+};
+
 class testThread : public JoinableThread
 {
 public:
@@ -56,6 +96,172 @@ public:
     };
 };
 
+static BiasedLock biasing;
+static sharedlock_t selected(&biasing);
+static volatile unsigned left = 0, right = 0;
+static volatile bool torn = false;
+
+class testBiased : public JoinableThread
+{
+private:
+    bool writer;
+
+public:
+    testBiased(bool writing) : JoinableThread(), writer(writing) {};
+
+    ~testBiased() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 2000; ++pos) {
+            if(writer) {
+                selected.modify();
+                ++left;
+                Thread::yield();
+                ++right;
+                selected.commit();
+            }
+            else {
+                selected.access();
+                if(left != right)
+                    torn = true;
+                selected.release();
+            }
+        }
+    };
+};
+
+static mapref<int, int> striped(7, 0, false, 8);
+
+class testStriped : public JoinableThread
+{
+private:
+    int base;
+
+public:
+    testStriped(int offset) : JoinableThread(), base(offset) {};
+
+    ~testStriped() {
+        join();
+    }
+
+    void run(void) {
+        for(int pos = base; pos < base + 500; ++pos)
+            striped(pos, pos + 1);
+    };
+};
+
+static mapped_pointer<int, int> nesting(37, NULL, 0, false, 4);
+static int nest = 3;
+static volatile bool nested = false;
+
+class testNested : public JoinableThread
+{
+public:
+    testNested() : JoinableThread() {};
+
+    ~testNested() {
+        join();
+    }
+
+    void run(void) {
+        nesting.remove(&nest);
+        nested = true;
+    };
+};
+
+static mpmcref<int> messages(16);
+static TicketLock ticket;
+static AdaptiveMutex adaptive;
+static unsigned ticketed = 0, adapted = 0;
+
+class testLocking : public JoinableThread
+{
+public:
+    testLocking() : JoinableThread() {};
+
+    ~testLocking() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 10000; ++pos) {
+            TicketLock::autolock exclusive(&ticket);
+            ++ticketed;
+        }
+        for(unsigned pos = 0; pos < 10000; ++pos) {
+            AdaptiveMutex::autolock exclusive(&adaptive);
+            ++adapted;
+        }
+    };
+};
+
+typedef struct {
+    unsigned serial, twice;
+} pair_t;
+
+static seqlock<pair_t> paired;
+
+class testSequence : public JoinableThread
+{
+public:
+    testSequence() : JoinableThread() {};
+
+    ~testSequence() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 1; pos <= 10000; ++pos) {
+            pair_t& current = paired.modify();
+            current.serial = pos;
+            current.twice = pos * 2;
+            paired.commit();
+        }
+    };
+};
+
+static Semaphore pings(1, 0), pongs(1, 0);
+static Barrier rendezvous(2);
+static TimedEvent finishing;
+static unsigned handoffs = 0;
+
+class testHandoff : public JoinableThread
+{
+public:
+    testHandoff() : JoinableThread() {};
+
+    ~testHandoff() {
+        join();
+    }
+
+    void run(void) {
+        for(unsigned pos = 0; pos < 1000; ++pos) {
+            pings.wait();
+            ++handoffs;
+            pongs.release();
+        }
+        rendezvous.wait();
+        finishing.signal();
+    };
+};
+
+class testProducer : public JoinableThread
+{
+public:
+    testProducer() : JoinableThread() {};
+
+    ~testProducer() {
+        join();
+    }
+
+    void run(void) {
+        for(int pos = 1; pos <= 1000; ++pos)
+            messages << pos;
+    };
+};
+
 extern "C" int main()
 {
     time_t now, later;
@@ -81,6 +287,203 @@ extern "C" int main()
     evt.wait(2000);
     time(&later);
     assert(later >= now + 1);
+
+    tasks = new TaskPool(4);
+    assert(tasks->size() == 4);
+    testSum sum(0, 10000);
+    bool done = sum.wait(0);
+    assert(!done);
+    tasks->submit(&sum);
+    done = sum.wait();
+    assert(done);
+    assert(sum.is_done());
+    assert(*sum == 49995000);
+    for(unsigned pos = 0; pos < 100; ++pos)
+        *tasks << new testDetached();
+    delete tasks;
+    assert(Atomic::load(&finished) == 100);
+
+    int guarded[8];
+    unsigned long lookups, contended;
+    bool locked;
+    for(unsigned pos = 0; pos < 8; ++pos) {
+        locked = Mutex::protect(&guarded[pos]);
+        assert(locked);
+    }
+    for(unsigned pos = 0; pos < 8; ++pos) {
+        locked = Mutex::release(&guarded[pos]);
+        assert(locked);
+    }
+    locked = Mutex::release(&guarded[0]);
+    assert(!locked);
+    Mutex::statistics(&lookups, &contended);
+    assert(lookups >= 17);
+    assert(contended <= lookups);
+
+    RWLock::reader::lock(&guarded[0]);
+    RWLock::reader::lock(&guarded[0]);
+    locked = RWLock::release(&guarded[0]);
+    assert(locked);
+    locked = RWLock::release(&guarded[0]);
+    assert(locked);
+    locked = RWLock::writer::lock(&guarded[0], 0);
+    assert(locked);
+    locked = RWLock::release(&guarded[0]);
+    assert(locked);
+    RWLock::statistics(&lookups, NULL);
+    assert(lookups >= 6);
+
+    BiasedLock biased;
+    biased.access();
+    biased.access();
+    biased.exclusive();
+    biased.access();
+    biased.release();
+    biased.share();
+    biased.release();
+    biased.release();
+    biased.modify();
+    biased.access();
+    biased.release();
+    biased.commit();
+
+    // readers never see a writer part way through a change...
+    testBiased *users[5];
+    for(unsigned pos = 0; pos < 5; ++pos) {
+        users[pos] = new testBiased(pos < 2);
+        users[pos]->start();
+    }
+    for(unsigned pos = 0; pos < 5; ++pos)
+        delete users[pos];
+    assert(!torn);
+    assert(left == 4000 && right == 4000);
+
+    mapref<int, int> table(37, 0, true);
+    typeref<int> key(3), value(9);
+    table(key, value);
+    assert(*table(key) == 9);
+    typeref<int> missing = table(4);
+    assert(!is(missing));
+
+    testStriped *writers[4];
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        writers[pos] = new testStriped(pos * 500);
+        writers[pos]->start();
+    }
+    for(unsigned pos = 0; pos < 4; ++pos)
+        delete writers[pos];
+    assert(striped.count() == 2000);
+    for(int pos = 0; pos < 2000; ++pos)
+        assert(*striped(pos) == pos + 1);
+    size_t buckets;
+    striped.statistics(&buckets);
+    assert(buckets > 7);
+
+    testProducer *producers[2];
+    for(unsigned pos = 0; pos < 2; ++pos) {
+        producers[pos] = new testProducer();
+        producers[pos]->start();
+    }
+    long received = 0;
+    for(unsigned pos = 0; pos < 2000; ++pos) {
+        typeref<int> msg;
+        messages >> msg;
+        received += *msg;
+    }
+    for(unsigned pos = 0; pos < 2; ++pos)
+        delete producers[pos];
+    assert(received == 1001000);
+    assert(messages.count() == 0);
+
+    testLocking *lockers[4];
+    for(unsigned pos = 0; pos < 4; ++pos) {
+        lockers[pos] = new testLocking();
+        lockers[pos]->start();
+    }
+    for(unsigned pos = 0; pos < 4; ++pos)
+        delete lockers[pos];
+    assert(ticketed == 40000);
+    assert(adapted == 40000);
+    locked = ticket.try_acquire();
+    assert(locked);
+    locked = ticket.try_acquire();
+    assert(!locked);
+    ticket.release();
+    locked = adaptive.try_acquire();
+    assert(locked);
+    locked = adaptive.try_acquire();
+    assert(!locked);
+    adaptive.release();
+
+    testSequence *sequencer = new testSequence();
+    sequencer->start();
+    pair_t snapshot;
+    do {
+        snapshot = *paired;
+        assert(snapshot.twice == snapshot.serial * 2);
+    } while(snapshot.serial < 10000);
+    delete sequencer;
+
+    testHandoff *handoff = new testHandoff();
+    handoff->start();
+    for(unsigned pos = 0; pos < 1000; ++pos) {
+        pings.release();
+        pongs.wait();
+    }
+    assert(handoffs == 1000);
+    // timed waits add to the event's timer, so restart it from now...
+    finishing.reset();
+    bool waited = rendezvous.wait(5000);
+    assert(waited);
+    waited = finishing.wait(5000);
+    assert(waited);
+    delete handoff;
+    waited = pings.wait(10);
+    assert(!waited);
+    waited = finishing.wait(10);
+    assert(!waited);
+    finishing.signal();
+    finishing.wait();
+
+    int first = 1, second = 2;
+    mapped_pointer<int, int> pointers(37, NULL, 0, false, 4);
+    pointers.set(&first, &first);
+    pointers.set(&second, &second);
+    int *one = pointers.get(&first);
+    int *two = pointers.get(&second);
+    assert(one == &first && two == &second);
+    pointers.release(one);
+    pointers.release(two);
+    pointers.remove(&first);
+    one = pointers.get(&first);
+    assert(one == nullptr);
+
+    // nested gets of one object each hold the stripe until released...
+    nesting.set(&nest, &nest);
+    one = nesting.get(&nest);
+    two = nesting.get(&nest);
+    assert(one == &nest && two == &nest);
+    nesting.release(two);
+    nesting.release(one);
+    testNested remover;
+    remover.start();
+    for(unsigned tries = 0; !nested && tries < 100; ++tries)
+        Thread::sleep(10);
+    assert(nested);
+
+    sharedref<int> config;
+    config = 1;
+    {
+        sharedref<int>::reader snapshot(config);
+        assert(*snapshot == 1);
+        config = 2;
+        assert(*snapshot == 1);
+        sharedref<int>::reader nested(config);
+        assert(*nested == 2);
+    }
+    SharedRef::reclaim();
+    typeref<int> current = *config;
+    assert(*current == 2);
     return 0;
 }
 
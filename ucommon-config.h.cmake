@@ -37,6 +37,12 @@
 #cmakedefine HAVE_REGEX_H 1
 #cmakedefine HAVE_SYS_INOTIFY_H 1
 #cmakedefine HAVE_SYS_EVENT_H 1
+#cmakedefine HAVE_SYS_EPOLL_H 1
+#cmakedefine HAVE_SYS_EVENTFD_H 1
+#cmakedefine HAVE_LINUX_FUTEX_H 1
+#cmakedefine HAVE_LINUX_IO_URING_H 1
+#cmakedefine HAVE_UCONTEXT_H 1
+#cmakedefine HAVE_SYS_SENDFILE_H 1
 #cmakedefine HAVE_SYSLOG_H 1
 #cmakedefine HAVE_LIBINTL_H 1
 #cmakedefine HAVE_NETINET_IN_H 1
@@ -82,6 +88,11 @@
 #cmakedefine HAVE_SYSCONF 1
 #cmakedefine HAVE_FTRUNCATE 1
 #cmakedefine HAVE_PWRITE 1
+#cmakedefine HAVE_COPY_FILE_RANGE 1
+#cmakedefine HAVE_SPLICE 1
+#cmakedefine HAVE_RECVMMSG 1
+#cmakedefine HAVE_SENDMMSG 1
+#cmakedefine HAVE_ACCEPT4 1
 #cmakedefine HAVE_SETPGRP 1
 #cmakedefine HAVE_SETLOCALE 1
 #cmakedefine HAVE_GETTEXT 1
@@ -16,7 +16,7 @@
 # Please submit bugfixes or comments via http://bugs.opensuse.org/
 #
 
-%define libname	libucommon8
+%define libname	libucommon9
 %if %{_target_cpu} == "x86_64"
 %define	build_docs	1
 %else